@@ -0,0 +1,92 @@
+/**
+ * tone_detect.c
+ * Written by Clyne Sullivan.
+ *
+ * An example host processing plugin: a Goertzel detector that reports the level of one tone in
+ * the stream, and whether it is above a threshold. The samples are passed on unchanged.
+ *
+ * Build with:
+ *   cc -O2 -shared -fPIC -I../source -o tone_detect.so tone_detect.c -lm
+ * and add it to the host processing chain with:
+ *   plugin ./plugins/tone_detect.so FREQ [THRESHOLD_VOLTS]
+ */
+
+#include "stmdsp_plugin.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TWO_PI 6.283185307179586
+
+typedef struct {
+    double coeff;
+    double threshold;
+    double s1, s2;
+    size_t count, window;
+    double level;
+} tone_state;
+
+static void *tone_create(const char *args, double rate)
+{
+    double frequency = 0, threshold = 0.1;
+    if (rate <= 0 || sscanf(args, "%lf %lf", &frequency, &threshold) < 1 ||
+        frequency <= 0 || frequency >= rate / 2)
+        return NULL;
+
+    tone_state *state = calloc(1, sizeof(tone_state));
+    if (state) {
+        // Windows of about 10 ms, rounded to whole cycles of the tone.
+        const double cycles = ceil(frequency * 0.01);
+        state->window = (size_t)(cycles * rate / frequency + 0.5);
+        state->coeff = 2 * cos(TWO_PI * frequency / rate);
+        state->threshold = threshold;
+    }
+    return state;
+}
+
+static void tone_destroy(void *state)
+{
+    free(state);
+}
+
+static int tone_process(void *p, stmdsp_block *block)
+{
+    tone_state *state = p;
+
+    for (size_t i = 0; i < block->count; i++) {
+        const double s = block->samples[i] + state->coeff * state->s1 - state->s2;
+        state->s2 = state->s1;
+        state->s1 = s;
+
+        if (++state->count == state->window) {
+            const double power = state->s1 * state->s1 + state->s2 * state->s2 -
+                state->coeff * state->s1 * state->s2;
+            state->level = 2 * sqrt(power > 0 ? power : 0) / state->window;
+            state->s1 = state->s2 = 0;
+            state->count = 0;
+        }
+    }
+
+    if (block->metric_capacity >= 2) {
+        block->metrics[0].name = "level";
+        block->metrics[0].value = state->level;
+        block->metrics[1].name = "detected";
+        block->metrics[1].value = state->level >= state->threshold;
+        block->metric_count = 2;
+    }
+    return 0;
+}
+
+static const stmdsp_plugin tone_plugin = {
+    STMDSP_PLUGIN_API_VERSION,
+    "tone detect",
+    tone_create,
+    tone_destroy,
+    tone_process,
+};
+
+STMDSP_PLUGIN_EXPORT const stmdsp_plugin *stmdsp_plugin_entry(void)
+{
+    return &tone_plugin;
+}
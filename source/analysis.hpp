@@ -0,0 +1,55 @@
+/**
+ * @file analysis.hpp
+ * @brief Shared sample history for the analysis views.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_ANALYSIS_HPP
+#define STMDSPGUI_ANALYSIS_HPP
+
+#include <cstddef>
+
+enum class AnalysisStream : int {
+    Output = 0,
+    Input
+};
+
+/**
+ * Returns the number of samples received on the given stream so far. Sample
+ * positions used with analysisRead() count from zero up to this value.
+ * The count restarts from zero if the stream's sample rate changes, or if the
+ * input stream is switched on or off. While both streams are fed, equal
+ * positions refer to samples of the same instant.
+ */
+std::size_t analysisWritten(AnalysisStream stream);
+
+/**
+ * Copies count samples of the stream, starting at position first, into out.
+ * Samples are converted to volts.
+ * @return False if the requested samples are not (or no longer) available.
+ */
+bool analysisRead(AnalysisStream stream, std::size_t first, std::size_t count,
+    float *out);
+
+/**
+ * Returns the sample rate of the analyzed streams, or zero if unknown.
+ */
+unsigned int analysisSampleRate();
+
+void spectrumRenderWindow(bool *open);
+bool spectrumWantsInput();
+
+void spectrogramRenderWindow(bool *open);
+bool spectrogramWantsInput();
+
+void measureRenderWindow(bool *open);
+bool measureWantsInput();
+
+void bodeRenderWindow(bool *open);
+
+#endif // STMDSPGUI_ANALYSIS_HPP
@@ -0,0 +1,310 @@
+/**
+ * @file capture.cpp
+ * @brief Binary sample capture files with optional block compression.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "capture.hpp"
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace capture
+{
+    // A 16-bit sample delta zigzags into at most 17 bits.
+    constexpr unsigned int MAX_WIDTH = 17;
+
+    static inline int32_t unzigzag(uint32_t n) {
+        return static_cast<int32_t>(n >> 1) ^ -static_cast<int32_t>(n & 1);
+    }
+
+    std::vector<uint8_t> encode(const stmdsp::adcsample_t *samples,
+        std::size_t count, bool compress, encoding& type)
+    {
+        const auto rawSize = count * sizeof(stmdsp::adcsample_t);
+
+        if (compress && count > 0) {
+            // Packed layout: one width byte per group, then a single
+            // little-endian bitstream holding every group's values.
+            const std::size_t groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+            std::vector<uint8_t> out (groups);
+            out.reserve(rawSize);
+
+            std::array<uint32_t, GROUP_SIZE> values;
+            uint64_t acc = 0;
+            unsigned int accBits = 0;
+            int32_t prev = 0;
+
+            for (std::size_t g = 0; g < groups; ++g) {
+                const auto n = std::min<std::size_t>(GROUP_SIZE, count - g * GROUP_SIZE);
+                const auto *in = samples + g * GROUP_SIZE;
+
+                const auto bits = kernels::packDeltas(in, n, prev, values.data());
+                prev = in[n - 1];
+
+                const unsigned int width = std::bit_width(bits);
+                out[g] = static_cast<uint8_t>(width);
+
+                for (std::size_t i = 0; i < n && width > 0; ++i) {
+                    acc |= static_cast<uint64_t>(values[i]) << accBits;
+                    accBits += width;
+                    while (accBits >= 8) {
+                        out.push_back(static_cast<uint8_t>(acc));
+                        acc >>= 8;
+                        accBits -= 8;
+                    }
+                }
+
+                // Incompressible data; stop early and fall back to raw.
+                if (out.size() >= rawSize)
+                    break;
+            }
+
+            if (accBits > 0)
+                out.push_back(static_cast<uint8_t>(acc));
+
+            if (out.size() < rawSize) {
+                type = encoding::Packed;
+                return out;
+            }
+        }
+
+        type = encoding::Raw;
+        std::vector<uint8_t> out (rawSize);
+        std::memcpy(out.data(), samples, rawSize);
+        return out;
+    }
+
+    bool decode(const block_header& header, const uint8_t *payload,
+        stmdsp::adcsample_t *samples)
+    {
+        const std::size_t count = header.sample_count;
+        const std::size_t size = header.payload_size;
+
+        if (header.type == encoding::Raw) {
+            if (size != count * sizeof(stmdsp::adcsample_t))
+                return false;
+            std::memcpy(samples, payload, size);
+            return true;
+        } else if (header.type != encoding::Packed) {
+            return false;
+        }
+
+        const std::size_t groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+        if (size < groups)
+            return false;
+
+        const uint8_t *bytes = payload + groups;
+        const uint8_t *bytesEnd = payload + size;
+        uint64_t acc = 0;
+        unsigned int accBits = 0;
+        int32_t prev = 0;
+
+        for (std::size_t g = 0; g < groups; ++g) {
+            const unsigned int width = payload[g];
+            if (width > MAX_WIDTH)
+                return false;
+
+            const auto n = std::min<std::size_t>(GROUP_SIZE, count - g * GROUP_SIZE);
+            const uint32_t mask = (1u << width) - 1;
+            auto *out = samples + g * GROUP_SIZE;
+
+            for (std::size_t i = 0; i < n; ++i) {
+                while (accBits < width) {
+                    if (bytes == bytesEnd)
+                        return false;
+                    acc |= static_cast<uint64_t>(*bytes++) << accBits;
+                    accBits += 8;
+                }
+
+                prev += unzigzag(static_cast<uint32_t>(acc) & mask);
+                acc >>= width;
+                accBits -= width;
+                out[i] = static_cast<stmdsp::adcsample_t>(prev);
+            }
+        }
+
+        return true;
+    }
+
+    writer::~writer()
+    {
+        close();
+    }
+
+    bool writer::open(const std::string& path, unsigned int sampleRate,
+        bool compress)
+    {
+        close();
+
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file.is_open())
+            return false;
+
+        file_header header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.sample_rate = sampleRate;
+        m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        m_compress = compress;
+        m_stop = false;
+        m_thread = std::thread(&writer::thread_main, this);
+        return true;
+    }
+
+    void writer::close()
+    {
+        if (m_thread.joinable()) {
+            {
+                std::scoped_lock lock (m_lock);
+                m_stop = true;
+            }
+            m_cv.notify_one();
+            m_thread.join();
+        }
+
+        if (m_file.is_open())
+            m_file.close();
+    }
+
+    void writer::write(ChunkRef chunk, bool withInput)
+    {
+        if (!chunk || chunk->output.empty())
+            return;
+
+        {
+            std::scoped_lock lock (m_lock);
+            m_queue.emplace_back(std::move(chunk), withInput);
+        }
+        m_cv.notify_one();
+    }
+
+    void writer::thread_main()
+    {
+        std::unique_lock lock (m_lock);
+
+        while (true) {
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break; // Only reached when stopping with nothing left to write.
+
+            auto [chunk, withInput] = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            write_block(chunk->output, channel::Output);
+            if (withInput && !chunk->input.empty())
+                write_block(chunk->input, channel::Input);
+
+            chunk = {};
+            lock.lock();
+        }
+    }
+
+    void writer::write_block(const std::vector<stmdsp::adcsample_t>& samples,
+        channel ch)
+    {
+        block_header header {};
+        header.channel = ch;
+        const auto payload = encode(samples.data(), samples.size(),
+            m_compress, header.type);
+        header.sample_count = samples.size();
+        header.payload_size = payload.size();
+
+        m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_file.write(reinterpret_cast<const char *>(payload.data()),
+            payload.size());
+    }
+
+    /**
+     * Whether the header's sizes agree with each other, so that a corrupt
+     * one is caught before its sample count is trusted. A Packed payload
+     * holds at least the width byte of each group, and is smaller than the
+     * raw samples would be (or raw would have been written).
+     */
+    static bool plausible(const block_header& header)
+    {
+        const uint64_t count = header.sample_count;
+        const uint64_t size = header.payload_size;
+        const uint64_t rawSize = count * sizeof(stmdsp::adcsample_t);
+
+        if (header.type == encoding::Raw)
+            return size == rawSize;
+        if (header.type == encoding::Packed) {
+            return count > 0 && size < rawSize &&
+                (count + GROUP_SIZE - 1) / GROUP_SIZE <= size;
+        }
+        return false;
+    }
+
+    bool reader::open(const std::string& path)
+    {
+        m_index.clear();
+        m_file = std::ifstream(path, std::ios::binary);
+        if (!m_file.is_open())
+            return false;
+
+        file_header header;
+        if (!m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header.version != VERSION)
+        {
+            m_file.close();
+            return false;
+        }
+
+        m_sample_rate = header.sample_rate;
+
+        // Walk the block headers, skipping over payloads, to build the index.
+        // A truncated final block (e.g. from a crash) is simply left out, as
+        // is everything from the first corrupt block header on.
+        m_file.seekg(0, std::ios::end);
+        const auto fileSize = m_file.tellg();
+        std::streamoff offset = sizeof(file_header);
+
+        while (offset + static_cast<std::streamoff>(sizeof(block_header)) <= fileSize) {
+            block_header bh;
+            m_file.seekg(offset);
+            if (!m_file.read(reinterpret_cast<char *>(&bh), sizeof(bh)) || !plausible(bh))
+                break;
+
+            const auto next = offset + static_cast<std::streamoff>(sizeof(bh))
+                + static_cast<std::streamoff>(bh.payload_size);
+            if (next > fileSize)
+                break;
+
+            m_index.push_back({offset, bh});
+            offset = next;
+        }
+
+        m_file.clear();
+        return true;
+    }
+
+    bool reader::read_block(std::size_t block,
+        std::vector<stmdsp::adcsample_t>& samples)
+    {
+        if (block >= m_index.size())
+            return false;
+
+        const auto& entry = m_index[block];
+        m_payload.resize(entry.header.payload_size);
+        m_file.seekg(entry.offset + static_cast<std::streamoff>(sizeof(block_header)));
+        if (!m_file.read(reinterpret_cast<char *>(m_payload.data()), m_payload.size())) {
+            m_file.clear();
+            return false;
+        }
+
+        samples.resize(entry.header.sample_count);
+        return decode(entry.header, m_payload.data(), samples.data());
+    }
+}
@@ -0,0 +1,161 @@
+/**
+ * @file capture.hpp
+ * @brief Binary sample capture files with optional block compression.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_CAPTURE_HPP
+#define STMDSPGUI_CAPTURE_HPP
+
+#include "chunk.hpp"
+#include "stmdsp.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace capture
+{
+    /**
+     * A capture file is a file_header followed by any number of blocks. Each
+     * block is a block_header followed by payload_size bytes of sample data.
+     * Blocks are self-contained, so any block can be decoded without reading
+     * the ones before it.
+     */
+    constexpr char MAGIC[8] = {'S', 'T', 'M', 'D', 'S', 'P', 'C', 'P'};
+    constexpr uint32_t VERSION = 1;
+
+    enum class encoding : uint8_t {
+        Raw = 0, /* Samples stored as-is. */
+        Packed   /* Delta + zigzag, bit-packed in groups of GROUP_SIZE. */
+    };
+
+    /**
+     * Number of samples that share one bit width in a Packed block.
+     */
+    constexpr unsigned int GROUP_SIZE = 32;
+
+    struct file_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sample_rate;
+    } __attribute__ ((packed));
+
+    /**
+     * The stream a block's samples came from. When both streams are logged,
+     * each conversion period is written as an Output block immediately
+     * followed by its Input block.
+     */
+    enum class channel : uint8_t {
+        Output = 0, /* Samples processed by the device's algorithm. */
+        Input       /* Raw samples fed into the algorithm. */
+    };
+
+    struct block_header {
+        uint32_t sample_count;
+        uint32_t payload_size;
+        encoding type;
+        capture::channel channel;
+        uint8_t reserved[2];
+    } __attribute__ ((packed));
+
+    /**
+     * Encodes the given samples into a block payload.
+     * Packed encoding is used when compress is true and it is actually
+     * smaller than the raw samples; the chosen encoding is returned in type.
+     */
+    std::vector<uint8_t> encode(const stmdsp::adcsample_t *samples,
+        std::size_t count, bool compress, encoding& type);
+
+    /**
+     * Decodes a block payload into the given sample buffer, which must have
+     * room for the block's sample_count samples.
+     * @return False if the payload is malformed.
+     */
+    bool decode(const block_header& header, const uint8_t *payload,
+        stmdsp::adcsample_t *samples);
+
+    /**
+     * Writes capture files. Encoding and disk I/O are done on the writer's
+     * own thread so that the acquisition thread never waits on them.
+     */
+    class writer
+    {
+    public:
+        writer() = default;
+        ~writer();
+
+        bool open(const std::string& path, unsigned int sampleRate,
+            bool compress = true);
+        void close();
+        bool is_open() const { return m_file.is_open(); }
+
+        /**
+         * Queues a chunk to be written as an Output block, followed by an
+         * Input block if withInput is set and the chunk has input samples.
+         * The chunk is shared, not copied.
+         */
+        void write(ChunkRef chunk, bool withInput = false);
+
+    private:
+        std::ofstream m_file;
+        std::thread m_thread;
+        std::mutex m_lock;
+        std::condition_variable m_cv;
+        std::deque<std::pair<ChunkRef, bool>> m_queue;
+        bool m_compress = true;
+        bool m_stop = false;
+
+        void thread_main();
+        void write_block(const std::vector<stmdsp::adcsample_t>& samples,
+            channel ch);
+    };
+
+    /**
+     * Reads capture files. The block headers are indexed when the file is
+     * opened, allowing random access to any block.
+     */
+    class reader
+    {
+    public:
+        bool open(const std::string& path);
+        bool is_open() const { return m_file.is_open(); }
+
+        unsigned int sample_rate() const { return m_sample_rate; }
+        std::size_t block_count() const { return m_index.size(); }
+        channel block_channel(std::size_t block) const {
+            return m_index[block].header.channel;
+        }
+
+        /**
+         * Reads and decodes the given block into samples.
+         * @return False if the block could not be read or decoded.
+         */
+        bool read_block(std::size_t block,
+            std::vector<stmdsp::adcsample_t>& samples);
+
+    private:
+        struct index_entry {
+            std::streamoff offset;
+            block_header header;
+        };
+
+        std::ifstream m_file;
+        std::vector<index_entry> m_index;
+        std::vector<uint8_t> m_payload;
+        unsigned int m_sample_rate = 0;
+    };
+}
+
+#endif // STMDSPGUI_CAPTURE_HPP
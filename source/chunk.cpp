@@ -0,0 +1,122 @@
+/**
+ * @file chunk.cpp
+ * @brief Shared, pooled chunks of streamed samples and their fan-out.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "chunk.hpp"
+
+#include <algorithm>
+
+static_assert((ChunkStream::Capacity & (ChunkStream::Capacity - 1)) == 0);
+
+ChunkPool::ChunkPool(std::size_t count)
+{
+    m_chunks.reserve(count);
+    m_free.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        m_chunks.push_back(std::make_unique<SampleChunk>());
+        m_chunks.back()->m_pool = this;
+        m_free.push_back(m_chunks.back().get());
+    }
+}
+
+ChunkRef ChunkPool::acquire()
+{
+    std::scoped_lock lock (m_lock);
+
+    if (m_free.empty()) {
+        m_chunks.push_back(std::make_unique<SampleChunk>());
+        m_chunks.back()->m_pool = this;
+        return ChunkRef(m_chunks.back().get());
+    }
+
+    auto chunk = m_free.back();
+    m_free.pop_back();
+    return ChunkRef(chunk);
+}
+
+std::size_t ChunkPool::size() const
+{
+    std::scoped_lock lock (m_lock);
+    return m_chunks.size();
+}
+
+void ChunkPool::recycle(SampleChunk *chunk)
+{
+    std::scoped_lock lock (m_lock);
+    m_free.push_back(chunk);
+}
+
+void ChunkStream::publish(ChunkRef chunk)
+{
+    // The chunk being replaced is released outside of the lock, in case
+    // this was its last reference.
+    {
+        std::scoped_lock lock (m_lock);
+        std::swap(m_ring[m_end & (Capacity - 1)], chunk);
+        ++m_end;
+    }
+
+    m_published.notify_all();
+}
+
+uint64_t ChunkStream::end() const
+{
+    std::scoped_lock lock (m_lock);
+    return m_end;
+}
+
+std::size_t ChunkStream::read(Cursor& cursor, std::vector<ChunkRef>& out)
+{
+    std::scoped_lock lock (m_lock);
+
+    const auto oldest = m_end > Capacity ? m_end - Capacity : 0;
+    if (cursor.position < oldest) {
+        cursor.dropped += oldest - cursor.position;
+        cursor.position = oldest;
+    } else if (cursor.position > m_end) {
+        cursor.position = m_end;
+    }
+
+    const auto count = m_end - cursor.position;
+    for (; cursor.position < m_end; ++cursor.position)
+        out.push_back(m_ring[cursor.position & (Capacity - 1)]);
+    return count;
+}
+
+bool ChunkStream::wait(const Cursor& cursor, std::stop_token stop)
+{
+    std::unique_lock lock (m_lock);
+    return m_published.wait(lock, stop, [&] { return m_end > cursor.position; });
+}
+
+void ChunkStream::attach(Cursor& cursor)
+{
+    std::scoped_lock lock (m_lock);
+    cursor.position = m_end;
+    if (std::find(m_attached.cbegin(), m_attached.cend(), &cursor) == m_attached.cend())
+        m_attached.push_back(&cursor);
+}
+
+void ChunkStream::detach(Cursor& cursor)
+{
+    std::scoped_lock lock (m_lock);
+    std::erase(m_attached, &cursor);
+}
+
+uint64_t ChunkStream::backlog() const
+{
+    std::scoped_lock lock (m_lock);
+
+    uint64_t backlog = 0;
+    for (const auto c : m_attached)
+        backlog = std::max(backlog, m_end - std::min(c->position, m_end));
+    return backlog;
+}
+
@@ -0,0 +1,198 @@
+/**
+ * @file chunk.hpp
+ * @brief Shared, pooled chunks of streamed samples and their fan-out.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_CHUNK_HPP
+#define STMDSPGUI_CHUNK_HPP
+
+#include "stmdsp.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+class ChunkPool;
+
+/**
+ * One buffer period of a stream: the output samples, and the input samples
+ * of the same period if they were read. Chunks are filled once by the
+ * producer and never change after they are published.
+ */
+struct SampleChunk
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<stmdsp::adcsample_t> output;
+    std::vector<stmdsp::adcsample_t> input; // Empty unless the input was read.
+
+    double rate = 0;            // Samples per second as delivered; zero if unpaced.
+    clock::time_point arrival;
+    unsigned int stream = 0;    // Changes each time a new stream starts.
+    bool display = true;        // Whether the draw window shows it.
+    bool log = false;           // Whether it goes to the open log file.
+
+private:
+    friend class ChunkPool;
+    friend class ChunkRef;
+
+    std::atomic_uint m_refs = 0;
+    ChunkPool *m_pool = nullptr;
+};
+
+/**
+ * A counted reference to a chunk. Copies share the chunk; it returns to its
+ * pool when the last reference goes.
+ */
+class ChunkRef
+{
+public:
+    ChunkRef() = default;
+    ChunkRef(const ChunkRef& other) noexcept : m_chunk(other.m_chunk) {
+        if (m_chunk)
+            m_chunk->m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    ChunkRef(ChunkRef&& other) noexcept : m_chunk(std::exchange(other.m_chunk, nullptr)) {}
+    ~ChunkRef() {
+        release();
+    }
+
+    ChunkRef& operator=(ChunkRef other) noexcept {
+        std::swap(m_chunk, other.m_chunk);
+        return *this;
+    }
+
+    const SampleChunk& operator*() const noexcept {
+        return *m_chunk;
+    }
+    const SampleChunk *operator->() const noexcept {
+        return m_chunk;
+    }
+    explicit operator bool() const noexcept {
+        return m_chunk != nullptr;
+    }
+
+    /**
+     * Write access, for the producer to fill a chunk fresh from the pool.
+     * Only valid before the chunk is shared.
+     */
+    SampleChunk& edit() noexcept {
+        return *m_chunk;
+    }
+
+private:
+    friend class ChunkPool;
+
+    SampleChunk *m_chunk = nullptr;
+
+    explicit ChunkRef(SampleChunk *chunk) noexcept : m_chunk(chunk) {
+        m_chunk->m_refs.store(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept;
+};
+
+/**
+ * Recycles chunks, along with the capacity of their sample vectors, so that
+ * a steady stream allocates nothing. The pool grows if every chunk is in use
+ * and never shrinks; it must outlive every reference to its chunks.
+ */
+class ChunkPool
+{
+public:
+    explicit ChunkPool(std::size_t count);
+
+    // A chunk no one else holds, for the producer to fill.
+    ChunkRef acquire();
+
+    // Chunks created so far.
+    std::size_t size() const;
+
+private:
+    friend class ChunkRef;
+
+    mutable std::mutex m_lock;
+    std::vector<std::unique_ptr<SampleChunk>> m_chunks;
+    std::vector<SampleChunk *> m_free;
+
+    void recycle(SampleChunk *chunk);
+};
+
+inline void ChunkRef::release() noexcept
+{
+    if (m_chunk && m_chunk->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        m_chunk->m_pool->recycle(m_chunk);
+    m_chunk = nullptr;
+}
+
+/**
+ * Fans a stream of chunks out to any number of consumers. The producer
+ * publishes each chunk once; every consumer keeps its own cursor and takes
+ * references to the chunks it has not seen yet, so no samples are copied
+ * and publishing costs the same however many consumers there are.
+ *
+ * The most recent Capacity chunks are held. A consumer that falls further
+ * behind than that skips ahead, and its cursor counts what it missed.
+ * Producers that can wait, like an unpaced replay, can instead hold back
+ * for the slowest attached cursor.
+ */
+class ChunkStream
+{
+public:
+    static constexpr std::size_t Capacity = 256; // Must be a power of two.
+
+    struct Cursor {
+        uint64_t position = 0; // Sequence number of the next chunk to read.
+        uint64_t dropped = 0;  // Chunks skipped for falling behind.
+    };
+
+    void publish(ChunkRef chunk);
+
+    // Sequence number of the next chunk to be published.
+    uint64_t end() const;
+
+    /**
+     * Appends the chunks after the cursor to out and advances the cursor.
+     * @return The number of chunks appended.
+     */
+    std::size_t read(Cursor& cursor, std::vector<ChunkRef>& out);
+
+    /**
+     * Blocks until there is a chunk after the cursor to read.
+     * @return False if woken by the stop request instead.
+     */
+    bool wait(const Cursor& cursor, std::stop_token stop);
+
+    /**
+     * Includes the given cursor in backlog(). Attaching moves it to end().
+     */
+    void attach(Cursor& cursor);
+    void detach(Cursor& cursor);
+
+    // Chunks published that the slowest attached cursor has not read.
+    uint64_t backlog() const;
+
+private:
+    mutable std::mutex m_lock;
+    std::condition_variable_any m_published;
+    std::array<ChunkRef, Capacity> m_ring;
+    uint64_t m_end = 0;
+    std::vector<Cursor *> m_attached;
+};
+
+#endif // STMDSPGUI_CHUNK_HPP
+
@@ -1,6 +1,6 @@
 /**
  * @file circular.hpp
- * @brief Small utility for filling a buffer in a circular manner.
+ * @brief A circular buffer that is written and read in bulk.
  *
  * Copyright (C) 2021 Clyne Sullivan
  *
@@ -12,36 +12,84 @@
 #ifndef CIRCULAR_HPP
 #define CIRCULAR_HPP
 
-#include <iterator>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <vector>
 
-template<template<typename> class Container, typename T>
-class CircularBuffer
+/**
+ * A circular buffer of a power-of-two number of elements, written and read
+ * in bulk. Positions are absolute, counted from the first element written
+ * since the last reset, so readers can tell what is still held.
+ */
+template<typename T>
+class RingBuffer
 {
 public:
-    CircularBuffer(Container<T>& container) :
-        m_begin(std::begin(container)),
-        m_end(std::end(container)),
-        m_current(m_begin) {}
-
-    void put(const T& value) noexcept {
-        *m_current = value;
-        if (++m_current == m_end)
-            m_current = m_begin;
+    // The capacity is rounded up to a power of two.
+    explicit RingBuffer(std::size_t capacity) :
+        m_data(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+        m_mask(m_data.size() - 1) {}
+
+    std::size_t capacity() const noexcept {
+        return m_data.size();
+    }
+
+    // Position of the oldest element held.
+    std::size_t begin() const noexcept {
+        return m_end > capacity() ? m_end - capacity() : 0;
+    }
+
+    // Position one past the newest element; the total written since reset.
+    std::size_t end() const noexcept {
+        return m_end;
+    }
+
+    void reset() noexcept {
+        m_end = 0;
+    }
+
+    /**
+     * Appends the given elements with at most two block copies. If there
+     * are more than capacity(), only the newest are kept.
+     */
+    void write(std::span<const T> values) noexcept {
+        const auto total = values.size();
+        if (values.size() > capacity())
+            values = values.last(capacity());
+
+        const auto start = (m_end + total - values.size()) & m_mask;
+        const auto n = std::min(values.size(), capacity() - start);
+        std::copy_n(values.begin(), n, m_data.begin() + start);
+        std::copy(values.begin() + n, values.end(), m_data.begin());
+        m_end += total;
     }
 
-    std::size_t size() const noexcept {
-        return std::distance(m_begin, m_end);
+    // Whether positions [first, first + count) are all held.
+    bool holds(std::size_t first, std::size_t count) const noexcept {
+        return first >= begin() && first + count <= m_end;
     }
 
-    void reset(const T& fill) noexcept {
-        std::fill(m_begin, m_end, fill);
-        m_current = m_begin;
+    /**
+     * Returns positions [first, first + count) as up to two contiguous
+     * regions, oldest first, for reading in place. The positions must be
+     * held; the regions are only valid until the next write.
+     */
+    std::array<std::span<const T>, 2> read_spans(std::size_t first,
+        std::size_t count) const noexcept
+    {
+        const std::span<const T> data (m_data);
+        const auto start = first & m_mask;
+        const auto n = std::min(count, capacity() - start);
+        return {data.subspan(start, n), data.first(count - n)};
     }
 
 private:
-    Container<T>::iterator m_begin;
-    Container<T>::iterator m_end;
-    Container<T>::iterator m_current;
+    std::vector<T> m_data;
+    std::size_t m_mask;
+    std::size_t m_end = 0;
 };
 
 #endif // CIRCULAR_HPP
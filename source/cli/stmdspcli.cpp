@@ -0,0 +1,465 @@
+/**
+ * @file stmdspcli.cpp
+ * @brief Headless front end: streams captures from the device to disk.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "code.hpp"
+#include "device.hpp"
+#include "runtime.hpp"
+#include "sequencer.hpp"
+#include "stmdsp.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+extern std::shared_ptr<stmdsp::device> m_device;
+extern std::array<unsigned int, 6> sampleRateInts;
+
+// Exit codes; also reported in the final status line.
+enum ExitCode : int {
+    Success = 0,
+    Usage,
+    Connect,
+    Setup,
+    Compile,
+    Upload,
+    Generator,
+    Output,
+    Disconnected,
+    Sequence
+};
+
+static const char *exitCodeNames[] = {
+    "ok", "usage", "connect", "setup", "compile", "upload", "generator",
+    "output", "disconnected", "sequence"
+};
+
+struct Options {
+    std::string port;
+    std::optional<unsigned int> rate;
+    std::optional<unsigned int> buffer;
+    std::string algorithm;
+    std::string generator;
+    std::string output;
+    std::string process;
+    std::string shm;
+    std::string listen;
+    std::string sequence;
+    bool input = false;
+    double time = 0;  // Seconds; zero runs until interrupted.
+    double stats = 0; // Seconds between stats lines; zero for only the last.
+    bool quiet = false;
+    bool help = false;
+};
+
+static std::mutex logLock;
+static bool logQuiet = false;
+static std::atomic_bool deviceLost = false;
+static volatile std::sig_atomic_t stopRequested = 0;
+
+// Log messages go to stderr, keeping stdout for the stats.
+void log(const std::string& str)
+{
+    if (!logQuiet) {
+        std::scoped_lock lock (logLock);
+        std::cerr << str << std::endl;
+    }
+}
+
+// There is no frame loop to wake.
+void guiWake() {}
+
+// Called from the device's status thread when the connection is lost.
+void deviceRenderDisconnect()
+{
+    deviceLost = true;
+}
+
+static void printUsage()
+{
+    std::cerr <<
+        "Usage: stmdspcli [options]\n"
+        "  -p, --port PORT       device port (default: first device found)\n"
+        "  -r, --rate HZ         sample rate\n"
+        "  -b, --buffer N        samples per buffer (100-4096)\n"
+        "  -a, --algorithm FILE  compile and upload the algorithm in FILE\n"
+        "  -g, --generator SPEC  signal generator: a .wav file, a list of\n"
+        "                        samples, or a formula of x\n"
+        "  -o, --output FILE     capture to FILE (binary if it ends in .stmcap)\n"
+        "  -i, --input           capture and export the input stream as well\n"
+        "  -P, --process STAGES  process the stream on the host before it is\n"
+        "                        captured; stages are separated by ';', e.g.\n"
+        "                        \"lowpass 2000; decimate 8\"\n"
+        "  -m, --shm NAME        export the stream to the POSIX shared-memory\n"
+        "                        segment NAME, e.g. /stmdsp (see stmdsp_shm.h)\n"
+        "  -l, --listen ADDRESS  serve the stream to local subscribers at a Unix\n"
+        "                        socket path, or a TCP PORT or HOST:PORT on a\n"
+        "                        loopback address (see stmdsp_stream.h)\n"
+        "  -t, --time SECONDS    stop after SECONDS (default: when interrupted)\n"
+        "  -s, --stats SECONDS   also print stats every SECONDS\n"
+        "  -S, --sequence FILE   run the sequence script in FILE instead; its\n"
+        "                        runs are printed as they finish, and the\n"
+        "                        summary table goes to stderr\n"
+        "  -q, --quiet           do not log to stderr\n"
+        "Algorithms are compiled as in the GUI, so run from its directory.\n"
+        "Stats and the final status are printed to stdout as JSON lines.\n";
+}
+
+template<typename T>
+static bool parseNumber(std::string_view str, T& value)
+{
+    const auto end = str.data() + str.size();
+    const auto [ptr, ec] = std::from_chars(str.data(), end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+static bool parseOptions(int argc, char **argv, Options& opts)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg (argv[i]);
+        const auto is = [&arg](const char *s, const char *l) {
+            return arg == s || arg == l;
+        };
+
+        if (is("-i", "--input")) {
+            opts.input = true;
+            continue;
+        } else if (is("-q", "--quiet")) {
+            opts.quiet = true;
+            continue;
+        } else if (is("-h", "--help")) {
+            opts.help = true;
+            return true;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << ".\n";
+            return false;
+        }
+
+        const std::string_view value (argv[++i]);
+        bool ok = true;
+        if (is("-p", "--port")) {
+            opts.port = value;
+        } else if (is("-r", "--rate")) {
+            ok = parseNumber(value, opts.rate.emplace());
+        } else if (is("-b", "--buffer")) {
+            ok = parseNumber(value, opts.buffer.emplace()) &&
+                *opts.buffer >= 100 && *opts.buffer <= stmdsp::SAMPLES_MAX;
+        } else if (is("-a", "--algorithm")) {
+            opts.algorithm = value;
+        } else if (is("-g", "--generator")) {
+            opts.generator = value;
+        } else if (is("-o", "--output")) {
+            opts.output = value;
+        } else if (is("-P", "--process")) {
+            opts.process = value;
+            std::string error;
+            ok = ProcessingChain().configure(opts.process, error);
+            if (!ok)
+                std::cerr << error << '\n';
+        } else if (is("-m", "--shm")) {
+            opts.shm = value;
+            ok = !opts.shm.empty();
+        } else if (is("-l", "--listen")) {
+            opts.listen = value;
+            ok = !opts.listen.empty();
+        } else if (is("-S", "--sequence")) {
+            opts.sequence = value;
+        } else if (is("-t", "--time")) {
+            ok = parseNumber(value, opts.time) && opts.time >= 0;
+        } else if (is("-s", "--stats")) {
+            ok = parseNumber(value, opts.stats) && opts.stats >= 0;
+        } else {
+            std::cerr << "Unknown option " << arg << ".\n";
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Bad value for " << arg << ": " << value << '\n';
+            return false;
+        }
+    }
+
+    if (!opts.sequence.empty() && (!opts.algorithm.empty() ||
+        !opts.generator.empty() || !opts.output.empty() || opts.input ||
+        !opts.process.empty() || opts.time > 0))
+    {
+        std::cerr << "A sequence sets up its own runs; only -p, -r, -b, -m, -l "
+                     "and -q go with it.\n";
+        return false;
+    }
+
+    if (opts.rate && std::find(sampleRateInts.cbegin(), sampleRateInts.cend(),
+        *opts.rate) == sampleRateInts.cend())
+    {
+        std::cerr << "Unsupported sample rate; choose from:";
+        for (auto r : sampleRateInts)
+            std::cerr << ' ' << r;
+        std::cerr << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+// Prints one JSON line of the stream's counters.
+static void printStats(const char *event, unsigned int rate, const char *status = nullptr)
+{
+    const auto stats = deviceStreamStats();
+    const double expected = rate * stats.seconds;
+
+    std::ostringstream line;
+    line << "{\"event\":\"" << event << '"';
+    if (status != nullptr)
+        line << ",\"status\":\"" << status << '"';
+    line << ",\"rate\":" << rate
+         << ",\"seconds\":" << stats.seconds
+         << ",\"periods\":" << stats.periods
+         << ",\"missed\":" << stats.missed
+         << ",\"late\":" << stats.late
+         << ",\"samples\":" << stats.samples
+         << ",\"input_samples\":" << stats.inputSamples
+         << ",\"samples_per_second\":" << (stats.seconds > 0 ? stats.samples / stats.seconds : 0)
+         << ",\"efficiency\":" << (expected > 0 ? stats.samples / expected : 0)
+         << '}';
+    std::cout << line.str() << std::endl;
+}
+
+static int finish(ExitCode code, unsigned int rate = 0)
+{
+    // Taken while the server still runs; it stops with the other tasks.
+    const auto server = deviceServerStats();
+
+    // Background tasks stop before anything they use goes away.
+    runtime().shutdown();
+    for (const auto& s : runtime().stats()) {
+        std::ostringstream line;
+        line << "Task " << s.name << ": " << s.runs << " runs, "
+             << s.total << " s total, " << s.longest << " s longest.";
+        log(line.str());
+    }
+    for (const bool input : {false, true}) {
+        for (const auto& s : deviceProcessingStats(input)) {
+            std::ostringstream line;
+            line << (input ? "Input" : "Output") << " stage " << s.name << ": "
+                 << (s.seconds > 0 ? s.samples / s.seconds / 1e6 : 0)
+                 << " Msamples/s, "
+                 << (s.blocks > 0 ? s.seconds / s.blocks * 1e6 : 0)
+                 << " us per block.";
+            for (const auto& m : s.metrics)
+                line << ' ' << m.name << '=' << m.value;
+            log(line.str());
+        }
+    }
+
+    if (server.frames > 0 || server.dropped > 0) {
+        std::ostringstream line;
+        line << "Stream server: " << server.frames << " frames, " << server.bytes
+             << " bytes sent; " << server.dropped << " frames dropped.";
+        log(line.str());
+    }
+
+    printStats("done", rate, exitCodeNames[code]);
+    return code;
+}
+
+static ExitCode setUp(const Options& opts)
+{
+    if (!deviceConnect(opts.port))
+        return Connect;
+
+    if (m_device->is_running())
+        deviceStart(false, false);
+    if (opts.rate && !deviceSetSampleRate(*opts.rate)) {
+        log("Error: Device did not accept the sample rate.");
+        return Setup;
+    }
+    if (opts.buffer) {
+        deviceSetBufferSize(*opts.buffer);
+        if (m_device->get_buffer_size() != *opts.buffer) {
+            log("Error: Device did not accept the buffer size.");
+            return Setup;
+        }
+    }
+
+    // Compiled after the buffer size is set, since the algorithm is built
+    // around it.
+    if (!opts.algorithm.empty()) {
+        std::ifstream file (opts.algorithm);
+        if (!file.good()) {
+            log("Error: Could not read " + opts.algorithm + '.');
+            return Compile;
+        }
+
+        std::ostringstream code;
+        code << file.rdbuf();
+        if (!compileEditorCode(code.str()))
+            return Compile;
+        if (!deviceAlgorithmUpload())
+            return Upload;
+    }
+
+    if (!opts.generator.empty() && !deviceGenLoad(opts.generator))
+        return Generator;
+
+    // Before the log file, which records the processed rate.
+    if (!opts.process.empty() && !deviceSetProcessing(opts.process))
+        return Setup;
+
+    if (!opts.shm.empty() && !deviceSetExport(opts.shm, opts.input))
+        return Setup;
+    if (!opts.listen.empty() && !deviceSetServer(opts.listen))
+        return Setup;
+
+    if (!opts.output.empty()) {
+        deviceSetInputLogging(opts.input);
+        if (!deviceLoadLogFile(opts.output))
+            return Output;
+    }
+
+    return Success;
+}
+
+// Prints a finished run of a sequence as one JSON line, with the columns of
+// the summary table.
+static void printRun(const SequenceResult& result)
+{
+    const auto header = Sequencer::tableHeader();
+    const auto row = Sequencer::tableRow(result);
+
+    std::ostringstream line;
+    line << "{\"event\":\"run\"";
+    for (std::size_t i = 0; i < header.size(); ++i) {
+        line << ",\"" << header[i] << "\":";
+
+        double number;
+        if (row[i].empty()) {
+            line << "null";
+        } else if (parseNumber(row[i], number) && std::isfinite(number)) {
+            line << row[i];
+        } else {
+            line << '"';
+            for (char c : row[i]) {
+                if (c == '"' || c == '\\')
+                    line << '\\';
+                line << (static_cast<unsigned char>(c) < ' ' ? ' ' : c);
+            }
+            line << '"';
+        }
+    }
+    line << '}';
+    std::cout << line.str() << std::endl;
+}
+
+static int runSequence(const Options& opts)
+{
+    Sequencer sequencer;
+    if (!sequencer.load(opts.sequence))
+        return finish(Sequence);
+
+    sequencer.onResult = printRun;
+    if (!sequencer.start())
+        return finish(Sequence);
+
+    while (sequencer.running()) {
+        if (stopRequested)
+            sequencer.stop();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    sequencer.wait();
+
+    const auto results = sequencer.results();
+    if (!logQuiet)
+        Sequencer::writeTable(std::cerr, results);
+
+    const auto rate = m_device ? m_device->get_sample_rate() : 0;
+    if (deviceLost)
+        return finish(Disconnected, rate);
+
+    const bool passed = results.size() == sequencer.runCount() &&
+        std::all_of(results.cbegin(), results.cend(), [](const auto& r) { return r.ok; });
+    return finish(passed ? Success : Sequence, rate);
+}
+
+int main(int argc, char **argv)
+{
+    using clock = std::chrono::steady_clock;
+
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        printUsage();
+        return finish(Usage);
+    } else if (opts.help) {
+        printUsage();
+        return Success;
+    }
+
+    logQuiet = opts.quiet;
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+    std::signal(SIGTERM, [](int) { stopRequested = 1; });
+
+    if (const auto code = setUp(opts); code != Success)
+        return finish(code);
+    if (!opts.sequence.empty())
+        return runSequence(opts);
+
+    const auto rate = m_device->get_sample_rate();
+
+    // Samples are only read for the capture; nothing is queued for drawing.
+    deviceStart(true, false);
+    if (!opts.generator.empty())
+        deviceGenStartToggle();
+
+    const auto seconds = [](double s) {
+        return std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(s));
+    };
+    const auto start = clock::now();
+    const auto stopAt = start + seconds(opts.time);
+    auto nextStats = start + seconds(opts.stats);
+
+    // The stream is read and written by the device module's own thread;
+    // this one only watches the clock.
+    while (!stopRequested && !deviceLost) {
+        const auto now = clock::now();
+        if (opts.time > 0 && now >= stopAt)
+            break;
+
+        if (opts.stats > 0 && now >= nextStats) {
+            printStats("stats", rate);
+            nextStats += seconds(opts.stats);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (deviceLost)
+        return finish(Disconnected, rate);
+
+    deviceStart(false, false);
+    if (m_device->is_siggening())
+        deviceGenStartToggle();
+
+    return finish(Success, rate);
+}
+
@@ -57,7 +57,7 @@ std::ifstream compileOpenBinaryFile()
         return std::ifstream();
 }
 
-void compileEditorCode(const std::string& code)
+bool compileEditorCode(const std::string& code, unsigned int bufferSize)
 {
     log("Compiling...");
 
@@ -77,7 +77,8 @@ void compileEditorCode(const std::string& code)
         auto file_text =
             platform == stmdsp::platform::L4 ? stmdsp::file_header_l4
                                              : stmdsp::file_header_h7;
-        const auto buffer_size = m_device ? m_device->get_buffer_size()
+        const auto buffer_size = bufferSize != 0 ? bufferSize :
+                                 m_device ? m_device->get_buffer_size()
                                           : stmdsp::SAMPLES_MAX;
 
         stringReplaceAll(file_text, "$0", std::to_string(buffer_size));
@@ -111,13 +112,15 @@ void compileEditorCode(const std::string& code)
 
     const auto makeOutput = scriptFile + ".log";
     const auto makeCommand = scriptFile + " > " + makeOutput + " 2>&1";
-    if (codeExecuteCommand(makeCommand, makeOutput))
+    const bool success = codeExecuteCommand(makeCommand, makeOutput);
+    if (success)
         log("Compilation succeeded.");
     else
         log("Compilation failed.");
 
     std::filesystem::remove(tempFileName);
     std::filesystem::remove(scriptFile);
+    return success;
 }
 
 void disassembleCode()
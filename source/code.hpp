@@ -26,8 +26,10 @@ std::ifstream compileOpenBinaryFile();
  * Attempts to compile the given C++ algorithm code into a binary.
  * Errors are reported to the log view.
  * @param code The C++ code for the algorithm (usually from the text editor).
+ * @param bufferSize The buffer size to build for; zero uses the device's.
+ * @return True if compilation succeeded.
  */
-void compileEditorCode(const std::string& code);
+bool compileEditorCode(const std::string& code, unsigned int bufferSize = 0);
 
 /**
  * Disassembles the most recently compiled binary, outputting the results to
@@ -11,17 +11,24 @@
 
 #include "stmdsp.hpp"
 
-#include "circular.hpp"
-#include "imgui.h"
+#include "capture.hpp"
+#include "chunk.hpp"
+#include "device.hpp"
+#include "kernels.hpp"
+#include "processing.hpp"
+#include "runtime.hpp"
+#include "shm_ring.hpp"
+#include "stream_server.hpp"
 #include "wav.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
 #include <charconv>
+#include <chrono>
 #include <cmath>
-#include <deque>
 #include <fstream>
-#include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -34,32 +41,416 @@ extern void log(const std::string& str);
 extern std::vector<stmdsp::dacsample_t> deviceGenLoadFormulaEval(const std::string&);
 extern std::ifstream compileOpenBinaryFile();
 extern void deviceRenderDisconnect();
+extern void guiWake();
 
 std::shared_ptr<stmdsp::device> m_device;
 
-static std::timed_mutex mutexDrawSamples;
 static std::timed_mutex mutexDeviceLoad;
+static std::mutex logSamplesLock; // Held while opening, writing or closing the log files.
 static std::ofstream logSamplesFile;
+static capture::writer logSamplesCapture;
 static wav::clip wavOutput;
-static std::deque<stmdsp::dacsample_t> drawSamplesQueue;
-static std::deque<stmdsp::dacsample_t> drawSamplesInputQueue;
-static bool drawSamplesInput = false;
-static unsigned int drawSamplesBufferSize = 1;
+static std::atomic_bool analysisInput = false;
+static std::atomic_bool drawSamplesEnabled = false;
+static std::atomic_bool drawSamplesInput = false;
+static std::atomic_bool logSamplesEnabled = false;
+static std::atomic_bool logSamplesInput = false;
+// Whether either log file is open; changed under logSamplesLock, so the
+// stream can check it without taking the lock.
+static std::atomic_bool logSamplesOpen = false;
+static unsigned int replaySampleRate = 0;
+static double replaySpeed = 1; // Zero replays as fast as possible.
+
+// Counts streams started, to tell their chunks apart.
+static std::atomic_uint streamGeneration = 0;
+// Stream statistics, written by drawSamplesTask.
+static std::atomic<std::chrono::steady_clock::rep> streamStart = 0;
+static std::atomic<std::chrono::steady_clock::rep> streamStop = 0;
+static std::atomic_size_t streamPeriods = 0;
+static std::atomic_size_t streamMissed = 0;
+static std::atomic_size_t streamLate = 0;
+static std::atomic_size_t streamSamples = 0;
+static std::atomic_size_t streamInputSamples = 0;
+
+// Host processing, set by deviceSetProcessing(). The chains are configured
+// alike, one for each direction, and are swapped out whole.
+static std::mutex processingLock;
+static std::shared_ptr<ProcessingChain> processingOutput;
+static std::shared_ptr<ProcessingChain> processingInput;
+static std::atomic_bool processingEnabled = false;
+static std::atomic_uint processingDecimation = 1;
+
+// Whether the shared-memory export, set by deviceSetExport(), takes the input.
+static std::atomic_bool exportInput = false;
+
+// The stream server, set by deviceSetServer(), which is told of device events.
+static std::mutex serverLock;
+static std::shared_ptr<StreamServer> streamServer;
 
-bool deviceConnect();
+/**
+ * Returns the stream that every chunk read from the device or replayed from
+ * a capture is published to.
+ */
+ChunkStream& deviceStream()
+{
+    static ChunkStream stream;
+    return stream;
+}
+
+/**
+ * Returns the stream that chunks are published to as read, while host
+ * processing is on; the processing task feeds deviceStream() from it.
+ */
+static ChunkStream& rawStream()
+{
+    static ChunkStream stream;
+    return stream;
+}
+
+/**
+ * Returns the pool that chunks are filled from. The stream holds on to its
+ * last Capacity chunks, so that many are in use once it has filled. The pool
+ * is never freed, since consumers may hold chunks right up until the program
+ * exits.
+ */
+static ChunkPool& chunkPool()
+{
+    static auto pool = new ChunkPool(ChunkStream::Capacity + 16);
+    return *pool;
+}
 
 void deviceSetInputDrawing(bool enabled)
 {
     drawSamplesInput = enabled;
-    if (enabled) {
-        drawSamplesQueue.clear();
-        drawSamplesInputQueue.clear();
+}
+
+void deviceSetInputLogging(bool enabled)
+{
+    logSamplesInput = enabled;
+}
+
+void deviceSetInputAnalysis(bool enabled)
+{
+    analysisInput = enabled;
+}
+
+// Passes a device event on to the stream server's subscribers, if it is on.
+static void notifyServer(uint32_t event, uint32_t value, const std::string& message)
+{
+    std::shared_ptr<StreamServer> server;
+    {
+        std::scoped_lock lock (serverLock);
+        server = streamServer;
+    }
+
+    if (server)
+        server->status(event, value, message);
+}
+
+// Logs a device error, and passes it on to the stream server.
+static void reportError(const std::string& message)
+{
+    log("Error: " + message);
+    notifyServer(STMDSP_EVENT_ERROR, 0, message);
+}
+
+// Returns the sample rate of whichever source is feeding the stream.
+static unsigned int sourceSampleRate()
+{
+    if (deviceIsReplaying())
+        return replaySampleRate;
+    else
+        return m_device ? m_device->get_sample_rate() : 0;
+}
+
+// The rate of deviceStream(), after any host processing.
+unsigned int deviceStreamSampleRate()
+{
+    return sourceSampleRate() / processingDecimation;
+}
+
+// Writes the chunk to whichever log file is open, if it is to be logged.
+static void logChunk(const ChunkRef& ref)
+{
+    if (!ref->log)
+        return;
+
+    std::scoped_lock lock (logSamplesLock);
+    const bool logInput = logSamplesInput;
+    const auto& chunk = ref->output;
+    const auto& chunk2 = ref->input;
+
+    if (logSamplesFile.is_open()) {
+        if (logInput) {
+            // One "output,input" row per sample; a missing chunk
+            // leaves its column empty.
+            const auto count = std::max(chunk.size(), chunk2.size());
+            for (std::size_t i = 0; i < count; ++i) {
+                if (i < chunk.size())
+                    logSamplesFile << chunk[i];
+                logSamplesFile << ',';
+                if (i < chunk2.size())
+                    logSamplesFile << chunk2[i];
+                logSamplesFile << '\n';
+            }
+        } else {
+            for (const auto& s : chunk)
+                logSamplesFile << s << '\n';
+        }
+    } else if (logSamplesCapture.is_open()) {
+        // The writer shares the chunk rather than copying it.
+        logSamplesCapture.write(ref, logInput);
+    }
+}
+
+// Timestamps and logs the given chunk, and hands it to the stream's
+// consumers.
+static void deliverChunk(ChunkRef chunk)
+{
+    chunk.edit().arrival = std::chrono::steady_clock::now();
+    logChunk(chunk);
+    deviceStream().publish(std::move(chunk));
+
+    // New samples to show.
+    guiWake();
+}
+
+// Passes a freshly read chunk on, through host processing if it is on.
+static void publishChunk(ChunkRef chunk)
+{
+    if (processingEnabled)
+        rawStream().publish(std::move(chunk));
+    else
+        deliverChunk(std::move(chunk));
+}
+
+/**
+ * Runs the chunks of rawStream() through the processing chains and delivers
+ * the results. The input is processed on the pool alongside the output.
+ */
+static void processingTask(std::stop_token stop)
+{
+    ChunkStream::Cursor cursor;
+    rawStream().attach(cursor);
+
+    std::vector<ChunkRef> chunks;
+    std::shared_ptr<ProcessingChain> output, input;
+    unsigned int stream = 0;
+
+    const auto processChunks = [&] {
+        rawStream().read(cursor, chunks);
+        for (auto& raw : chunks) {
+            {
+                std::scoped_lock lock (processingLock);
+                if (output != processingOutput) {
+                    output = processingOutput;
+                    input = processingInput;
+                    stream = 0;
+                }
+            }
+
+            // Chunks left over from when processing was on.
+            if (!output) {
+                deliverChunk(std::move(raw));
+                continue;
+            }
+
+            // Each stream starts afresh. The rate cannot change while a
+            // stream runs.
+            if (raw->stream != stream) {
+                stream = raw->stream;
+                output->reset(sourceSampleRate());
+                input->reset(sourceSampleRate());
+            }
+
+            auto ref = chunkPool().acquire();
+            auto& fill = ref.edit();
+
+            Job<void> inputJob;
+            if (!raw->input.empty()) {
+                inputJob = runtime().submit("process input",
+                    [&] { input->process(raw->input, fill.input); });
+            } else {
+                fill.input.clear();
+            }
+            output->process(raw->output, fill.output);
+            if (inputJob.valid())
+                inputJob.get();
+
+            fill.rate = raw->rate / output->decimation();
+            fill.stream = raw->stream;
+            fill.display = raw->display;
+            fill.log = raw->log;
+            deliverChunk(std::move(ref));
+        }
+        chunks.clear();
+    };
+
+    while (rawStream().wait(cursor, stop))
+        processChunks();
+
+    // Whatever was read before the stop is still delivered, and logged.
+    processChunks();
+    rawStream().detach(cursor);
+}
+
+bool deviceSetProcessing(const std::string& spec)
+{
+    auto output = std::make_shared<ProcessingChain>();
+    auto input = std::make_shared<ProcessingChain>();
+    std::string error;
+    if (!output->configure(spec, error) || !input->configure(spec, error)) {
+        log("Error: Host processing: " + error);
+        return false;
+    }
+
+    const bool enabled = !output->empty();
+    {
+        std::scoped_lock lock (processingLock);
+        processingOutput = enabled ? output : nullptr;
+        processingInput = enabled ? input : nullptr;
+    }
+    processingDecimation = output->decimation();
+    processingEnabled = enabled;
+
+    log(enabled ? "Host processing set." : "Host processing off.");
+    return true;
+}
+
+std::vector<ProcessingChain::StageStats> deviceProcessingStats(bool input)
+{
+    std::shared_ptr<ProcessingChain> chain;
+    {
+        std::scoped_lock lock (processingLock);
+        chain = input ? processingInput : processingOutput;
+    }
+
+    return chain ? chain->stats() : std::vector<ProcessingChain::StageStats>();
+}
+
+/**
+ * Writes each chunk of deviceStream() to the shared-memory rings. Readers
+ * never hold this up; only falling behind the stream loses chunks.
+ */
+static void exportTask(std::stop_token stop, std::shared_ptr<ShmRing> ring)
+{
+    ChunkStream::Cursor cursor;
+    cursor.position = deviceStream().end();
+
+    std::vector<ChunkRef> chunks;
+    unsigned int stream = 0;
+    uint64_t dropped = 0;
+
+    while (deviceStream().wait(cursor, stop)) {
+        deviceStream().read(cursor, chunks);
+        ring->addDropped(cursor.dropped - dropped);
+        dropped = cursor.dropped;
+
+        for (const auto& ref : chunks) {
+            if (ref->stream != stream) {
+                stream = ref->stream;
+                ring->beginStream(stream, deviceStreamSampleRate());
+            }
+            ring->write(STMDSP_SHM_OUTPUT, ref->output.data(), ref->output.size());
+            ring->write(STMDSP_SHM_INPUT, ref->input.data(), ref->input.size());
+        }
+        chunks.clear();
     }
 }
 
-static void measureCodeTask(std::shared_ptr<stmdsp::device> device)
+bool deviceSetExport(const std::string& name, bool input)
 {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // The old segment is closed, and unlinked, once its task has stopped.
+    runtime().stopIo("export");
+    exportInput = false;
+    if (name.empty()) {
+        log("Shared-memory export off.");
+        return true;
+    }
+
+    auto ring = std::make_shared<ShmRing>();
+    std::string error;
+    if (!ring->open(name, ShmRing::DefaultCapacity, error)) {
+        log("Error: Shared-memory export: " + error);
+        return false;
+    }
+
+    exportInput = input;
+    log("Exporting the stream to shared memory at " + ring->name() + '.');
+    runtime().startIo("export",
+        [ring = std::move(ring)](std::stop_token stop) { exportTask(stop, ring); });
+    return true;
+}
+
+/**
+ * Hands each chunk of deviceStream() to the stream server, announcing each
+ * new stream first.
+ */
+static void serverFeedTask(std::stop_token stop, std::shared_ptr<StreamServer> server)
+{
+    ChunkStream::Cursor cursor;
+    cursor.position = deviceStream().end();
+
+    std::vector<ChunkRef> chunks;
+    unsigned int stream = 0;
+
+    while (deviceStream().wait(cursor, stop)) {
+        const auto count = deviceStream().read(cursor, chunks);
+        const auto rate = deviceStreamSampleRate();
+
+        auto sequence = cursor.position - count;
+        for (const auto& ref : chunks) {
+            if (ref->stream != stream) {
+                stream = ref->stream;
+                server->status(STMDSP_EVENT_STREAM_START, rate, "Stream started.");
+            }
+            server->publish(ref, sequence++, rate);
+        }
+        chunks.clear();
+    }
+}
+
+bool deviceSetServer(const std::string& address)
+{
+    runtime().stopIo("server feed");
+    runtime().stopIo("server");
+    {
+        std::scoped_lock lock (serverLock);
+        streamServer.reset();
+    }
+    if (address.empty()) {
+        log("Stream server off.");
+        return true;
+    }
+
+    auto server = std::make_shared<StreamServer>();
+    std::string error;
+    if (!server->open(address, error)) {
+        log("Error: Stream server: " + error);
+        return false;
+    }
+
+    {
+        std::scoped_lock lock (serverLock);
+        streamServer = server;
+    }
+    runtime().startIo("server", [server](std::stop_token stop) { server->run(stop); });
+    runtime().startIo("server feed",
+        [server](std::stop_token stop) { serverFeedTask(stop, server); });
+    log("Serving the stream at " + server->address() + '.');
+    return true;
+}
+
+StreamServer::Stats deviceServerStats()
+{
+    std::scoped_lock lock (serverLock);
+    return streamServer ? streamServer->stats() : StreamServer::Stats();
+}
+
+static void measureCodeTask(std::stop_token stop, std::shared_ptr<stmdsp::device> device)
+{
+    if (!Runtime::sleepFor(stop, std::chrono::seconds(1)))
+        return;
 
     if (device) {
         const auto cycles = device->measurement_read();
@@ -67,22 +458,24 @@ static void measureCodeTask(std::shared_ptr<stmdsp::device> device)
     }
 }
 
-static std::vector<stmdsp::dacsample_t> tryReceiveChunk(
+// Reads into the given vector, retrying briefly while the device has nothing.
+static void tryReceiveChunk(
     std::shared_ptr<stmdsp::device> device,
-    auto readFunc)
+    auto readFunc,
+    std::vector<stmdsp::adcsample_t>& chunk)
 {
+    chunk.clear();
+
     for (int tries = 0; tries < 100; ++tries) {
         if (!device->is_running())
             break;
 
-        const auto chunk = readFunc(device.get());
+        readFunc(device.get(), chunk);
         if (!chunk.empty())
-            return chunk;
+            break;
         else
             std::this_thread::sleep_for(std::chrono::microseconds(20));
     }
-
-    return {};
 }
 
 static std::chrono::duration<double> getBufferPeriod(
@@ -98,55 +491,70 @@ static std::chrono::duration<double> getBufferPeriod(
     }
 }
 
-static void drawSamplesTask(std::shared_ptr<stmdsp::device> device)
+static void drawSamplesTask(std::stop_token stop, std::shared_ptr<stmdsp::device> device)
 {
     if (!device)
         return;
 
+    const auto generation = streamGeneration.load();
+
     // This is the amount of time to wait between device reads.
     const auto bufferTime = getBufferPeriod(device, 1);
 
-    // Adds the given chunk of samples to the given queue.
-    const auto addToQueue = [](auto& queue, const auto& chunk) {
-        std::scoped_lock lock (mutexDrawSamples);
-        std::copy(chunk.cbegin(), chunk.cend(), std::back_inserter(queue));
-    };
-
     std::unique_lock<std::timed_mutex> lockDevice (mutexDeviceLoad, std::defer_lock);
 
-    while (device && device->is_running()) {
+    while (!stop.stop_requested() && device->is_running()) {
         const auto next = std::chrono::high_resolution_clock::now() + bufferTime;
 
-        if (lockDevice.try_lock_until(next)) {
-            std::vector<stmdsp::dacsample_t> chunk, chunk2;
+        // The input is read once per period, into the same chunk as the
+        // output, and shared by everything that wants it.
+        const bool logInput = logSamplesEnabled && logSamplesInput && logSamplesOpen;
+        const bool readInput = drawSamplesInput || logInput || analysisInput ||
+            exportInput;
 
-            chunk = tryReceiveChunk(device,
-                std::mem_fn(&stmdsp::device::continuous_read));
-            if (drawSamplesInput) {
-                chunk2 = tryReceiveChunk(device,
-                    std::mem_fn(&stmdsp::device::continuous_read_input));
+        if (lockDevice.try_lock_until(next)) {
+            // Pooled chunks keep their vectors' storage, so reading into
+            // them allocates nothing once the stream is going.
+            auto ref = chunkPool().acquire();
+            auto& fill = ref.edit();
+
+            tryReceiveChunk(device,
+                [](auto dev, auto& v) { dev->continuous_read(v); }, fill.output);
+            if (readInput) {
+                tryReceiveChunk(device,
+                    [](auto dev, auto& v) { dev->continuous_read_input(v); }, fill.input);
+            } else {
+                fill.input.clear();
             }
 
             lockDevice.unlock();
+            if (stop.stop_requested())
+                break;
 
-            addToQueue(drawSamplesQueue, chunk);
-            if (drawSamplesInput)
-                addToQueue(drawSamplesInputQueue, chunk2);
+            ++streamPeriods;
+            if (fill.output.empty())
+                ++streamMissed;
+            streamSamples += fill.output.size();
+            streamInputSamples += fill.input.size();
 
-            if (logSamplesFile.is_open()) {
-                for (const auto& s : chunk)
-                    logSamplesFile << s << '\n';
-            }
+            fill.rate = device->get_sample_rate();
+            fill.stream = generation;
+            fill.display = drawSamplesEnabled;
+            fill.log = logSamplesEnabled;
+
+            publishChunk(std::move(ref));
         } else {
             // Device must be busy, back off for a bit.
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
 
-        std::this_thread::sleep_until(next);
+        if (std::chrono::high_resolution_clock::now() > next)
+            ++streamLate;
+        Runtime::sleepUntil(stop, next);
     }
 }
 
-static void feedSigGenTask(std::shared_ptr<stmdsp::device> device)
+static void feedSigGenTask(std::stop_token stop, std::shared_ptr<stmdsp::device> device)
 {
     if (!device)
         return;
@@ -166,30 +574,93 @@ static void feedSigGenTask(std::shared_ptr<stmdsp::device> device)
     wavBuf.resize(wavBuf.size() / 2);
     std::vector<int16_t> wavIntBuf (wavBuf.size());
 
-    while (device->is_siggening()) {
+    while (!stop.stop_requested() && device->is_siggening()) {
         const auto next = std::chrono::high_resolution_clock::now() + delay;
 
         wavOutput.next(wavIntBuf.data(), wavIntBuf.size());
-        std::transform(wavIntBuf.cbegin(), wavIntBuf.cend(),
-            wavBuf.begin(),
-            [](auto i) { return static_cast<stmdsp::dacsample_t>(i / 16 + 2048); });
+        kernels::pcmToDac(wavIntBuf.data(), wavBuf.data(), wavIntBuf.size());
 
         {
             std::scoped_lock lock (mutexDeviceLoad);
-            while (!device->siggen_upload(wavBuf.data(), wavBuf.size()))
-                std::this_thread::sleep_for(uploadDelay);
+            while (!device->siggen_upload(wavBuf.data(), wavBuf.size())) {
+                if (!Runtime::sleepFor(stop, uploadDelay))
+                    break;
+            }
+        }
+
+        Runtime::sleepUntil(stop, next);
+    }
+}
+
+static void replayTask(std::stop_token stop, std::shared_ptr<capture::reader> reader)
+{
+    using clock = std::chrono::steady_clock;
+
+    // When unpaced, only let the slowest consumer fall this many chunks
+    // behind, well short of what the stream holds.
+    const uint64_t backlogLimit = ChunkStream::Capacity / 4;
+
+    const auto generation = ++streamGeneration;
+    const auto start = clock::now();
+    auto next = start;
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; !stop.stop_requested() && i < reader->block_count(); ++i) {
+        // Input blocks follow the output block of the same period, and are
+        // read into its chunk below.
+        if (reader->block_channel(i) == capture::channel::Input)
+            continue;
+
+        auto ref = chunkPool().acquire();
+        auto& fill = ref.edit();
+        bool ok = reader->read_block(i, fill.output);
+        fill.input.clear();
+        if (ok && i + 1 < reader->block_count() &&
+            reader->block_channel(i + 1) == capture::channel::Input)
+        {
+            ok = reader->read_block(i + 1, fill.input);
         }
+        if (!ok) {
+            log("Error: Capture file is damaged, stopping replay.");
+            break;
+        }
+
+        fill.rate = replaySampleRate * replaySpeed;
+        fill.stream = generation;
+        fill.display = true;
+        fill.log = false;
 
-        std::this_thread::sleep_until(next);
+        if (replaySpeed > 0) {
+            next += std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(fill.output.size() / fill.rate));
+        } else {
+            while (std::max(rawStream().backlog(), deviceStream().backlog()) >= backlogLimit) {
+                if (!Runtime::sleepFor(stop, std::chrono::milliseconds(1)))
+                    break;
+            }
+        }
+
+        total += fill.output.size();
+        publishChunk(std::move(ref));
+
+        if (replaySpeed > 0)
+            Runtime::sleepUntil(stop, next);
     }
+
+    notifyServer(STMDSP_EVENT_STREAM_STOP, 0, "Replay finished.");
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+    log("Replay finished: " + std::to_string(total) + " samples in " +
+        std::to_string(elapsed.count()) + " s (" +
+        std::to_string(static_cast<std::size_t>(total / elapsed.count())) +
+        " samples/s).");
 }
 
-static void statusTask(std::shared_ptr<stmdsp::device> device)
+static void statusTask(std::stop_token stop, std::shared_ptr<stmdsp::device> device)
 {
     if (!device)
         return;
 
-    while (device->connected()) {
+    while (!stop.stop_requested() && device->connected()) {
         mutexDeviceLoad.lock();
         const auto [status, error] = device->get_status();
         mutexDeviceLoad.unlock();
@@ -197,10 +668,10 @@ static void statusTask(std::shared_ptr<stmdsp::device> device)
         if (error != stmdsp::Error::None) {
             switch (error) {
             case stmdsp::Error::NotIdle:
-                log("Error: Device already running...");
+                reportError("Device already running...");
                 break;
             case stmdsp::Error::ConversionAborted:
-                log("Error: Algorithm unloaded, a fault occurred!");
+                reportError("Algorithm unloaded, a fault occurred!");
                 break;
             case stmdsp::Error::GUIDisconnect:
                 // Do GUI events for disconnect if device was lost.
@@ -209,31 +680,61 @@ static void statusTask(std::shared_ptr<stmdsp::device> device)
                 return;
                 break;
             default:
-                log("Error: Device had an issue...");
+                reportError("Device had an issue...");
                 break;
             }
         }
 
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        Runtime::sleepFor(stop, std::chrono::seconds(1));
     }
 }
 
-void deviceLoadAudioFile(const std::string& file)
+static void closeLogFiles()
+{
+    std::scoped_lock lock (logSamplesLock);
+    logSamplesOpen = false;
+    if (logSamplesFile.is_open()) {
+        logSamplesFile.close();
+        log("Log file saved and closed.");
+    } else if (logSamplesCapture.is_open()) {
+        logSamplesCapture.close();
+        log("Capture file saved and closed.");
+    }
+}
+
+bool deviceLoadAudioFile(const std::string& file)
 {
     wavOutput = wav::clip(file);
     if (wavOutput.valid())
         log("Audio file loaded.");
     else
         log("Error: Bad WAV audio file.");
+
+    return wavOutput.valid();
 }
 
-void deviceLoadLogFile(const std::string& file)
+bool deviceLoadLogFile(const std::string& file)
 {
-    logSamplesFile = std::ofstream(file);
-    if (logSamplesFile.is_open())
+    // Binary captures are compressed; anything else gets the text format.
+    const auto rate = m_device ? m_device->get_sample_rate() : 0;
+    bool opened;
+    {
+        std::scoped_lock lock (logSamplesLock);
+        if (file.ends_with(".stmcap")) {
+            opened = logSamplesCapture.open(file, rate / processingDecimation);
+        } else {
+            logSamplesFile = std::ofstream(file);
+            opened = logSamplesFile.is_open();
+        }
+        logSamplesOpen = logSamplesFile.is_open() || logSamplesCapture.is_open();
+    }
+
+    if (opened)
         log("Log file ready.");
     else
         log("Error: Could not open log file.");
+
+    return opened;
 }
 
 bool deviceGenStartToggle()
@@ -243,7 +744,8 @@ bool deviceGenStartToggle()
 
         if (!running) {
             if (wavOutput.valid()) {
-                std::thread(feedSigGenTask, m_device).detach();
+                runtime().startIo("generator",
+                    [device = m_device](auto stop) { feedSigGenTask(stop, device); });
             } else {
                 std::scoped_lock dlock (mutexDeviceLoad);
                 m_device->siggen_start();
@@ -254,6 +756,7 @@ bool deviceGenStartToggle()
                 std::scoped_lock dlock (mutexDeviceLoad);
                 m_device->siggen_stop();
             }
+            runtime().stopIo("generator");
             log("Generator stopped.");
         }
 
@@ -263,29 +766,89 @@ bool deviceGenStartToggle()
     return false;
 }
 
-void deviceUpdateDrawBufferSize(double timeframe)
+bool deviceIsReplaying()
+{
+    return runtime().ioRunning("replay");
+}
+
+// True while samples are arriving, either from the device or a replay.
+bool deviceIsStreaming()
 {
-    drawSamplesBufferSize = std::round(
-        m_device->get_sample_rate() * timeframe);
+    return deviceIsReplaying() || (m_device && m_device->is_running());
 }
 
-void deviceSetSampleRate(unsigned int rate)
+/**
+ * Replays the given capture file into the draw queues.
+ * @param speed Playback speed relative to real-time, or zero to replay as fast
+ *              as the renderer can consume the samples.
+ */
+bool deviceReplayStart(const std::string& file, double speed)
 {
-    do {
+    if (deviceIsStreaming()) {
+        log("Cannot replay while the stream is busy.");
+        return false;
+    }
+
+    auto reader = std::make_shared<capture::reader>();
+    if (!reader->open(file) || reader->sample_rate() == 0) {
+        log("Error: Bad capture file.");
+        return false;
+    }
+
+    replaySampleRate = reader->sample_rate();
+    replaySpeed = speed;
+    runtime().startIo("processing", processingTask);
+    runtime().startIo("replay",
+        [reader](auto stop) { replayTask(stop, reader); });
+    log("Replaying capture.");
+    return true;
+}
+
+void deviceReplayStop()
+{
+    runtime().stopIo("replay");
+}
+
+bool deviceSetSampleRate(unsigned int rate)
+{
+    extern std::array<unsigned int, 6> sampleRateInts;
+
+    // The device ignores rates it does not support, so those would never
+    // take; a device that stops answering gives up after a while too.
+    if (!m_device || std::find(sampleRateInts.cbegin(), sampleRateInts.cend(),
+        rate) == sampleRateInts.cend())
+    {
+        return false;
+    }
+
+    for (int tries = 0; tries < 50; ++tries) {
         m_device->set_sample_rate(rate);
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    } while (m_device->get_sample_rate() != rate);
+        if (m_device->get_sample_rate() == rate)
+            return true;
+    }
+    return false;
+}
+
+void deviceSetBufferSize(unsigned int size)
+{
+    if (m_device)
+        m_device->continuous_set_buffer_size(size);
 }
 
 bool deviceConnect()
 {
-    static std::thread statusThread;
+    return deviceConnect({});
+}
 
+bool deviceConnect(const std::string& port)
+{
     if (!m_device) {
         stmdsp::scanner scanner;
         if (const auto devices = scanner.scan(); !devices.empty()) {
+            const auto& target = port.empty() ? devices.front() : port;
             try {
-                m_device.reset(new stmdsp::device(devices.front()));
+                m_device.reset(new stmdsp::device(target));
             } catch (...) {
                 log("Failed to connect (check permissions?).");
                 m_device.reset();
@@ -294,8 +857,9 @@ bool deviceConnect()
             if (m_device) {
                 if (m_device->connected()) {
                     log("Connected!");
-                    statusThread = std::thread(statusTask, m_device);
-                    statusThread.detach();
+                    notifyServer(STMDSP_EVENT_CONNECTED, 0, "Connected.");
+                    runtime().startIo("status",
+                        [device = m_device](auto stop) { statusTask(stop, device); });
                     return true;
                 } else {
                     m_device.reset();
@@ -307,10 +871,17 @@ bool deviceConnect()
         }
     } else {
         m_device->disconnect();
-        if (statusThread.joinable())
-            statusThread.join();
+        // The status task may be the one disconnecting, in which case it
+        // is only asked to stop.
+        runtime().stopIo("status");
+        runtime().stopIo("stream");
+        runtime().stopIo("processing");
+        runtime().stopIo("generator");
         m_device.reset();
+        // Keep what was captured before the device went away.
+        closeLogFiles();
         log("Disconnected.");
+        notifyServer(STMDSP_EVENT_DISCONNECTED, 0, "Disconnected.");
     }
 
     return false;
@@ -325,19 +896,36 @@ void deviceStart(bool logResults, bool drawSamples)
 
     if (m_device->is_running()) {
         {
-            std::scoped_lock lock (mutexDrawSamples, mutexDeviceLoad);
+            std::scoped_lock lock (mutexDeviceLoad);
             std::this_thread::sleep_for(std::chrono::microseconds(150));
             m_device->continuous_stop();
         }
-        if (logSamplesFile.is_open()) {
-            logSamplesFile.close();
-            log("Log file saved and closed.");
-        }
+        // The log is only closed once nothing else can write to it.
+        runtime().stopIo("stream");
+        runtime().stopIo("processing");
+        streamStop = std::chrono::steady_clock::now().time_since_epoch().count();
+        closeLogFiles();
+        notifyServer(STMDSP_EVENT_STREAM_STOP, 0, "Stream stopped.");
         log("Ready.");
     } else {
+        deviceReplayStop();
+        drawSamplesEnabled = drawSamples;
+        logSamplesEnabled = logResults;
+        ++streamGeneration;
+        streamPeriods = 0;
+        streamMissed = 0;
+        streamLate = 0;
+        streamSamples = 0;
+        streamInputSamples = 0;
+        streamStart = std::chrono::steady_clock::now().time_since_epoch().count();
+        streamStop = 0;
+
+        // Consumers can attach to the stream at any time, so it is always
+        // read.
         m_device->continuous_start();
-        if (drawSamples || logResults || wavOutput.valid())
-            std::thread(drawSamplesTask, m_device).detach();
+        runtime().startIo("processing", processingTask);
+        runtime().startIo("stream",
+            [device = m_device](auto stop) { drawSamplesTask(stop, device); });
 
         log("Running.");
     }
@@ -347,11 +935,12 @@ void deviceStartMeasurement()
 {
     if (m_device && m_device->is_running()) {
         m_device->measurement_start();
-        std::thread(measureCodeTask, m_device).detach();
+        runtime().startIo("code timing",
+            [device = m_device](auto stop) { measureCodeTask(stop, device); });
     }
 }
 
-void deviceAlgorithmUpload()
+bool deviceAlgorithmUpload()
 {
     if (!m_device) {
         log("No device connected.");
@@ -364,9 +953,12 @@ void deviceAlgorithmUpload()
 
         m_device->upload_filter(reinterpret_cast<unsigned char *>(&str[0]), str.size());
         log("Algorithm uploaded.");
+        return true;
     } else {
         log("Algorithm must be compiled first.");
     }
+
+    return false;
 }
 
 void deviceAlgorithmUnload()
@@ -381,7 +973,7 @@ void deviceAlgorithmUnload()
     }
 }
 
-void deviceGenLoadList(const std::string_view list)
+bool deviceGenLoadList(const std::string_view list)
 {
     std::vector<stmdsp::dacsample_t> samples;
 
@@ -416,66 +1008,55 @@ void deviceGenLoadList(const std::string_view list)
 
         m_device->siggen_upload(samples.data(), samples.size());
         log("Generator ready.");
+        return true;
     }
+
+    return false;
 }
 
-void deviceGenLoadFormula(const std::string& formula)
+bool deviceGenLoadFormula(const std::string& formula)
 {
     auto samples = deviceGenLoadFormulaEval(formula);
 
     if (!samples.empty()) {
         m_device->siggen_upload(samples.data(), samples.size());
         log("Generator ready.");
+        return true;
     } else {
         log("Error: Bad formula.");
+        return false;
     }
 }
 
-std::size_t pullFromQueue(
-    std::deque<stmdsp::dacsample_t>& queue,
-    CircularBuffer<std::vector, stmdsp::dacsample_t>& circ)
+bool deviceGenLoad(const std::string& spec)
 {
-    // We know how big the circular buffer should be to hold enough samples to
-    // fill the current draw samples view.
-    // If the given buffer does not match this size, notify the caller.
-    // TODO this could be done better... drawSamplesBufferSize should be a GUI-
-    // only thing.
-    if (circ.size() != drawSamplesBufferSize)
-        return drawSamplesBufferSize;
-
-    std::scoped_lock lock (mutexDrawSamples);
-
-    // The render code will draw all of the new samples we add to the buffer.
-    // So, we must provide a certain amount of samples at a time to make the
-    // render appear smooth.
-    // The 1.025 factor keeps us on top of the stream; don't want to fall
-    // behind.
-    const double FPS = ImGui::GetIO().Framerate;
-    const auto desiredCount = m_device->get_sample_rate() / FPS;
-
-    // Transfer from the queue to the render buffer.
-    auto count = std::min(queue.size(), static_cast<std::size_t>(desiredCount));
-    while (count--) {
-        circ.put(queue.front());
-        queue.pop_front();
-    }
+    if (spec.ends_with(".wav"))
+        return deviceLoadAudioFile(spec);
 
-    return 0;
-}
-
-/**
- * Pulls a render frame's worth of samples from the draw samples queue, adding
- * the samples to the given buffer.
- */
-std::size_t pullFromDrawQueue(
-    CircularBuffer<std::vector, stmdsp::dacsample_t>& circ)
-{
-    return pullFromQueue(drawSamplesQueue, circ);
+    // Otherwise the generator plays from its own buffer.
+    wavOutput = wav::clip();
+    if (spec.find_first_not_of("0123456789, \t") == std::string::npos)
+        return deviceGenLoadList(spec);
+    else
+        return deviceGenLoadFormula(spec);
 }
 
-std::size_t pullFromInputDrawQueue(
-    CircularBuffer<std::vector, stmdsp::dacsample_t>& circ)
+DeviceStreamStats deviceStreamStats()
 {
-    return pullFromQueue(drawSamplesInputQueue, circ);
+    using clock = std::chrono::steady_clock;
+
+    const auto start = streamStart.load();
+    const auto stop = streamStop.load();
+    const auto end = stop != 0 || start == 0 ? stop :
+        clock::now().time_since_epoch().count();
+
+    DeviceStreamStats stats;
+    stats.seconds = std::chrono::duration<double>(clock::duration(end - start)).count();
+    stats.periods = streamPeriods;
+    stats.missed = streamMissed;
+    stats.late = streamLate;
+    stats.samples = streamSamples;
+    stats.inputSamples = streamInputSamples;
+    return stats;
 }
 
@@ -0,0 +1,140 @@
+/**
+ * @file device.hpp
+ * @brief Device control and sample streaming, shared by the GUI and the CLI.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_DEVICE_HPP
+#define STMDSPGUI_DEVICE_HPP
+
+#include "chunk.hpp"
+#include "processing.hpp"
+#include "stmdsp.hpp"
+#include "stream_server.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Counters of the current (or last) stream, reset each time it starts.
+ */
+struct DeviceStreamStats
+{
+    double seconds = 0;           // Time since the stream started.
+    std::size_t periods = 0;      // Buffer periods the stream was read for.
+    std::size_t missed = 0;       // Periods whose output read came back empty.
+    std::size_t late = 0;         // Periods whose work ran past the next one.
+    std::size_t samples = 0;      // Output samples read.
+    std::size_t inputSamples = 0; // Input samples read.
+};
+
+/**
+ * Connects to the first device found, or disconnects if already connected.
+ * Both directions are reported to the log.
+ * @return True if a device is now connected.
+ */
+bool deviceConnect();
+
+/**
+ * As deviceConnect(), but connects to the device at the given port. An
+ * empty port picks the first device found.
+ */
+bool deviceConnect(const std::string& port);
+
+/**
+ * Sets the sample rate, waiting for the device to take it.
+ * @return False if the rate is not supported or the device did not take it.
+ */
+bool deviceSetSampleRate(unsigned int rate);
+void deviceSetBufferSize(unsigned int size);
+
+/**
+ * Starts the stream, or stops it if running. Samples are read each buffer
+ * period and published to deviceStream().
+ * @param logResults Whether a log file opened by deviceLoadLogFile() is fed.
+ * @param drawSamples Whether the draw window shows the stream's chunks.
+ */
+void deviceStart(bool logResults, bool drawSamples);
+void deviceStartMeasurement();
+bool deviceIsStreaming();
+unsigned int deviceStreamSampleRate();
+DeviceStreamStats deviceStreamStats();
+
+bool deviceAlgorithmUpload();
+void deviceAlgorithmUnload();
+
+bool deviceGenStartToggle();
+bool deviceGenLoadFormula(const std::string& formula);
+bool deviceGenLoadList(std::string_view list);
+bool deviceLoadAudioFile(const std::string& file);
+
+/**
+ * Loads the signal generator from a .wav file name, a list of samples, or a
+ * formula of x, as the text suggests.
+ */
+bool deviceGenLoad(const std::string& spec);
+
+/**
+ * Opens a file for logging the stream to: a binary capture if the name ends
+ * in ".stmcap", text otherwise. The file is closed when the stream stops.
+ */
+bool deviceLoadLogFile(const std::string& file);
+void deviceSetInputLogging(bool enabled);
+
+bool deviceReplayStart(const std::string& file, double speed);
+void deviceReplayStop();
+bool deviceIsReplaying();
+
+/**
+ * The chunks read from the device or replayed from a capture, for any
+ * number of consumers to read at their own pace.
+ */
+ChunkStream& deviceStream();
+
+/**
+ * Ask for the input stream to be read along with the output, for the draw
+ * window or analysis respectively.
+ */
+void deviceSetInputDrawing(bool enabled);
+void deviceSetInputAnalysis(bool enabled);
+
+/**
+ * Sets the host processing applied to both directions of the stream before
+ * it is shown, analyzed or logged; see ProcessingChain for the description.
+ * An empty description turns processing off. Takes effect immediately, and
+ * runs on its own task so that it never holds up reading the device.
+ * @return False, leaving processing as it was, if the description is bad.
+ */
+bool deviceSetProcessing(const std::string& spec);
+
+// Timing of each stage of the output's or the input's processing.
+std::vector<ProcessingChain::StageStats> deviceProcessingStats(bool input);
+
+/**
+ * Exports the stream to the named POSIX shared-memory segment, laid out as
+ * described in stmdsp_shm.h, for other local processes to read in place.
+ * The input is read every period and exported too if asked for. An empty
+ * name turns the export off.
+ * @return False if the segment could not be created.
+ */
+bool deviceSetExport(const std::string& name, bool input);
+
+/**
+ * Serves the stream and device events to any number of local subscribers,
+ * framed as described in stmdsp_stream.h, at a Unix domain socket path or a
+ * TCP PORT or HOST:PORT, where HOST is a loopback address. An empty address
+ * turns it off.
+ * @return False if the server could not listen there.
+ */
+bool deviceSetServer(const std::string& address);
+StreamServer::Stats deviceServerStats();
+
+#endif // STMDSPGUI_DEVICE_HPP
+
@@ -10,6 +10,7 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "kernels.hpp"
 #include "stmdsp.hpp"
 
 #include <algorithm>
@@ -64,14 +65,16 @@ std::vector<stmdsp::dacsample_t> deviceGenLoadFormulaEval(const std::string& for
     expression.register_symbol_table(symbol_table);
     parser.compile(formulaString, expression);
 
-    const auto genFun = [&x, &expression] {
-        const auto s = std::clamp(expression.value(), -1., 1.) * 2048. + 2048.;
-        ++x;
-        return static_cast<stmdsp::dacsample_t>(std::min(s, 4095.));
-    };
+    std::vector<double> values (stmdsp::SAMPLES_MAX);
+    std::generate(values.begin(), values.end(),
+        [&x, &expression] {
+            const auto v = expression.value();
+            ++x;
+            return v;
+        });
 
-    std::vector<stmdsp::dacsample_t> samples (stmdsp::SAMPLES_MAX);
-    std::generate(samples.begin(), samples.end(), genFun);
+    std::vector<stmdsp::dacsample_t> samples (values.size());
+    kernels::unitToDac(values.data(), samples.data(), values.size());
     return samples;
 }
 
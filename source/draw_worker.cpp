@@ -0,0 +1,491 @@
+/**
+ * @file draw_worker.cpp
+ * @brief Prepares the draw window's plot geometry on a worker thread.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "device.hpp"
+#include "draw_worker.hpp"
+#include "kernels.hpp"
+#include "main.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+stmdsp::dacsample_t voltsToSample(float volts)
+{
+    return std::clamp((volts + 3.3f) / 6.6f * 4095.f, 0.f, 4095.f);
+}
+
+/**
+ * Builds the trace of the samples at positions [first, first + count) of the
+ * given source, to fill a plot of the given size. When there are more
+ * samples than pixel columns, each column spans the true min/max of the
+ * samples it covers; when zoomed in further, the samples themselves are
+ * joined up and marked. Positions outside [begin, end) are left blank.
+ */
+static void buildTrace(const auto& source, std::size_t begin, std::size_t end,
+    double first, double count, const DrawRequest& req,
+    std::vector<ImVec2>& points, std::vector<ImVec2>& marks)
+{
+    const auto toY = [&req](stmdsp::dacsample_t s) {
+        const float n = std::clamp((s - 2048.) / req.yMinMax, -0.5, 0.5);
+        return req.height * (0.5f - n);
+    };
+
+    const int columns = static_cast<int>(req.width);
+    const double samplesPerColumn = count / columns;
+
+    points.clear();
+    marks.clear();
+    points.reserve(columns * 2);
+
+    if (samplesPerColumn < 1) {
+        const auto lo = std::max(begin, static_cast<std::size_t>(std::max(0., first)));
+        const auto hi = std::min(end, static_cast<std::size_t>(std::max(0., first + count)) + 2);
+        const bool marked = samplesPerColumn < 1. / 6;
+        for (auto i = lo; i < hi; ++i) {
+            points.emplace_back((i - first + 0.5) / samplesPerColumn, toY(source[i]));
+            if (marked)
+                marks.push_back(points.back());
+        }
+    } else {
+        float lastY = 0;
+        for (int x = 0; x < columns; ++x) {
+            const auto a = first + x * samplesPerColumn;
+            if (a + samplesPerColumn <= begin)
+                continue;
+            if (a >= end)
+                break;
+
+            const auto from = static_cast<std::size_t>(std::max(0., a));
+            const auto to = std::max(from + 1,
+                static_cast<std::size_t>(std::max(0., a + samplesPerColumn)));
+            const auto [min, max] = source.minmax(from, to);
+
+            // Visit the end of the span nearest the previous point first, so
+            // the path stays connected without doubling back across the column.
+            const float cx = x + 0.5f;
+            float near = toY(max);
+            float far = toY(min);
+            if (!points.empty() && std::abs(far - lastY) < std::abs(near - lastY))
+                std::swap(near, far);
+
+            points.emplace_back(cx, near);
+            if (far != near)
+                points.emplace_back(cx, far);
+            lastY = far;
+        }
+    }
+}
+
+/**
+ * Returns the source's sample at the given position in volts, if it is held.
+ * Only this one sample is ever converted; the traces are laid out in ADC
+ * codes.
+ */
+static std::optional<float> valueAt(const auto& source, std::size_t begin,
+    std::size_t end, double position)
+{
+    if (position < begin || position >= end)
+        return {};
+
+    const stmdsp::adcsample_t sample = source[static_cast<std::size_t>(position)];
+    float volts;
+    kernels::samplesToVolts(&sample, &volts, 1);
+    return volts;
+}
+
+/**
+ * Copies the samples of the other history that line up with positions
+ * [first, last) of the trigger source, whose newest sample is at end. The
+ * histories end together; if the other lags, as when chunks carry no input,
+ * nothing lines up and nothing is copied.
+ */
+static void copyAligned(const SampleHistory<stmdsp::dacsample_t>& other,
+    std::size_t end, std::size_t first, std::size_t last,
+    std::vector<stmdsp::dacsample_t>& out)
+{
+    if (other.end() < end)
+        return;
+
+    const auto shift = other.end() - end;
+    other.copy(first + shift, last + shift, out);
+}
+
+static void publishTriggerFrame(DrawTrigger& trig,
+    const std::vector<stmdsp::dacsample_t>& output,
+    const std::vector<stmdsp::dacsample_t>& input)
+{
+    trig.frame.resize(output.size(), 2048);
+    trig.frame.write(output.begin(), output.end());
+    trig.frameInput.resize(std::max<std::size_t>(input.size(), 1), 2048);
+    trig.frameInput.write(input.begin(), input.end());
+
+    if (trig.persistence)
+        trig.persistence->accumulate(output, 0, output.size());
+}
+
+/**
+ * Feeds the samples pulled in this render frame through the trigger, and
+ * publishes a new triggered view whenever one is complete.
+ */
+static void updateTrigger(DrawTrigger& trig,
+    const SampleHistory<stmdsp::dacsample_t>& history,
+    const SampleHistory<stmdsp::dacsample_t>& historyInput,
+    bool useInput, std::size_t N, double sampleRate)
+{
+    const auto& src = trig.source == 1 && useInput ? historyInput : history;
+    const auto& other = &src == &history ? historyInput : history;
+    const std::size_t end = src.end();
+    const std::size_t pre = std::min(N - 1,
+        static_cast<std::size_t>(N * trig.position / 100.f));
+    const std::size_t post = N - pre;
+
+    trig.edge.configure(voltsToSample(trig.level),
+        voltsToSample(trig.hysteresis) - voltsToSample(0),
+        static_cast<EdgeTrigger::Slope>(trig.slope));
+
+    // If more than one view's length arrived (or the history was reset),
+    // start over from the latest samples.
+    if (end < trig.seen || end - trig.seen > N) {
+        trig.seen = end - std::min(end, N);
+        trig.pending.reset();
+        trig.edge.rearm();
+    }
+
+    std::size_t pos = trig.seen;
+    while (pos < end) {
+        if (trig.pending) {
+            // Collect the rest of the pending view.
+            const auto stop = std::min(end, *trig.pending + post);
+            src.copy(pos, stop, trig.assembly);
+            if (useInput)
+                copyAligned(other, end, pos, stop, trig.assemblyInput);
+            pos = stop;
+
+            if (trig.assembly.size() == N) {
+                publishTriggerFrame(trig, trig.assembly, trig.assemblyInput);
+                trig.holdoffEnd = *trig.pending +
+                    static_cast<std::size_t>(trig.holdoff / 1000.f * sampleRate);
+                trig.lastFrame = pos;
+                trig.pending.reset();
+                if (trig.mode == DrawTrigger::Mode::Single)
+                    trig.armed = false;
+            }
+        } else if (trig.armed) {
+            pos = std::max(pos, std::min(end, trig.holdoffEnd));
+            if (pos == end)
+                break;
+
+            std::size_t found = 0;
+            for (auto s = src.contiguous(pos, end); !s.empty();
+                s = src.contiguous(pos + found, end))
+            {
+                const auto n = trig.edge.scan(s);
+                found += n;
+                if (n < s.size())
+                    break;
+            }
+
+            if (pos + found >= end) {
+                pos = end;
+            } else if (pos + found < src.begin() + pre) {
+                // Not enough history before this edge; look for the next one.
+                pos += found + 1;
+            } else {
+                trig.pending = pos + found;
+                trig.assembly.clear();
+                trig.assemblyInput.clear();
+                src.copy(*trig.pending - pre, *trig.pending, trig.assembly);
+                if (useInput)
+                    copyAligned(other, end, *trig.pending - pre, *trig.pending, trig.assemblyInput);
+                pos = *trig.pending;
+            }
+        } else {
+            pos = end;
+        }
+    }
+
+    trig.seen = end;
+
+    // Auto mode free-runs when no trigger has been seen for a whole view.
+    if (trig.mode == DrawTrigger::Mode::Auto && !trig.pending &&
+        end - std::min(end, trig.lastFrame) >= N)
+    {
+        std::vector<stmdsp::dacsample_t> output, input;
+        src.copy(end - std::min(end, N), end, output);
+        if (useInput)
+            copyAligned(other, end, end - std::min(end, N), end, input);
+        publishTriggerFrame(trig, output, input);
+        trig.lastFrame = end;
+    }
+}
+
+DrawWorker::DrawWorker()
+{
+    // Attached, so that unpaced replays wait for the window to keep up.
+    deviceStream().attach(m_cursor);
+    m_thread = std::thread(&DrawWorker::run, this);
+}
+
+DrawWorker::~DrawWorker()
+{
+    {
+        std::scoped_lock lock (m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    deviceStream().detach(m_cursor);
+}
+
+void DrawWorker::request(const DrawRequest& req)
+{
+    {
+        std::scoped_lock lock (m_lock);
+        m_pending = req;
+    }
+    m_wake.notify_one();
+}
+
+void DrawWorker::run()
+{
+    std::unique_lock lock (m_lock);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || m_pending; });
+        if (m_stop)
+            break;
+
+        const auto req = *m_pending;
+        m_pending.reset();
+        lock.unlock();
+        build(req);
+        lock.lock();
+    }
+}
+
+/**
+ * Accumulates the output samples that arrived since the last frame, and
+ * fades the image by the stream time that passed. In triggered mode the
+ * sweeps are instead accumulated as they are published.
+ */
+void DrawWorker::updatePersistence(const DrawRequest& req, bool triggered)
+{
+    m_phosphor.configure(req.width, req.height, req.yMinMax);
+
+    const std::size_t N = req.sweep;
+    const std::size_t end = m_history.end();
+    if (N != m_persistenceSweep || triggered != m_persistenceTriggered) {
+        m_phosphor.clear();
+        m_persistenceSweep = N;
+        m_persistenceTriggered = triggered;
+    }
+    if (end < m_persistenceSeen)
+        m_persistenceSeen = end - std::min(end, N);
+
+    const auto count = std::min(end - m_persistenceSeen, N);
+    if (!triggered && count > 0) {
+        // Position p sits at index p % N of its sweep, so the free-running
+        // view is itself a sweep.
+        for (auto pos = end - count; pos < end;) {
+            const auto stop = std::min(end, (pos / N + 1) * N);
+            const auto s = m_history.contiguous(pos, stop);
+            if (s.empty())
+                break;
+            m_phosphor.accumulate(s, pos % N, N);
+            pos += s.size();
+        }
+    }
+
+    const double elapsed = (end - m_persistenceSeen) / req.sampleRate;
+    m_persistenceSeen = end;
+    m_phosphor.render(std::exp2(-elapsed / req.persistenceTime));
+}
+
+/**
+ * Takes the stream's new chunks and moves the samples that are due to be
+ * shown into the histories. The display clock decides what is due from when
+ * the chunks arrived, not from the frame rate, so the time base holds steady
+ * through frame hitches. Unpaced chunks are shown as soon as they arrive.
+ */
+void DrawWorker::pull(bool input)
+{
+    m_arrived.clear();
+    deviceStream().read(m_cursor, m_arrived);
+
+    const auto restart = [this] {
+        m_waiting.clear();
+        m_waitingOffset = 0;
+        m_queued = 0;
+        m_clock.reset();
+    };
+
+    // A gap in the stream would throw off the clock's arrival times.
+    if (m_cursor.dropped != m_dropped) {
+        m_dropped = m_cursor.dropped;
+        restart();
+    }
+
+    for (auto& chunk : m_arrived) {
+        if (!chunk->display || chunk->output.empty())
+            continue;
+
+        if (chunk->stream != m_streamId) {
+            m_streamId = chunk->stream;
+            restart();
+        }
+
+        m_clock.arrived(chunk->output.size(), chunk->rate, chunk->arrival);
+        m_queued += chunk->output.size();
+        m_waiting.push_back(std::move(chunk));
+    }
+    m_arrived.clear();
+
+    if (m_waiting.empty())
+        return;
+
+    auto due = m_waiting.back()->rate <= 0 ? m_queued :
+        m_clock.advance(SampleChunk::clock::now(), m_queued);
+    m_queued -= std::min(due, m_queued);
+
+    // Input samples come from the same chunks as the output, so the two
+    // traces stay in step.
+    while (due > 0 && !m_waiting.empty()) {
+        const auto& chunk = *m_waiting.front();
+        const auto first = m_waitingOffset;
+        const auto count = std::min(due, chunk.output.size() - first);
+
+        m_history.write(chunk.output.cbegin() + first,
+            chunk.output.cbegin() + first + count);
+        if (input && chunk.input.size() > first) {
+            const auto inputCount = std::min(count, chunk.input.size() - first);
+            m_historyInput.write(chunk.input.cbegin() + first,
+                chunk.input.cbegin() + first + inputCount);
+        }
+
+        due -= count;
+        m_waitingOffset += count;
+        if (m_waitingOffset == chunk.output.size()) {
+            m_waiting.pop_front();
+            m_waitingOffset = 0;
+        }
+    }
+}
+
+void DrawWorker::build(const DrawRequest& req)
+{
+    const auto& last = m_last ? *m_last : DrawRequest();
+    if (!m_last || req.historyBudget != last.historyBudget) {
+        m_history.setBudget(req.historyBudget);
+        m_historyInput.setBudget(req.historyBudget);
+    }
+    if (req.resets != last.resets) {
+        m_history.reset();
+        m_historyInput.reset();
+    }
+    if (req.rearms != last.rearms) {
+        m_trigger.armed = true;
+        m_trigger.pending.reset();
+        m_trigger.edge.rearm();
+    }
+    if (req.persistenceClears != last.persistenceClears)
+        m_phosphor.clear();
+    static_cast<DrawTriggerSettings&>(m_trigger) = req.trigger;
+
+    const auto written = m_history.end();
+    pull(req.input);
+
+    // Nothing new to show: no samples arrived and nothing was changed.
+    if (m_last && req == last && m_history.end() == written)
+        return;
+    m_last = req;
+
+    const double span = req.span;
+    const double viewEnd = req.paused ? std::clamp<double>(req.end,
+        std::min<double>(m_history.end(), m_history.begin() + span), m_history.end())
+        : m_history.end();
+    const double first = viewEnd - span;
+
+    const bool triggered = m_trigger.mode != DrawTrigger::Mode::Off;
+    m_trigger.persistence = req.persistence && triggered ? &m_phosphor : nullptr;
+    if (!req.paused) {
+        // Triggered sweeps are accumulated as updateTrigger() publishes them,
+        // and so appear from the next frame.
+        if (req.persistence)
+            updatePersistence(req, triggered);
+        if (triggered) {
+            updateTrigger(m_trigger, m_history, m_historyInput, req.input,
+                req.sweep, req.sampleRate);
+        }
+    }
+
+    auto& g = m_geometry.back();
+    g.capacity = m_history.capacity();
+    g.begin = m_history.begin();
+    g.end = m_history.end();
+    g.first = first;
+    g.viewEnd = viewEnd;
+    g.armed = m_trigger.armed;
+    g.delay = m_clock.delay();
+
+    // The input trace is read at the same ages as the output trace.
+    const double inputShift = static_cast<double>(m_historyInput.end()) - m_history.end();
+    const auto& frame = m_trigger.frame;
+    const auto& frameInput = m_trigger.frameInput;
+
+    g.output.clear();
+    g.outputMarks.clear();
+    g.input.clear();
+    g.inputMarks.clear();
+    g.outputValue.reset();
+    g.inputValue.reset();
+    if (triggered) {
+        if (!req.persistence)
+            buildTrace(frame, 0, frame.size(), 0, frame.size(), req, g.output, g.outputMarks);
+        if (req.input) {
+            buildTrace(frameInput, 0, frameInput.size(), 0, frameInput.size(), req,
+                g.input, g.inputMarks);
+        }
+        if (req.mouse >= 0) {
+            g.outputValue = valueAt(frame, 0, frame.size(), req.mouse * frame.size());
+            if (req.input) {
+                g.inputValue = valueAt(frameInput, 0, frameInput.size(),
+                    req.mouse * frameInput.size());
+            }
+        }
+    } else {
+        if (!req.persistence) {
+            buildTrace(m_history, m_history.begin(), m_history.end(), first, span, req,
+                g.output, g.outputMarks);
+        }
+        if (req.input) {
+            buildTrace(m_historyInput, m_historyInput.begin(), m_historyInput.end(),
+                first + inputShift, span, req, g.input, g.inputMarks);
+        }
+        if (req.mouse >= 0) {
+            g.outputValue = valueAt(m_history, m_history.begin(), m_history.end(),
+                first + req.mouse * span);
+            if (req.input) {
+                g.inputValue = valueAt(m_historyInput, m_historyInput.begin(),
+                    m_historyInput.end(), first + inputShift + req.mouse * span);
+            }
+        }
+    }
+
+    if (req.persistence) {
+        g.image = m_phosphor.image();
+        g.imageWidth = m_phosphor.width();
+        g.imageHeight = m_phosphor.height();
+    } else {
+        g.image.clear();
+    }
+
+    m_geometry.publish();
+    guiWake();
+}
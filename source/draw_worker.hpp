@@ -0,0 +1,201 @@
+/**
+ * @file draw_worker.hpp
+ * @brief Prepares the draw window's plot geometry on a worker thread.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_DRAW_WORKER_HPP
+#define STMDSPGUI_DRAW_WORKER_HPP
+
+#include "chunk.hpp"
+#include "envelope.hpp"
+#include "history.hpp"
+#include "pacing.hpp"
+#include "phosphor.hpp"
+#include "swapbuffer.hpp"
+#include "trigger.hpp"
+#include "imgui.h"
+
+#include "stmdsp.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+stmdsp::dacsample_t voltsToSample(float volts);
+
+/**
+ * Settings of the draw window's edge-triggered mode, as set by its controls.
+ */
+struct DrawTriggerSettings
+{
+    enum class Mode : int { Off, Normal, Auto, Single };
+
+    Mode mode = Mode::Off;
+    int source = 0; // 0: output, 1: input
+    int slope = 0;  // EdgeTrigger::Slope
+    float level = 0.f;       // volts
+    float hysteresis = 0.05f; // volts
+    float holdoff = 0.f;     // milliseconds
+    float position = 50.f;   // percent of the view before the trigger
+
+    bool operator==(const DrawTriggerSettings&) const = default;
+};
+
+/**
+ * State for the draw window's edge-triggered mode. Sample positions are
+ * absolute, counted by the source history's end().
+ */
+struct DrawTrigger : DrawTriggerSettings
+{
+    EdgeTrigger edge;
+    bool armed = true; // Cleared after a Single capture.
+    std::size_t seen = 0;
+    std::size_t holdoffEnd = 0;
+    std::size_t lastFrame = 0;
+    std::optional<std::size_t> pending;
+    std::vector<stmdsp::dacsample_t> assembly;
+    std::vector<stmdsp::dacsample_t> assemblyInput;
+
+    // Triggered views; drawn in place of the free-running histories.
+    EnvelopeBuffer<stmdsp::dacsample_t> frame;
+    EnvelopeBuffer<stmdsp::dacsample_t> frameInput;
+
+    // When set, every triggered output sweep is also accumulated here.
+    Phosphor *persistence = nullptr;
+};
+
+/**
+ * Everything the worker needs to know to prepare one frame of the plot.
+ * One-shot actions are counters, so that none is lost when a request is
+ * replaced before the worker gets to it.
+ */
+struct DrawRequest
+{
+    float width = 1;  // Plot size, in pixels.
+    float height = 1;
+    unsigned int yMinMax = 4095;
+    double span = 1;         // Samples across the free-running view.
+    std::size_t sweep = 1;   // Samples in a triggered or persistent sweep.
+    bool paused = false;
+    double end = 0;          // Position of the view's right edge while paused.
+    bool input = false;      // Whether the input trace is drawn.
+    std::size_t historyBudget = 64 << 20; // Bytes per history.
+    unsigned int resets = 0; // Discards the histories.
+
+    DrawTriggerSettings trigger;
+    unsigned int rearms = 0;
+
+    bool persistence = false;
+    float persistenceTime = 1.f; // Seconds for intensity to halve.
+    unsigned int persistenceClears = 0;
+
+    double sampleRate = 1;
+    float mouse = -1; // Fraction of the width under the mouse; negative if none.
+
+    bool operator==(const DrawRequest&) const = default;
+};
+
+/**
+ * A finished frame of the plot. Vertices are relative to the plot's top-left
+ * corner and only need offsetting and submitting.
+ */
+struct DrawGeometry
+{
+    std::vector<ImVec2> output;
+    std::vector<ImVec2> input;
+    std::vector<ImVec2> outputMarks; // Individual samples, when zoomed in far.
+    std::vector<ImVec2> inputMarks;
+
+    std::size_t capacity = 0; // Longest history kept, in samples.
+    std::size_t begin = 0;    // Positions held by the output history.
+    std::size_t end = 0;
+    double first = 0;         // Positions across the free-running view.
+    double viewEnd = 0;
+    bool armed = true;
+    double delay = 0;         // Seconds from a sample arriving to it being shown.
+
+    // Sample values under the mouse, in volts.
+    std::optional<float> outputValue;
+    std::optional<float> inputValue;
+
+    // The persistence image, column-major; empty when persistence is off.
+    std::vector<uint32_t> image;
+    unsigned int imageWidth = 0;
+    unsigned int imageHeight = 0;
+};
+
+/**
+ * Owns the draw window's sample histories, trigger and persistence state,
+ * and turns them into plot geometry on its own thread. Each frame the GUI
+ * posts a request and fetches the newest finished geometry, so the decimation
+ * and vertex building never hold up the GUI thread.
+ */
+class DrawWorker
+{
+public:
+    DrawWorker();
+    ~DrawWorker();
+
+    /**
+     * Asks for the geometry of the given frame, replacing any request that
+     * has not been started yet. The GUI is woken once it is ready.
+     */
+    void request(const DrawRequest& req);
+
+    /**
+     * Takes the newest finished geometry, if there is one. Returns true if
+     * geometry() changed.
+     */
+    bool fetch() noexcept {
+        return m_geometry.fetch();
+    }
+
+    const DrawGeometry& geometry() const noexcept {
+        return m_geometry.front();
+    }
+
+private:
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::optional<DrawRequest> m_pending;
+    bool m_stop = false;
+
+    SwapBuffer<DrawGeometry> m_geometry;
+
+    // Only touched by the worker thread.
+    ChunkStream::Cursor m_cursor;
+    uint64_t m_dropped = 0;
+    std::vector<ChunkRef> m_arrived;
+    std::deque<ChunkRef> m_waiting;  // Chunks not yet fully moved to the histories.
+    std::size_t m_waitingOffset = 0; // Samples of the front chunk already moved.
+    std::size_t m_queued = 0;        // Samples left in m_waiting.
+    std::optional<unsigned int> m_streamId;
+    DisplayClock m_clock;
+    SampleHistory<stmdsp::dacsample_t> m_history;
+    SampleHistory<stmdsp::dacsample_t> m_historyInput;
+    DrawTrigger m_trigger;
+    Phosphor m_phosphor;
+    std::size_t m_persistenceSeen = 0;  // end() of the output history.
+    std::size_t m_persistenceSweep = 0; // Samples per sweep the image was built from.
+    bool m_persistenceTriggered = false;
+    std::optional<DrawRequest> m_last;
+
+    void run();
+    void build(const DrawRequest& req);
+    void pull(bool input);
+    void updatePersistence(const DrawRequest& req, bool triggered);
+};
+
+#endif // STMDSPGUI_DRAW_WORKER_HPP
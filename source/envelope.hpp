@@ -0,0 +1,190 @@
+/**
+ * @file envelope.hpp
+ * @brief Circular sample buffer with a min/max pyramid for envelope drawing.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENVELOPE_HPP
+#define ENVELOPE_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * A fixed-size circular buffer that also keeps min/max summaries of every
+ * power-of-two aligned block of samples. The summaries are updated as samples
+ * are written, so the exact min/max of any range can be found in logarithmic
+ * time no matter how many samples the range covers.
+ */
+template<typename T>
+class EnvelopeBuffer
+{
+public:
+    EnvelopeBuffer(std::size_t size = 1, const T& fill = T()) {
+        resize(size, fill);
+    }
+
+    /**
+     * Resizes the buffer, discarding its contents.
+     */
+    void resize(std::size_t size, const T& fill = T()) {
+        m_size = std::max<std::size_t>(size, 1);
+
+        // Storage is padded to a power of two so that every level halves
+        // evenly. Padding is never part of a query result.
+        const auto capacity = std::bit_ceil(m_size);
+        m_levels.resize(std::bit_width(capacity) - 1);
+        for (std::size_t i = 0; i < m_levels.size(); ++i)
+            m_levels[i].resize(capacity >> (i + 1));
+
+        m_samples.resize(capacity);
+        reset(fill);
+    }
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /**
+     * Fills the buffer with the given value and rewinds to its start.
+     */
+    void reset(const T& fill) {
+        std::fill(m_samples.begin(), m_samples.end(), fill);
+        for (auto& level : m_levels)
+            std::fill(level.begin(), level.end(), std::pair(fill, fill));
+        m_current = 0;
+        m_written = 0;
+    }
+
+    /**
+     * Returns the total number of samples written since the last reset.
+     */
+    std::size_t written() const noexcept {
+        return m_written;
+    }
+
+    /**
+     * Returns the two contiguous regions that hold the newest count samples,
+     * oldest first. The second region is empty unless the samples wrap.
+     */
+    std::pair<std::span<const T>, std::span<const T>> recent(std::size_t count) const noexcept {
+        count = std::min(count, m_size);
+        const T *data = m_samples.data();
+        if (count <= m_current) {
+            return {{data + m_current - count, count}, {}};
+        } else {
+            const auto wrapped = count - m_current;
+            return {{data + m_size - wrapped, wrapped}, {data, m_current}};
+        }
+    }
+
+    void put(const T& value) {
+        write(&value, &value + 1);
+    }
+
+    /**
+     * Writes the given samples at the current position, wrapping around to
+     * the start of the buffer as needed.
+     */
+    template<typename It>
+    void write(It first, It last) {
+        auto count = static_cast<std::size_t>(std::distance(first, last));
+        m_written += count;
+
+        // Anything older than one buffer length would be overwritten anyway.
+        if (count > m_size) {
+            const auto skip = count - m_size;
+            std::advance(first, skip);
+            m_current = (m_current + skip) % m_size;
+            count = m_size;
+        }
+
+        while (count > 0) {
+            const auto n = std::min(count, m_size - m_current);
+            auto next = first;
+            std::advance(next, n);
+            std::copy(first, next, m_samples.begin() + m_current);
+            update(m_current, m_current + n);
+
+            first = next;
+            count -= n;
+            m_current += n;
+            if (m_current == m_size)
+                m_current = 0;
+        }
+    }
+
+    T operator[](std::size_t i) const noexcept {
+        return m_samples[i];
+    }
+
+    /**
+     * Finds the smallest and largest samples in the index range [first, last).
+     */
+    std::pair<T, T> minmax(std::size_t first, std::size_t last) const noexcept {
+        last = std::min(last, m_size);
+        if (first >= last)
+            return {m_samples[std::min(first, m_size - 1)],
+                    m_samples[std::min(first, m_size - 1)]};
+
+        std::pair<T, T> result (m_samples[first], m_samples[first]);
+        const auto merge = [&result](const std::pair<T, T>& mm) {
+            result.first = std::min(result.first, mm.first);
+            result.second = std::max(result.second, mm.second);
+        };
+
+        // Bottom-up walk: take unpaired edge nodes at each level, then move
+        // up to the parents of what remains.
+        for (std::size_t level = 0; first < last; ++level) {
+            if (first & 1)
+                merge(node(level, first++));
+            if (last & 1)
+                merge(node(level, --last));
+            first >>= 1;
+            last >>= 1;
+        }
+
+        return result;
+    }
+
+private:
+    std::vector<T> m_samples;
+    std::vector<std::vector<std::pair<T, T>>> m_levels;
+    std::size_t m_size = 0;
+    std::size_t m_current = 0;
+    std::size_t m_written = 0;
+
+    std::pair<T, T> node(std::size_t level, std::size_t index) const noexcept {
+        if (level == 0)
+            return {m_samples[index], m_samples[index]};
+        else
+            return m_levels[level - 1][index];
+    }
+
+    // Recomputes the summaries covering the samples in [first, last).
+    void update(std::size_t first, std::size_t last) {
+        for (std::size_t level = 0; level < m_levels.size(); ++level) {
+            first >>= 1;
+            last = ((last - 1) >> 1) + 1;
+
+            for (auto i = first; i < last; ++i) {
+                const auto a = node(level, i * 2);
+                const auto b = node(level, i * 2 + 1);
+                m_levels[level][i] = {std::min(a.first, b.first),
+                                      std::max(a.second, b.second)};
+            }
+        }
+    }
+};
+
+#endif // ENVELOPE_HPP
@@ -0,0 +1,154 @@
+/**
+ * @file fft.cpp
+ * @brief Fast Fourier transform and window functions for host-side analysis.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fft.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+const char *fftWindowNames[5] = {
+    "Rectangular",
+    "Hann",
+    "Hamming",
+    "Blackman-Harris",
+    "Flat top"
+};
+
+FFT::FFT(std::size_t size) :
+    m_size(std::max<std::size_t>(std::bit_floor(size), 4))
+{
+    const auto half = m_size / 2;
+    const int bits = std::countr_zero(half);
+
+    m_re.resize(half);
+    m_im.resize(half);
+
+    m_bitReverse.resize(half);
+    for (std::size_t i = 0; i < half; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_bitReverse[i] = r;
+    }
+
+    // Each stage with butterfly span h uses h twiddles, stored contiguously
+    // starting at index h - 1.
+    m_twiddleRe.resize(half);
+    m_twiddleIm.resize(half);
+    for (std::size_t h = 1; h < half; h <<= 1) {
+        for (std::size_t j = 0; j < h; ++j) {
+            const double a = -std::numbers::pi * j / h;
+            m_twiddleRe[h - 1 + j] = std::cos(a);
+            m_twiddleIm[h - 1 + j] = std::sin(a);
+        }
+    }
+
+    // Used to split the half-length transform into the real spectrum.
+    m_realTwiddle.resize(half);
+    for (std::size_t k = 0; k < half; ++k)
+        m_realTwiddle[k] = std::polar(1., -2 * std::numbers::pi * k / m_size);
+}
+
+void FFT::forward(const float *in, std::complex<float> *out)
+{
+    const auto half = m_size / 2;
+    float *re = m_re.data();
+    float *im = m_im.data();
+
+    // Pack even/odd samples as real/imaginary parts, in bit-reversed order.
+    for (std::size_t i = 0; i < half; ++i) {
+        const auto r = m_bitReverse[i];
+        re[r] = in[2 * i];
+        im[r] = in[2 * i + 1];
+    }
+
+    // The first stage's twiddles are all one.
+    for (std::size_t i = 0; i < half; i += 2) {
+        const float tr = re[i + 1];
+        const float ti = im[i + 1];
+        re[i + 1] = re[i] - tr;
+        im[i + 1] = im[i] - ti;
+        re[i] += tr;
+        im[i] += ti;
+    }
+
+    for (std::size_t h = 2; h < half; h <<= 1) {
+        const float *__restrict wr = m_twiddleRe.data() + h - 1;
+        const float *__restrict wi = m_twiddleIm.data() + h - 1;
+
+        for (std::size_t base = 0; base < half; base += 2 * h) {
+            // The halves of a butterfly group never overlap.
+            float *__restrict ar = re + base;
+            float *__restrict ai = im + base;
+            float *__restrict br = ar + h;
+            float *__restrict bi = ai + h;
+
+            for (std::size_t j = 0; j < h; ++j) {
+                const float tr = br[j] * wr[j] - bi[j] * wi[j];
+                const float ti = br[j] * wi[j] + bi[j] * wr[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+
+    // Recover the spectrum of the real input from the packed transform.
+    out[0] = {re[0] + im[0], 0};
+    out[half] = {re[0] - im[0], 0};
+    for (std::size_t k = 1; k < half; ++k) {
+        const std::complex<float> z (re[k], im[k]);
+        const std::complex<float> zc (re[half - k], -im[half - k]);
+        const auto even = (z + zc) * 0.5f;
+        const auto odd = (z - zc) * std::complex<float>(0, -0.5f);
+        out[k] = even + m_realTwiddle[k] * odd;
+    }
+}
+
+std::vector<float> fftMakeWindow(FFTWindow type, std::size_t size)
+{
+    std::vector<float> window (size, 1.f);
+    if (size < 2)
+        return window;
+
+    // All but the rectangular window are sums of cosines.
+    std::vector<double> a;
+    switch (type) {
+    case FFTWindow::Rectangular:
+        return window;
+    case FFTWindow::Hann:
+        a = {0.5, 0.5};
+        break;
+    case FFTWindow::Hamming:
+        a = {0.54, 0.46};
+        break;
+    case FFTWindow::BlackmanHarris:
+        a = {0.35875, 0.48829, 0.14128, 0.01168};
+        break;
+    case FFTWindow::FlatTop:
+        a = {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368};
+        break;
+    }
+
+    // Periodic form, as is usual for spectral analysis.
+    for (std::size_t n = 0; n < size; ++n) {
+        const double x = 2 * std::numbers::pi * n / size;
+        double w = 0;
+        for (std::size_t k = 0; k < a.size(); ++k)
+            w += (k % 2 ? -a[k] : a[k]) * std::cos(k * x);
+        window[n] = w;
+    }
+
+    return window;
+}
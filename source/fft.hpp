@@ -0,0 +1,71 @@
+/**
+ * @file fft.hpp
+ * @brief Fast Fourier transform and window functions for host-side analysis.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_FFT_HPP
+#define STMDSPGUI_FFT_HPP
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Radix-2 FFT of real input. Twiddles and the bit-reversal permutation are
+ * computed once at construction. Internally a half-length complex FFT is run
+ * on split real/imaginary arrays, which keeps the butterfly loops contiguous
+ * so that the compiler can vectorize them.
+ */
+class FFT
+{
+public:
+    /**
+     * @param size Transform length; must be a power of two, at least four.
+     */
+    explicit FFT(std::size_t size);
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /**
+     * Transforms size() real samples into size() / 2 + 1 frequency bins.
+     */
+    void forward(const float *in, std::complex<float> *out);
+
+private:
+    std::size_t m_size;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+    std::vector<float> m_twiddleRe;
+    std::vector<float> m_twiddleIm;
+    std::vector<std::complex<float>> m_realTwiddle;
+    std::vector<uint32_t> m_bitReverse;
+};
+
+enum class FFTWindow : int {
+    Rectangular = 0,
+    Hann,
+    Hamming,
+    BlackmanHarris,
+    FlatTop
+};
+
+/**
+ * Display names for each FFTWindow, in enum order.
+ */
+extern const char *fftWindowNames[5];
+
+/**
+ * Generates the coefficients of the given window function.
+ */
+std::vector<float> fftMakeWindow(FFTWindow type, std::size_t size);
+
+#endif // STMDSPGUI_FFT_HPP
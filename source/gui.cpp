@@ -17,14 +17,21 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 
+#include <atomic>
+
 bool guiInitialize();
 void guiRender();
-bool guiHandleEvents();
+bool guiHandleEvents(int timeout, bool& input);
 void guiShutdown();
+void guiWake();
 
 static SDL_Window *window = nullptr;
 static SDL_GLContext gl_context;
 
+// Pushed by other threads to end a wait in guiHandleEvents().
+static Uint32 wakeEvent = static_cast<Uint32>(-1);
+static std::atomic_bool wakePending = false;
+
 bool guiInitialize()
 {
     if (SDL_Init(0) != 0) {
@@ -54,6 +61,8 @@ bool guiInitialize()
     SDL_GL_MakeCurrent(window, gl_context);
     SDL_GL_SetSwapInterval(1); // Enable vsync
 
+    wakeEvent = SDL_RegisterEvents(1);
+
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -119,11 +128,41 @@ void guiRender()
     SDL_GL_SwapWindow(window);
 }
 
-bool guiHandleEvents()
+/**
+ * Requests a new frame from any thread. Requests made while one is already
+ * pending are merged into it.
+ */
+void guiWake()
+{
+    if (wakeEvent != static_cast<Uint32>(-1) && !wakePending.exchange(true)) {
+        SDL_Event event {};
+        event.type = wakeEvent;
+        SDL_PushEvent(&event);
+    }
+}
+
+/**
+ * Handles all pending events.
+ * @param timeout Milliseconds to wait for the first event if none are
+ *                pending; zero to return immediately.
+ * @param input Set if any event other than a guiWake() request arrived.
+ * @return True if the application should quit.
+ */
+bool guiHandleEvents(int timeout, bool& input)
 {
     bool done = false;
+    input = false;
+
+    SDL_Event event;
+    bool have = timeout > 0 ? SDL_WaitEventTimeout(&event, timeout)
+                            : SDL_PollEvent(&event);
+    for (; have; have = SDL_PollEvent(&event)) {
+        if (event.type == wakeEvent) {
+            wakePending = false;
+            continue;
+        }
 
-    for (SDL_Event event; SDL_PollEvent(&event);) {
+        input = true;
         ImGui_ImplSDL2_ProcessEvent(&event);
         if (event.type == SDL_QUIT) {
             done = true;
@@ -0,0 +1,156 @@
+/**
+ * @file gui_analysis.cpp
+ * @brief Contains the "Analysis" menu and the sample history its views share.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.hpp"
+#include "circular.hpp"
+#include "device.hpp"
+#include "kernels.hpp"
+#include "imgui.h"
+
+#include "stmdsp.hpp"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+
+// Enough history for the largest FFT plus averaging, at the highest rate.
+constexpr std::size_t HistorySize = 1 << 21;
+
+// Raw samples are kept, so a chunk is stored with plain block copies; they
+// are only converted to volts as the views read them.
+using History = RingBuffer<stmdsp::dacsample_t>;
+
+static std::array<History, 2> histories {History(HistorySize), History(HistorySize)};
+static unsigned int sampleRate = 0;
+static bool showSpectrum = false;
+static bool showSpectrogram = false;
+static bool showMeasurements = false;
+static bool showBode = false;
+
+std::size_t analysisWritten(AnalysisStream stream)
+{
+    return histories[static_cast<int>(stream)].end();
+}
+
+bool analysisRead(AnalysisStream stream, std::size_t first, std::size_t count,
+    float *out)
+{
+    const auto& history = histories[static_cast<int>(stream)];
+    if (!history.holds(first, count))
+        return false;
+
+    for (const auto span : history.read_spans(first, count)) {
+        kernels::samplesToVolts(span.data(), out, span.size());
+        out += span.size();
+    }
+    return true;
+}
+
+unsigned int analysisSampleRate()
+{
+    return sampleRate;
+}
+
+static void analysisUpdate()
+{
+    static ChunkStream::Cursor cursor;
+    static uint64_t dropped = 0;
+    static bool attached = false;
+    static std::vector<ChunkRef> chunks;
+
+    const bool enabled = showSpectrum || showSpectrogram || showMeasurements ||
+                         showBode;
+    const bool withInput = showBode ||
+                           (showSpectrum && spectrumWantsInput()) ||
+                           (showSpectrogram && spectrogramWantsInput()) ||
+                           (showMeasurements && measureWantsInput());
+    deviceSetInputAnalysis(withInput);
+
+    // Only read the stream while something is shown, picking up from its
+    // newest chunk.
+    if (enabled != attached) {
+        attached = enabled;
+        if (enabled)
+            deviceStream().attach(cursor);
+        else
+            deviceStream().detach(cursor);
+    }
+    if (!enabled)
+        return;
+
+    // The streams are only aligned (sample for sample) if they start
+    // together, so restart both whenever the input is switched.
+    static bool hadInput = false;
+    if (withInput != hadInput) {
+        hadInput = withInput;
+        for (auto& h : histories)
+            h.reset();
+    }
+
+    chunks.clear();
+    deviceStream().read(cursor, chunks);
+
+    // A gap would break the continuity the views rely on.
+    if (cursor.dropped != dropped) {
+        dropped = cursor.dropped;
+        for (auto& h : histories)
+            h.reset();
+    }
+
+    if (chunks.empty())
+        return;
+
+    // Positions are only meaningful at a single rate.
+    if (const auto rate = deviceStreamSampleRate(); rate != sampleRate) {
+        sampleRate = rate;
+        for (auto& h : histories)
+            h.reset();
+    }
+
+    for (const auto& chunk : chunks) {
+        if (withInput) {
+            // Views that relate the two streams need them to stay
+            // sample-aligned, even if one read came up short.
+            const auto n = std::min(chunk->output.size(), chunk->input.size());
+            histories[0].write(std::span(chunk->output).first(n));
+            histories[1].write(std::span(chunk->input).first(n));
+        } else {
+            histories[0].write(chunk->output);
+        }
+    }
+    chunks.clear();
+}
+
+void analysisRenderMenu()
+{
+    if (ImGui::BeginMenu("Analysis")) {
+        ImGui::MenuItem("Spectrum", nullptr, &showSpectrum);
+        ImGui::MenuItem("Spectrogram", nullptr, &showSpectrogram);
+        ImGui::MenuItem("Measurements", nullptr, &showMeasurements);
+        ImGui::MenuItem("Transfer function", nullptr, &showBode);
+        ImGui::EndMenu();
+    }
+}
+
+void analysisRenderWindows()
+{
+    analysisUpdate();
+
+    if (showSpectrum)
+        spectrumRenderWindow(&showSpectrum);
+    if (showSpectrogram)
+        spectrogramRenderWindow(&showSpectrogram);
+    if (showMeasurements)
+        measureRenderWindow(&showMeasurements);
+    if (showBode)
+        bodeRenderWindow(&showBode);
+}
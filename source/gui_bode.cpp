@@ -0,0 +1,304 @@
+/**
+ * @file gui_bode.cpp
+ * @brief Contains the transfer function (Bode plot) window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.hpp"
+#include "fft.hpp"
+#include "imgui.h"
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+// Segments processed per frame at most; beyond this the view skips ahead.
+constexpr std::size_t MaxSegmentsPerFrame = 64;
+
+/**
+ * Welch-averaged auto- and cross-spectra of the input (x) and output (y)
+ * streams, from Hann-windowed segments with 50% overlap.
+ */
+struct CrossSpectra
+{
+    std::vector<float> xx;
+    std::vector<float> yy;
+    std::vector<std::complex<float>> xy;
+    std::size_t segments = 0;
+    std::size_t position = 0; // Stream position of the next segment.
+    bool valid = false;
+};
+
+static int fftSizeIndex = 3; // 512 << 3 = 4096
+static int averages = 32;
+static float minFrequency = 10.f;
+
+static std::unique_ptr<FFT> fft;
+static std::vector<float> window;
+static CrossSpectra spectra;
+
+static void bodeReset()
+{
+    const std::size_t size = 512u << fftSizeIndex;
+    if (!fft || fft->size() != size) {
+        fft = std::make_unique<FFT>(size);
+        window = fftMakeWindow(FFTWindow::Hann, size);
+    }
+
+    const auto bins = size / 2 + 1;
+    spectra.xx.assign(bins, 0.f);
+    spectra.yy.assign(bins, 0.f);
+    spectra.xy.assign(bins, {});
+    spectra.segments = 0;
+    spectra.valid = false;
+}
+
+/**
+ * Folds one segment of both streams into the averaged spectra. The average
+ * is a plain mean until the chosen number of segments is reached, and then
+ * becomes exponential so that the estimate follows changes to the algorithm.
+ */
+static void addSegment(const float *x, const float *y)
+{
+    static std::vector<float> windowed;
+    static std::vector<std::complex<float>> X, Y;
+
+    const auto size = fft->size();
+    windowed.resize(size);
+    X.resize(size / 2 + 1);
+    Y.resize(size / 2 + 1);
+
+    kernels::multiply(x, window.data(), windowed.data(), size);
+    fft->forward(windowed.data(), X.data());
+    kernels::multiply(y, window.data(), windowed.data(), size);
+    fft->forward(windowed.data(), Y.data());
+
+    ++spectra.segments;
+    const float weight = 1.f / std::min<std::size_t>(spectra.segments, averages);
+    for (std::size_t k = 0; k < X.size(); ++k) {
+        spectra.xx[k] += weight * (std::norm(X[k]) - spectra.xx[k]);
+        spectra.yy[k] += weight * (std::norm(Y[k]) - spectra.yy[k]);
+        spectra.xy[k] += weight * (std::conj(X[k]) * Y[k] - spectra.xy[k]);
+    }
+}
+
+static void bodeUpdate()
+{
+    static std::vector<float> x, y;
+
+    const auto size = fft->size();
+    const auto hop = size / 2;
+    const auto written = std::min(analysisWritten(AnalysisStream::Input),
+                                  analysisWritten(AnalysisStream::Output));
+    if (written < size)
+        return;
+
+    // Restart from recent samples if the history restarted or was outrun.
+    const auto newest = written - size;
+    if (!spectra.valid || spectra.position > written ||
+        spectra.position + hop * MaxSegmentsPerFrame < newest)
+    {
+        spectra.position = newest - std::min(newest, hop * (MaxSegmentsPerFrame - 1));
+        spectra.valid = true;
+    }
+
+    x.resize(size);
+    y.resize(size);
+    for (; spectra.position <= newest; spectra.position += hop) {
+        if (analysisRead(AnalysisStream::Input, spectra.position, size, x.data()) &&
+            analysisRead(AnalysisStream::Output, spectra.position, size, y.data()))
+        {
+            addSegment(x.data(), y.data());
+        }
+    }
+}
+
+static void renderControls()
+{
+    static const char *sizes[] = {"512", "1024", "2048", "4096", "8192",
+                                  "16384", "32768"};
+
+    bool reset = false;
+
+    ImGui::SetNextItemWidth(80);
+    reset |= ImGui::Combo("Size", &fftSizeIndex, sizes, IM_ARRAYSIZE(sizes));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100);
+    ImGui::SliderInt("Averages", &averages, 1, 512, "%d",
+        ImGuiSliderFlags_Logarithmic);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100);
+    ImGui::DragFloat("Min. freq.", &minFrequency, 1.f, 1.f, 1000.f, "%.0f Hz");
+    ImGui::SameLine();
+    reset |= ImGui::Button("Reset");
+    ImGui::SameLine();
+    ImGui::Text("%zu segments", spectra.segments);
+
+    if (reset || !fft)
+        bodeReset();
+}
+
+void bodeRenderWindow(bool *open)
+{
+    ImGui::SetNextWindowSize({640, 560}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("bode", open);
+
+    renderControls();
+    bodeUpdate();
+
+    const unsigned int rate = analysisSampleRate();
+    auto drawList = ImGui::GetWindowDrawList();
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    const ImVec2 size = ImGui::GetContentRegionAvail();
+    if (size.x < 20 || size.y < 60 || rate == 0) {
+        ImGui::End();
+        return;
+    }
+
+    // Magnitude, phase and coherence, stacked.
+    const float heights[] = {size.y * 0.45f, size.y * 0.35f, size.y * 0.2f};
+    const float tops[] = {p0.y, p0.y + heights[0], p0.y + heights[0] + heights[1]};
+    for (int i = 0; i < 3; ++i) {
+        drawList->AddRectFilled({p0.x, tops[i]}, {p0.x + size.x, tops[i] + heights[i] - 2},
+            IM_COL32_BLACK);
+    }
+
+    const float nyquist = rate / 2.f;
+    const float binWidth = static_cast<float>(rate) / fft->size();
+    const float fmin = std::clamp(minFrequency, binWidth, nyquist / 10);
+    const auto xToFreq = [&](float x) {
+        return fmin * std::pow(nyquist / fmin, x / size.x);
+    };
+    const auto freqToX = [&](float f) {
+        return p0.x + size.x * std::log(f / fmin) / std::log(nyquist / fmin);
+    };
+
+    // Magnitude spans -60 to +20 dB; phase spans -180 to 180 degrees.
+    const auto magToY = [&](float db) {
+        return tops[0] + (heights[0] - 2) * (1 - std::clamp((db + 60) / 80, 0.f, 1.f));
+    };
+    const auto phaseToY = [&](float deg) {
+        return tops[1] + (heights[1] - 2) * (1 - (deg + 180) / 360);
+    };
+    const auto cohToY = [&](float c) {
+        return tops[2] + (heights[2] - 2) * (1 - c);
+    };
+
+    const auto lcGrid = IM_COL32(60, 60, 60, 255);
+    const auto lcText = IM_COL32(180, 180, 180, 255);
+    char buf[48];
+    for (float decade = 1; decade < nyquist; decade *= 10) {
+        for (int m = 1; m < 10; ++m) {
+            const float f = decade * m;
+            if (f < fmin || f > nyquist)
+                continue;
+            const float x = freqToX(f);
+            for (int i = 0; i < 3; ++i)
+                drawList->AddLine({x, tops[i]}, {x, tops[i] + heights[i] - 2}, lcGrid);
+            if (m == 1) {
+                snprintf(buf, sizeof(buf), "%g Hz", f);
+                drawList->AddText({x + 2, tops[2] + heights[2] - 18}, lcText, buf);
+            }
+        }
+    }
+    for (int db = 0; db > -60; db -= 20) {
+        drawList->AddLine({p0.x, magToY(db)}, {p0.x + size.x, magToY(db)}, lcGrid);
+        snprintf(buf, sizeof(buf), "%d dB", db);
+        drawList->AddText({p0.x + 2, magToY(db) + 1}, lcText, buf);
+    }
+    for (int deg = 90; deg > -180; deg -= 90) {
+        drawList->AddLine({p0.x, phaseToY(deg)}, {p0.x + size.x, phaseToY(deg)}, lcGrid);
+        snprintf(buf, sizeof(buf), "%d deg", deg);
+        drawList->AddText({p0.x + 2, phaseToY(deg) + 1}, lcText, buf);
+    }
+    drawList->AddLine({p0.x, cohToY(0.5f)}, {p0.x + size.x, cohToY(0.5f)}, lcGrid);
+    drawList->AddText({p0.x + 2, tops[2] + 1}, lcText, "Coherence");
+
+    if (spectra.segments == 0) {
+        ImGui::End();
+        return;
+    }
+
+    // H = Sxy / Sxx at the bin nearest each pixel column.
+    const auto binAt = [&](float f) {
+        return std::min<std::size_t>(std::lround(f / binWidth), spectra.xx.size() - 1);
+    };
+    const auto transfer = [&](std::size_t k) {
+        return spectra.xx[k] > 0 ? spectra.xy[k] / spectra.xx[k] : std::complex<float>();
+    };
+    const auto coherence = [&](std::size_t k) {
+        const float d = spectra.xx[k] * spectra.yy[k];
+        return d > 0 ? std::min(std::norm(spectra.xy[k]) / d, 1.f) : 0.f;
+    };
+
+    static std::vector<ImVec2> mag, phase, coh;
+    mag.clear();
+    phase.clear();
+    coh.clear();
+
+    const int columns = static_cast<int>(size.x);
+    const auto phaseColor = IM_COL32(80, 80, 255, 255);
+    int poorStart = -1;
+    for (int c = 0; c <= columns; ++c) {
+        const bool end = c == columns;
+        const auto k = binAt(xToFreq(c + 0.5f));
+        const float g = end ? 1.f : coherence(k);
+
+        // Shade runs of columns where the estimate can't be trusted (little
+        // input energy there, or mostly noise).
+        if (g < 0.5f && poorStart < 0) {
+            poorStart = c;
+        } else if (g >= 0.5f && poorStart >= 0) {
+            for (int i = 0; i < 2; ++i) {
+                drawList->AddRectFilled({p0.x + poorStart, tops[i]},
+                    {p0.x + c, tops[i] + heights[i] - 2}, IM_COL32(90, 90, 90, 90));
+            }
+            poorStart = -1;
+        }
+        if (end)
+            break;
+
+        const auto h = transfer(k);
+        const float x = p0.x + c + 0.5f;
+        const float py = phaseToY(std::arg(h) * 180 / std::numbers::pi_v<float>);
+
+        // Break the phase trace where it wraps around.
+        if (!phase.empty() && std::abs(py - phase.back().y) > heights[1] / 2) {
+            drawList->AddPolyline(phase.data(), phase.size(), phaseColor, ImDrawFlags_None, 1.f);
+            phase.clear();
+        }
+
+        mag.emplace_back(x, magToY(20 * std::log10(std::max(std::abs(h), 1e-6f))));
+        phase.emplace_back(x, py);
+        coh.emplace_back(x, cohToY(g));
+    }
+
+    drawList->AddPolyline(mag.data(), mag.size(), IM_COL32(255, 0, 0, 255), ImDrawFlags_None, 1.f);
+    drawList->AddPolyline(phase.data(), phase.size(), phaseColor, ImDrawFlags_None, 1.f);
+    drawList->AddPolyline(coh.data(), coh.size(), IM_COL32(0, 200, 0, 255), ImDrawFlags_None, 1.f);
+
+    const auto mouse = ImGui::GetMousePos();
+    if (mouse.x > p0.x && mouse.x < p0.x + size.x &&
+        mouse.y > p0.y && mouse.y < p0.y + size.y)
+    {
+        const auto k = binAt(xToFreq(mouse.x - p0.x));
+        const auto h = transfer(k);
+        drawList->AddLine({mouse.x, p0.y}, {mouse.x, p0.y + size.y}, IM_COL32(255, 255, 0, 255));
+        snprintf(buf, sizeof(buf), "   %.1f Hz, %.2f dB, %.1f deg, coh. %.3f",
+            k * binWidth, 20 * std::log10(std::max(std::abs(h), 1e-6f)),
+            std::arg(h) * 180 / std::numbers::pi_v<float>, coherence(k));
+        drawList->AddText(mouse, IM_COL32(255, 255, 0, 255), buf);
+    }
+
+    ImGui::End();
+}
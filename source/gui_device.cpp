@@ -1,44 +1,48 @@
-#include "circular.hpp"
+#include "device.hpp"
+#include "draw_worker.hpp"
 #include "imgui.h"
 #include "imgui_internal.h"
 #include "ImGuiFileDialog.h"
 
 #include "stmdsp.hpp"
 
+#include <SDL2/SDL_opengl.h>
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdio>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
-// Used for status queries and buffer size configuration.
+// Used for status queries.
 extern std::shared_ptr<stmdsp::device> m_device;
 
-void deviceAlgorithmUnload();
-void deviceAlgorithmUpload();
-bool deviceConnect();
-void deviceGenLoadFormula(const std::string& list);
-void deviceGenLoadList(std::string_view list);
-bool deviceGenStartToggle();
-void deviceLoadAudioFile(const std::string& file);
-void deviceLoadLogFile(const std::string& file);
-void deviceSetSampleRate(unsigned int index);
-void deviceSetInputDrawing(bool enabled);
-void deviceStart(bool logResults, bool drawSamples);
-void deviceStartMeasurement();
-void deviceUpdateDrawBufferSize(double timeframe);
-std::size_t pullFromDrawQueue(
-    CircularBuffer<std::vector, stmdsp::dacsample_t>& circ);
-std::size_t pullFromInputDrawQueue(
-    CircularBuffer<std::vector, stmdsp::dacsample_t>& circ);
+extern void log(const std::string& str);
+
+void processingOpen();
+bool sequenceIsRunning();
+void sequenceOpen(const std::string& path, bool draw);
+void sequenceStop();
 
 static std::string sampleRatePreview = "?";
 static bool measureCodeTime = false;
 static bool logResults = false;
+static bool logInput = false;
 static bool drawSamples = false;
 static bool popupRequestBuffer = false;
 static bool popupRequestSiggen = false;
 static bool popupRequestLog = false;
+static bool popupRequestReplay = false;
+static bool popupRequestSequence = false;
+static bool popupRequestExport = false;
+static bool exportStream = false;
+static bool popupRequestServer = false;
+static bool serveStream = false;
+static double replaySpeed = 1; // Zero replays as fast as possible.
 static double drawSamplesTimeframe = 1.0; // seconds
 
 static std::string getSampleRatePreview(unsigned int rate)
@@ -69,7 +73,6 @@ void deviceRenderMenu()
                     connectLabel = "Disconnect";
                     sampleRatePreview =
                         getSampleRatePreview(m_device->get_sample_rate());
-                    deviceUpdateDrawBufferSize(drawSamplesTimeframe);
                 } else {
                     deviceRenderDisconnect();
                 }
@@ -77,21 +80,29 @@ void deviceRenderMenu()
 
         const bool isConnected = m_device ? true : false;
         const bool isRunning = isConnected && m_device->is_running();
+        // A running sequence has the device to itself.
+        const bool isFree = isConnected && !sequenceIsRunning();
 
         ImGui::Separator();
 
-        static std::string startLabel ("Start");
-        addMenuItem(startLabel, isConnected, [&] {
-                startLabel = isRunning ? "Start" : "Stop";
+        addMenuItem(isRunning ? "Stop" : "Start", isFree, [&] {
                 deviceStart(logResults, drawSamples);
                 if (logResults && isRunning)
                     logResults = false;
             });
-        addMenuItem("Upload algorithm", isConnected && !isRunning,
+        addMenuItem("Upload algorithm", isFree && !isRunning,
             deviceAlgorithmUpload);
-        addMenuItem("Unload algorithm", isConnected && !isRunning,
+        addMenuItem("Unload algorithm", isFree && !isRunning,
             deviceAlgorithmUnload);
         addMenuItem("Measure Code Time", isRunning, deviceStartMeasurement);
+        if (deviceIsReplaying())
+            addMenuItem("Stop replay", true, deviceReplayStop);
+        else
+            addMenuItem("Replay capture...", !isRunning, [] { popupRequestReplay = true; });
+        if (sequenceIsRunning())
+            addMenuItem("Stop sequence", true, sequenceStop);
+        else
+            addMenuItem("Run sequence...", isConnected && !isRunning, [] { popupRequestSequence = true; });
 
         ImGui::Separator();
         if (!isConnected || isRunning)
@@ -102,22 +113,34 @@ void deviceRenderMenu()
             if (logResults)
                 popupRequestLog = true;
         }
+        if (ImGui::Checkbox("Log input with results", &logInput))
+            deviceSetInputLogging(logInput);
         addMenuItem("Set buffer size...", true, [] { popupRequestBuffer = true; });
 
         if (!isConnected || isRunning)
             ImGui::PopDisabled();
+        addMenuItem("Host processing...", true, processingOpen);
+        if (exportStream) {
+            addMenuItem("Stop shared-memory export", true,
+                [] { exportStream = !deviceSetExport({}, false); });
+        } else {
+            addMenuItem("Export to shared memory...", true, [] { popupRequestExport = true; });
+        }
+        if (serveStream) {
+            addMenuItem("Stop stream server", true,
+                [] { serveStream = !deviceSetServer({}); });
+        } else {
+            addMenuItem("Serve stream...", true, [] { popupRequestServer = true; });
+        }
         ImGui::Separator();
 
         addMenuItem("Load signal generator",
-            isConnected && !m_device->is_siggening() && !m_device->is_running(),
+            isFree && !m_device->is_siggening() && !m_device->is_running(),
             [] { popupRequestSiggen = true; });
 
-        static std::string startSiggenLabel ("Start signal generator");
-        addMenuItem(startSiggenLabel, isConnected, [&] {
-                const bool running = deviceGenStartToggle();
-                startSiggenLabel = running ? "Stop signal generator"
-                                           : "Start signal generator";
-            });
+        addMenuItem(isConnected && m_device->is_siggening() ?
+                "Stop signal generator" : "Start signal generator",
+            isFree, deviceGenStartToggle);
 
         ImGui::EndMenu();
     }
@@ -126,13 +149,13 @@ void deviceRenderMenu()
 void deviceRenderToolbar()
 {
     ImGui::SameLine();
-    if (ImGui::Button("Upload"))
+    if (ImGui::Button("Upload") && !sequenceIsRunning())
         deviceAlgorithmUpload();
     ImGui::SameLine();
     ImGui::SetNextItemWidth(100);
 
-    const bool enable =
-        m_device && !m_device->is_running() && !m_device->is_siggening();
+    const bool enable = m_device && !m_device->is_running() &&
+        !m_device->is_siggening() && !sequenceIsRunning();
     if (!enable)
         ImGui::PushDisabled();
 
@@ -142,9 +165,10 @@ void deviceRenderToolbar()
         for (const auto& r : sampleRateInts) {
             const auto s = getSampleRatePreview(r);
             if (ImGui::Selectable(s.c_str())) {
-                sampleRatePreview = s;
-                deviceSetSampleRate(r);
-                deviceUpdateDrawBufferSize(drawSamplesTimeframe);
+                if (deviceSetSampleRate(r))
+                    sampleRatePreview = s;
+                else
+                    log("Error: Device did not accept the sample rate.");
             }
         }
 
@@ -169,7 +193,91 @@ void deviceRenderWidgets()
     } else if (popupRequestLog) {
         popupRequestLog = false;
         ImGuiFileDialog::Instance()->OpenModal(
-            "ChooseFileLog", "Choose File", ".csv", ".");
+            "ChooseFileLog", "Choose File", ".csv,.stmcap", ".");
+    } else if (popupRequestReplay) {
+        popupRequestReplay = false;
+        ImGui::OpenPopup("replay");
+    } else if (popupRequestSequence) {
+        popupRequestSequence = false;
+        ImGuiFileDialog::Instance()->OpenModal(
+            "ChooseFileSequence", "Choose File", ".seq,.txt", ".");
+    } else if (popupRequestExport) {
+        popupRequestExport = false;
+        ImGui::OpenPopup("export");
+    } else if (popupRequestServer) {
+        popupRequestServer = false;
+        ImGui::OpenPopup("server");
+    }
+
+    if (ImGui::BeginPopup("server")) {
+        static auto serverAddress = std::string(STMDSP_STREAM_DEFAULT_PATH).append(48, '\0');
+
+        ImGui::Text("Unix socket path, or TCP port (or loopback host:port):");
+        ImGui::PushStyleColor(ImGuiCol_FrameBg, {.8, .8, .8, 1});
+        ImGui::InputText("", serverAddress.data(), serverAddress.size());
+        ImGui::PopStyleColor();
+
+        if (ImGui::Button("Start")) {
+            serveStream = deviceSetServer(serverAddress.substr(0, serverAddress.find('\0')));
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel"))
+            ImGui::CloseCurrentPopup();
+        ImGui::EndPopup();
+    }
+
+    if (ImGui::BeginPopup("export")) {
+        static auto exportName = std::string("/stmdsp").append(56, '\0');
+        static bool exportInput = false;
+
+        ImGui::Text("Shared-memory segment name:");
+        ImGui::PushStyleColor(ImGuiCol_FrameBg, {.8, .8, .8, 1});
+        ImGui::InputText("", exportName.data(), exportName.size());
+        ImGui::PopStyleColor();
+        ImGui::Checkbox("Include input", &exportInput);
+
+        if (ImGui::Button("Start")) {
+            exportStream = deviceSetExport(
+                exportName.substr(0, exportName.find('\0')), exportInput);
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel"))
+            ImGui::CloseCurrentPopup();
+        ImGui::EndPopup();
+    }
+
+    if (ImGui::BeginPopup("replay")) {
+        static int replayOption = 0;
+        static int replayFactor = 4;
+
+        ImGui::RadioButton("Real-time", &replayOption, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("Accelerated", &replayOption, 1);
+        ImGui::SameLine();
+        ImGui::RadioButton("As fast as possible", &replayOption, 2);
+
+        if (replayOption == 1) {
+            ImGui::SetNextItemWidth(100);
+            if (ImGui::InputInt("x speed", &replayFactor))
+                replayFactor = std::clamp(replayFactor, 2, 1000);
+        }
+
+        if (ImGui::Button("Choose File")) {
+            replaySpeed = replayOption == 0 ? 1 :
+                          replayOption == 1 ? replayFactor : 0;
+
+            // This dialog will override the replay popup, closing it.
+            ImGuiFileDialog::Instance()->OpenModal(
+                "ChooseFileReplay", "Choose File", ".stmcap", ".");
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel"))
+            ImGui::CloseCurrentPopup();
+
+        ImGui::EndPopup();
     }
 
     if (ImGui::BeginPopup("siggen")) {
@@ -234,10 +342,8 @@ void deviceRenderWidgets()
             ImGuiInputTextFlags_CharsDecimal);
         ImGui::PopStyleColor();
         if (ImGui::Button("Save")) {
-            if (m_device) {
-                int n = std::clamp(std::stoi(bufferSizeInput), 100, 4096);
-                m_device->continuous_set_buffer_size(n);
-            }
+            int n = std::clamp(std::stoi(bufferSizeInput), 100, 4096);
+            deviceSetBufferSize(n);
             ImGui::CloseCurrentPopup();
         }
         ImGui::SameLine();
@@ -271,40 +377,234 @@ void deviceRenderWidgets()
 
         ImGuiFileDialog::Instance()->Close();
     }
+
+    if (ImGuiFileDialog::Instance()->Display("ChooseFileSequence",
+                                             ImGuiWindowFlags_NoCollapse,
+                                             ImVec2(460, 540)))
+    {
+        if (ImGuiFileDialog::Instance()->IsOk()) {
+            const auto filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
+            sequenceOpen(filePathName, drawSamples);
+        }
+
+        ImGuiFileDialog::Instance()->Close();
+    }
+
+    if (ImGuiFileDialog::Instance()->Display("ChooseFileReplay",
+                                             ImGuiWindowFlags_NoCollapse,
+                                             ImVec2(460, 540)))
+    {
+        if (ImGuiFileDialog::Instance()->IsOk()) {
+            const auto filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
+            if (deviceReplayStart(filePathName, replaySpeed))
+                drawSamples = true;
+        }
+
+        ImGuiFileDialog::Instance()->Close();
+    }
 }
 
+/**
+ * Returns true if the trigger should be re-armed.
+ * @param armed Whether the trigger is currently armed.
+ */
+static bool renderTriggerControls(DrawTriggerSettings& trig, bool armed)
+{
+    static const char *modes[] = {"Off", "Normal", "Auto", "Single"};
+    static const char *sources[] = {"Output", "Input"};
+    static const char *slopes[] = {"Rising", "Falling"};
+
+    bool rearm = false;
+
+    int mode = static_cast<int>(trig.mode);
+    ImGui::Text("Trigger");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(90);
+    if (ImGui::Combo("##mode", &mode, modes, IM_ARRAYSIZE(modes))) {
+        trig.mode = static_cast<DrawTriggerSettings::Mode>(mode);
+        rearm = true;
+    }
+
+    if (trig.mode == DrawTriggerSettings::Mode::Off)
+        return rearm;
+
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::Combo("##source", &trig.source, sources, IM_ARRAYSIZE(sources));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::Combo("##slope", &trig.slope, slopes, IM_ARRAYSIZE(slopes));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::DragFloat("Level", &trig.level, 0.01f, -3.3f, 3.3f, "%.2fV");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::DragFloat("Hyst.", &trig.hysteresis, 0.005f, 0.f, 1.f, "%.3fV");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::DragFloat("Holdoff", &trig.holdoff, 1.f, 0.f, 10000.f, "%.0fms");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::SliderFloat("Pre", &trig.position, 0.f, 100.f, "%.0f%%");
+
+    if (trig.mode == DrawTriggerSettings::Mode::Single) {
+        ImGui::SameLine();
+        if (ImGui::Button(armed ? "Armed" : "Arm"))
+            rearm = true;
+    }
+
+    return rearm;
+}
+
+/**
+ * Settings and texture for the draw window's persistence mode. The image
+ * itself is built by the draw worker.
+ */
+struct DrawPersistence
+{
+    bool enabled = false;
+    float time = 1.f; // seconds for intensity to halve
+    unsigned int clears = 0;
+
+    GLuint texture = 0;
+    unsigned int textureWidth = 0;
+    unsigned int textureHeight = 0;
+};
+
+static void renderPersistenceControls(DrawPersistence& persist)
+{
+    ImGui::Checkbox("Persistence", &persist.enabled);
+    if (!persist.enabled)
+        return;
+
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(120);
+    ImGui::SliderFloat("Decay", &persist.time, 0.05f, 60.f, "%.2fs",
+        ImGuiSliderFlags_Logarithmic);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        ++persist.clears;
+}
+
+/**
+ * Uploads the persistence image of the given geometry for drawing.
+ */
+static void uploadPersistence(DrawPersistence& persist, const DrawGeometry& g)
+{
+    // The image is column-major, so it is uploaded as the plot's transpose.
+    if (persist.texture == 0) {
+        glGenTextures(1, &persist.texture);
+        glBindTexture(GL_TEXTURE_2D, persist.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, persist.texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (persist.textureWidth != g.imageWidth || persist.textureHeight != g.imageHeight) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g.imageHeight, g.imageWidth,
+            0, GL_RGBA, GL_UNSIGNED_BYTE, g.image.data());
+        persist.textureWidth = g.imageWidth;
+        persist.textureHeight = g.imageHeight;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g.imageHeight, g.imageWidth,
+            GL_RGBA, GL_UNSIGNED_BYTE, g.image.data());
+    }
+}
+
+/**
+ * Submits a trace prepared by the draw worker, placing it at the plot's
+ * top-left corner p0.
+ */
+static void submitTrace(ImDrawList *drawList, const std::vector<ImVec2>& points,
+    const std::vector<ImVec2>& marks, const ImVec2& p0, ImU32 color)
+{
+    // Reused between calls and frames to avoid reallocating every frame.
+    static std::vector<ImVec2> placed;
+
+    placed.resize(points.size());
+    std::transform(points.cbegin(), points.cend(), placed.begin(),
+        [&p0](const ImVec2& p) { return ImVec2(p.x + p0.x, p.y + p0.y); });
+    drawList->AddPolyline(placed.data(), placed.size(), color, ImDrawFlags_None, 1.f);
+
+    for (const auto& m : marks) {
+        drawList->AddRectFilled({p0.x + m.x - 1.5f, p0.y + m.y - 1.5f},
+            {p0.x + m.x + 1.5f, p0.y + m.y + 1.5f}, color);
+    }
+}
+
+/**
+ * Where the free-running view sits in the sample history. A live view
+ * follows the newest samples; a paused one stays put, so that older samples
+ * can be looked over while new ones keep arriving.
+ */
+struct DrawView
+{
+    bool paused = false;
+    double end = 0; // Stream position of the view's right edge.
+    unsigned int sampleRate = 0;
+    unsigned int resets = 0;
+};
+
+// Memory given to each trace's history.
+static const std::size_t historyBudgets[] = {64 << 20, 256 << 20, 1024 << 20};
+static const char *historyBudgetNames[] = {"64 MB", "256 MB", "1 GB"};
+
+// Shortest view, and longest triggered or persistent sweep, in seconds.
+constexpr double MinTimeframe = 1. / 1024;
+constexpr double MaxSweepTimeframe = 32;
+
 void deviceRenderDraw()
 {
     if (drawSamples) {
-        static std::vector<stmdsp::dacsample_t> buffer;
-        static std::vector<stmdsp::dacsample_t> bufferInput;
-        static auto bufferCirc = CircularBuffer(buffer);
-        static auto bufferInputCirc = CircularBuffer(bufferInput);
-
+        // Started with the window, so the thread only exists once needed.
+        static DrawWorker worker;
+
+        static DrawTriggerSettings trigger;
+        static unsigned int rearms = 0;
+        static DrawPersistence persist;
+        static DrawView view;
+        static int historyIndex = 1;
         static bool drawSamplesInput = false;
         static unsigned int yMinMax = 4095;
 
-        ImGui::Begin("draw", &drawSamples);
+        const bool fresh = worker.fetch();
+        const auto& g = worker.geometry();
+
+        // Positions only map to times at the rate they were taken at.
+        if (const auto rate = deviceStreamSampleRate(); rate != 0 && rate != view.sampleRate) {
+            ++view.resets;
+            view.paused = false;
+            view.sampleRate = rate;
+        }
+        const double sampleRate = std::max(1u, view.sampleRate);
+        const double maxTimeframe = std::max(MinTimeframe,
+            g.capacity > 0 ? g.capacity / sampleRate : MaxSweepTimeframe);
+
+        ImGui::Begin("draw", &drawSamples,
+            ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
         ImGui::Text("Draw input ");
         ImGui::SameLine();
         if (ImGui::Checkbox("", &drawSamplesInput)) {
             deviceSetInputDrawing(drawSamplesInput);
             if (drawSamplesInput) {
-                bufferCirc.reset(2048);
-                bufferInputCirc.reset(2048);
+                ++view.resets;
+                view.paused = false;
             }
         }
         ImGui::SameLine();
         ImGui::Text("Time: %0.3f sec", drawSamplesTimeframe);
         ImGui::SameLine();
-        if (ImGui::Button("-", {30, 0})) {
-            drawSamplesTimeframe = std::max(drawSamplesTimeframe / 2., 0.0078125);
-            deviceUpdateDrawBufferSize(drawSamplesTimeframe);
-        }
+        if (ImGui::Button("-", {30, 0}))
+            drawSamplesTimeframe = std::max(drawSamplesTimeframe / 2., MinTimeframe);
+        ImGui::SameLine();
+        if (ImGui::Button("+", {30, 0}))
+            drawSamplesTimeframe = std::min(drawSamplesTimeframe * 2, maxTimeframe);
         ImGui::SameLine();
-        if (ImGui::Button("+", {30, 0})) {
-            drawSamplesTimeframe = std::min(drawSamplesTimeframe * 2, 32.);
-            deviceUpdateDrawBufferSize(drawSamplesTimeframe);
+        if (ImGui::Button(view.paused ? "Live" : "Pause", {50, 0})) {
+            view.paused = !view.paused;
+            view.end = g.end;
         }
         ImGui::SameLine();
         ImGui::Text("Y: +/-%1.2fV", 3.3f * (static_cast<float>(yMinMax) / 4095.f));
@@ -316,29 +616,97 @@ void deviceRenderDraw()
         if (ImGui::Button(" + ", {30, 0})) {
             yMinMax = std::min(4095u, (yMinMax << 1) | 1);
         }
-
-        auto newSize = pullFromDrawQueue(bufferCirc);
-        if (newSize > 0) {
-            buffer.resize(newSize);
-            bufferCirc = CircularBuffer(buffer);
-            pullFromDrawQueue(bufferCirc);
+        ImGui::SameLine();
+        ImGui::Text("Delay: %.0f ms", g.delay * 1000);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80);
+        ImGui::Combo("History", &historyIndex, historyBudgetNames,
+            IM_ARRAYSIZE(historyBudgetNames));
+        if (renderTriggerControls(trigger, g.armed))
+            ++rearms;
+        renderPersistenceControls(persist);
+
+        // The plot fills the space left below the controls.
+        auto drawList = ImGui::GetWindowDrawList();
+        ImVec2 p0 = ImGui::GetWindowPos();
+        auto size = ImGui::GetWindowSize();
+        const float controlsHeight = ImGui::GetCursorScreenPos().y - p0.y;
+        p0.y += controlsHeight;
+        size.y -= controlsHeight + 5;
+        size.x = std::floor(size.x);
+        size.y = std::floor(std::max(size.y, 1.f));
+
+        const bool triggered = trigger.mode != DrawTriggerSettings::Mode::Off;
+
+        // The plot takes the mouse: the wheel zooms and dragging scrolls
+        // back through the history.
+        ImGui::SetCursorScreenPos(p0);
+        ImGui::InvisibleButton("##plot", size);
+        const auto& io = ImGui::GetIO();
+        const auto mouse = ImGui::GetMousePos();
+        const bool mouseOver = mouse.x > p0.x && mouse.x < p0.x + size.x &&
+            mouse.y > p0.y && mouse.y < p0.y + size.y;
+
+        drawSamplesTimeframe = std::clamp(drawSamplesTimeframe, MinTimeframe, maxTimeframe);
+        if (!view.paused)
+            view.end = g.end;
+
+        if (ImGui::IsItemHovered() && io.MouseWheel != 0) {
+            const double zoomed = std::clamp(drawSamplesTimeframe * std::pow(0.8, io.MouseWheel),
+                MinTimeframe, maxTimeframe);
+
+            // Keep the sample under the mouse in place. Live views stay
+            // pinned to the newest samples instead.
+            if (view.paused && !triggered) {
+                const double right = 1 - (mouse.x - p0.x) / size.x;
+                view.end += (zoomed - drawSamplesTimeframe) * sampleRate * right;
+            }
+            drawSamplesTimeframe = zoomed;
         }
 
-        if (drawSamplesInput) {
-            auto newSize = pullFromInputDrawQueue(bufferInputCirc);
-            if (newSize > 0) {
-                bufferInput.resize(newSize);
-                bufferInputCirc = CircularBuffer(bufferInput);
-                pullFromInputDrawQueue(bufferInputCirc);
-            }
+        const double span = drawSamplesTimeframe * sampleRate;
+        if (ImGui::IsItemActive() && !triggered && io.MouseDelta.x != 0) {
+            view.end -= io.MouseDelta.x * span / size.x;
+            view.paused = true;
+        }
+        if (view.paused) {
+            view.end = std::clamp<double>(view.end,
+                std::min<double>(g.end, g.begin + span), g.end);
         }
 
-        auto drawList = ImGui::GetWindowDrawList();
-        ImVec2 p0 = ImGui::GetWindowPos();
-        auto size = ImGui::GetWindowSize();
-        p0.y += 65;
-        size.y -= 70;
+        DrawRequest req;
+        req.width = size.x;
+        req.height = size.y;
+        req.yMinMax = yMinMax;
+        req.span = span;
+        req.sweep = static_cast<std::size_t>(std::clamp(span, 1.,
+            MaxSweepTimeframe * sampleRate));
+        req.paused = view.paused;
+        req.end = view.paused ? view.end : 0;
+        req.input = drawSamplesInput;
+        req.historyBudget = historyBudgets[historyIndex];
+        req.resets = view.resets;
+        req.trigger = trigger;
+        req.rearms = rearms;
+        req.persistence = persist.enabled;
+        req.persistenceTime = persist.time;
+        req.persistenceClears = persist.clears;
+        req.sampleRate = sampleRate;
+        req.mouse = mouseOver ? (mouse.x - p0.x) / size.x : -1;
+        worker.request(req);
+
+        if (fresh && persist.enabled && !g.image.empty())
+            uploadPersistence(persist, g);
+
         drawList->AddRectFilled(p0, {p0.x + size.x, p0.y + size.y}, IM_COL32_BLACK);
+        if (persist.enabled && persist.texture != 0) {
+            // Texture rows run along the plot's x axis.
+            const ImVec2 p1 {p0.x + size.x, p0.y + size.y};
+            drawList->AddImageQuad(
+                reinterpret_cast<ImTextureID>(static_cast<intptr_t>(persist.texture)),
+                p0, {p1.x, p0.y}, p1, {p0.x, p1.y},
+                {0, 0}, {0, 1}, {1, 1}, {1, 0});
+        }
 
         const auto lcMinor = ImGui::GetColorU32(IM_COL32(40, 40, 40, 255));
         const auto lcMajor = ImGui::GetColorU32(IM_COL32(140, 140, 140, 255));
@@ -362,52 +730,47 @@ void deviceRenderDraw()
             }
         }
 
-        const float di = static_cast<float>(buffer.size()) / size.x;
-        const float dx = std::ceil(size.x / static_cast<float>(buffer.size()));
-        ImVec2 pp = p0;
-        float i = 0;
-        while (pp.x < p0.x + size.x) {
-            unsigned int idx = i;
-            float n = std::clamp((buffer[idx] - 2048.) / yMinMax, -0.5, 0.5);
-            i += di;
-
-            ImVec2 next (pp.x + dx, p0.y + size.y * (0.5 - n));
-            drawList->AddLine(pp, next, ImGui::GetColorU32(IM_COL32(255, 0, 0, 255)));
-            pp = next;
-        }
-
-        if (drawSamplesInput) {
-            ImVec2 pp = p0;
-            float i = 0;
-            while (pp.x < p0.x + size.x) {
-                unsigned int idx = i;
-                float n = std::clamp((bufferInput[idx] - 2048.) / yMinMax, -0.5, 0.5);
-                i += di;
-
-                ImVec2 next (pp.x + dx, p0.y + size.y * (0.5 - n));
-                drawList->AddLine(pp, next, ImGui::GetColorU32(IM_COL32(0, 0, 255, 255)));
-                pp = next;
+        drawList->PushClipRect(p0, {p0.x + size.x, p0.y + size.y}, true);
+        submitTrace(drawList, g.output, g.outputMarks, p0, IM_COL32(255, 0, 0, 255));
+        if (drawSamplesInput)
+            submitTrace(drawList, g.input, g.inputMarks, p0, IM_COL32(0, 0, 255, 255));
+        drawList->PopClipRect();
+
+        if (triggered) {
+            // Mark the trigger position and level.
+            const auto color = IM_COL32(0, 200, 0, 255);
+            const float tx = p0.x + size.x * trigger.position / 100.f;
+            const float n = std::clamp((voltsToSample(trigger.level) - 2048.) / yMinMax, -0.5, 0.5);
+            const float ty = p0.y + size.y * (0.5f - n);
+            drawList->AddLine({tx, p0.y}, {tx, p0.y + size.y}, color);
+            drawList->AddLine({p0.x, ty}, {p0.x + size.x, ty}, color);
+        } else if (g.end > g.begin) {
+            // Show where the view sits within the whole history.
+            const double held = g.end - g.begin;
+            const float x0 = p0.x + size.x * std::max(0., g.first - g.begin) / held;
+            const float x1 = p0.x + size.x * (g.viewEnd - g.begin) / held;
+            const float y = p0.y + size.y - 4;
+            drawList->AddRectFilled({p0.x, y}, {p0.x + size.x, y + 3}, IM_COL32(60, 60, 60, 255));
+            drawList->AddRectFilled({x0, y}, {std::max(x1, x0 + 2), y + 3}, IM_COL32(200, 200, 200, 255));
+
+            if (view.paused) {
+                char buf[48];
+                snprintf(buf, sizeof(buf), "Paused, %.3f s behind",
+                    (g.end - g.viewEnd) / sampleRate);
+                drawList->AddText({p0.x + 4, p0.y + 4}, IM_COL32(255, 255, 0, 255), buf);
             }
         }
 
-        const auto mouse = ImGui::GetMousePos();
-        if (mouse.x > p0.x && mouse.x < p0.x + size.x &&
-            mouse.y > p0.y && mouse.y < p0.y + size.y)
-        {
+        if (mouseOver) {
             char buf[16];
             drawList->AddLine({mouse.x, p0.y}, {mouse.x, p0.y + size.y}, IM_COL32(255, 255, 0, 255));
 
-            {
-                const std::size_t si = (mouse.x - p0.x) / size.x * buffer.size();
-                const float s = buffer[si] / 4095.f * 6.6f - 3.3f;
-                snprintf(buf, sizeof(buf), "   %1.3fV", s);
+            if (g.outputValue) {
+                snprintf(buf, sizeof(buf), "   %1.3fV", *g.outputValue);
                 drawList->AddText(mouse, IM_COL32(255, 0, 0, 255), buf);
             }
-
-            if (drawSamplesInput) {
-                const std::size_t si = (mouse.x - p0.x) / size.x * bufferInput.size();
-                const float s = bufferInput[si] / 4095.f * 6.6f - 3.3f;
-                snprintf(buf, sizeof(buf), "   %1.3fV", s);
+            if (drawSamplesInput && g.inputValue) {
+                snprintf(buf, sizeof(buf), "   %1.3fV", *g.inputValue);
                 drawList->AddText({mouse.x, mouse.y + 20}, IM_COL32(0, 0, 255, 255), buf);
             }
         }
@@ -415,4 +778,3 @@ void deviceRenderDraw()
         ImGui::End();
     }
 }
-
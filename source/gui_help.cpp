@@ -11,11 +11,11 @@
 
 #include "imgui.h"
 #include "ImGuiFileDialog.h"
+#include "runtime.hpp"
 
 #include <cstdlib>
 #include <iostream>
 #include <string>
-#include <thread>
 
 void log(const std::string& str);
 
@@ -72,7 +72,7 @@ void helpRenderDialog()
             }
 #endif
 
-	    std::thread(helpDownloadThread).detach();
+	    runtime().startIo("firmware", [](auto) { helpDownloadThread(); });
         }
 
         ImGuiFileDialog::Instance()->Close();
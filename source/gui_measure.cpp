@@ -0,0 +1,216 @@
+/**
+ * @file gui_measure.cpp
+ * @brief Contains the live measurements panel.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.hpp"
+#include "fft.hpp"
+#include "measure.hpp"
+#include "runtime.hpp"
+#include "imgui.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// Blocks are a hundredth of a second, so windows are a whole number of them.
+constexpr unsigned int BlocksPerSecond = 100;
+
+enum class FrequencyMethod : int {
+    ZeroCrossings = 0,
+    Autocorrelation
+};
+
+struct StreamMeasurement
+{
+    Measurement measurement;
+    Measurement::Result result;
+    float frequency = 0;
+    std::size_t position = 0; // Stream position of the next sample to process.
+    bool valid = false;
+
+    // Scratch space of its own, so that the streams can be updated at once.
+    std::vector<float> chunk;
+    std::vector<float> recent;
+    std::unique_ptr<FFT> fft;
+};
+
+static int windowIndex = 2; // 1 second
+static int frequencyMethod = static_cast<int>(FrequencyMethod::ZeroCrossings);
+static bool showInput = false;
+
+static std::array<StreamMeasurement, 2> streams;
+static unsigned int configuredRate = 0;
+
+bool measureWantsInput()
+{
+    return showInput;
+}
+
+static double windowSeconds()
+{
+    static const double seconds[] = {0.1, 0.5, 1, 2, 5};
+    return seconds[windowIndex];
+}
+
+static void measureReset(unsigned int rate)
+{
+    const auto blockSize = std::max(1u, rate / BlocksPerSecond);
+    const auto blockCount = static_cast<std::size_t>(windowSeconds() * BlocksPerSecond);
+    for (auto& s : streams) {
+        s.measurement.configure(blockSize, blockCount);
+        s.result = {};
+        s.frequency = 0;
+        s.valid = false;
+    }
+
+    configuredRate = rate;
+}
+
+/**
+ * Feeds every sample that arrived since the last frame through the stream's
+ * measurement, then refreshes its results.
+ */
+static void measureUpdate(AnalysisStream stream, StreamMeasurement& s,
+    unsigned int rate)
+{
+    constexpr std::size_t ChunkSize = 4096;
+    auto& chunk = s.chunk;
+    chunk.resize(ChunkSize);
+
+    const auto written = analysisWritten(stream);
+    const auto window = static_cast<std::size_t>(windowSeconds() * rate);
+
+    // Start over if the history restarted or was outrun.
+    if (!s.valid || s.position > written || written - s.position > window) {
+        s.measurement.reset();
+        s.position = written - std::min(written, window);
+        s.valid = true;
+    }
+
+    while (s.position < written) {
+        const auto n = std::min(ChunkSize, written - s.position);
+        if (!analysisRead(stream, s.position, n, chunk.data())) {
+            s.valid = false;
+            return;
+        }
+
+        s.measurement.process(chunk.data(), n);
+        s.position += n;
+    }
+
+    s.result = s.measurement.result(rate);
+    s.frequency = s.result.frequency;
+
+    if (static_cast<FrequencyMethod>(frequencyMethod) == FrequencyMethod::Autocorrelation) {
+        auto& fft = s.fft;
+        auto& recent = s.recent;
+
+        if (!fft)
+            fft = std::make_unique<FFT>(16384);
+        const auto count = std::min(written, fft->size() / 2);
+        recent.resize(count);
+        s.frequency = 0;
+        if (analysisRead(stream, written - count, count, recent.data()))
+            s.frequency = autocorrelationFrequency(recent.data(), count, *fft, rate);
+    }
+}
+
+static void renderControls()
+{
+    static const char *windows[] = {"0.1 s", "0.5 s", "1 s", "2 s", "5 s"};
+    static const char *methods[] = {"Zero crossings", "Autocorrelation"};
+
+    ImGui::SetNextItemWidth(80);
+    if (ImGui::Combo("Window", &windowIndex, windows, IM_ARRAYSIZE(windows)))
+        measureReset(configuredRate);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(140);
+    ImGui::Combo("Frequency", &frequencyMethod, methods, IM_ARRAYSIZE(methods));
+    ImGui::SameLine();
+    ImGui::Checkbox("Input", &showInput);
+}
+
+void measureRenderWindow(bool *open)
+{
+    ImGui::SetNextWindowSize({420, 420}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("measurements", open);
+
+    renderControls();
+
+    const unsigned int rate = analysisSampleRate();
+    if (rate != configuredRate)
+        measureReset(rate);
+
+    const int count = showInput ? 2 : 1;
+    if (rate > 0) {
+        // The input is measured on the pool alongside the output. The
+        // histories only change on this thread, so they hold still until
+        // both are done.
+        Job<void> input;
+        if (showInput) {
+            input = runtime().submit("measure input",
+                [rate] { measureUpdate(AnalysisStream::Input, streams[1], rate); });
+        }
+        measureUpdate(AnalysisStream::Output, streams[0], rate);
+        if (input.valid())
+            input.get();
+    }
+
+    if (ImGui::BeginTable("values", count + 1,
+        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("");
+        ImGui::TableSetupColumn("Output");
+        if (showInput)
+            ImGui::TableSetupColumn("Input");
+        ImGui::TableHeadersRow();
+
+        const auto row = [count](const char *name, const char *format, auto value) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name);
+            for (int i = 0; i < count; ++i) {
+                ImGui::TableNextColumn();
+                if (streams[i].result.count > 0)
+                    ImGui::Text(format, value(streams[i]));
+                else
+                    ImGui::TextUnformatted("-");
+            }
+        };
+
+        using S = const StreamMeasurement&;
+        row("Mean",       "%.4f V",  [](S s) { return s.result.mean; });
+        row("RMS",        "%.4f V",  [](S s) { return s.result.rms; });
+        row("RMS (AC)",   "%.4f V",  [](S s) { return s.result.acRms; });
+        row("Min",        "%.4f V",  [](S s) { return s.result.min; });
+        row("Max",        "%.4f V",  [](S s) { return s.result.max; });
+        row("Pk-pk",      "%.4f V",  [](S s) { return s.result.max - s.result.min; });
+        row("Crest",      "%.3f",    [](S s) { return s.result.crest; });
+        row("Frequency",  "%.2f Hz", [](S s) { return s.frequency; });
+        ImGui::EndTable();
+    }
+
+    // Amplitude histograms, -3.3V on the left to 3.3V on the right.
+    const float height = (ImGui::GetContentRegionAvail().y - 10) / count;
+    if (height > 20) {
+        static const char *labels[] = {"##output", "##input"};
+        static const char *titles[] = {"Output histogram", "Input histogram"};
+        for (int i = 0; i < count; ++i) {
+            const auto& h = streams[i].result.histogram;
+            ImGui::PlotHistogram(labels[i], h.data(), h.size(), 0, titles[i],
+                0.f, FLT_MAX, {ImGui::GetContentRegionAvail().x, height - 4});
+        }
+    }
+
+    ImGui::End();
+}
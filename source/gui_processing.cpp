@@ -0,0 +1,97 @@
+/**
+ * @file gui_processing.cpp
+ * @brief Contains the window for setting up host processing of the stream.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "device.hpp"
+#include "imgui.h"
+
+#include <string>
+
+static bool showProcessing = false;
+static std::string processingInput (4096, '\0');
+
+void processingOpen()
+{
+    showProcessing = true;
+}
+
+static void renderStats(const char *id, bool input)
+{
+    const auto stats = deviceProcessingStats(input);
+    if (stats.empty())
+        return;
+
+    if (ImGui::BeginTable(id, 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn(input ? "Input stage" : "Output stage");
+        ImGui::TableSetupColumn("us/block");
+        ImGui::TableSetupColumn("Msamples/s");
+        ImGui::TableSetupColumn("Share");
+        ImGui::TableHeadersRow();
+
+        double total = 0;
+        for (const auto& s : stats)
+            total += s.seconds;
+
+        for (const auto& s : stats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.blocks > 0 ? s.seconds / s.blocks * 1e6 : 0.);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.seconds > 0 ? s.samples / s.seconds / 1e6 : 0.);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f%%", total > 0 ? s.seconds / total * 100 : 0.);
+
+            for (const auto& m : s.metrics) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextDisabled("  %s", m.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%g", m.value);
+                ImGui::TableNextColumn();
+                ImGui::TableNextColumn();
+            }
+        }
+
+        ImGui::EndTable();
+    }
+}
+
+void processingRenderWindow()
+{
+    if (!showProcessing)
+        return;
+
+    ImGui::SetNextWindowSize({520, 420}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("Host processing", &showProcessing);
+
+    ImGui::TextUnformatted("Stages, one per line, applied in order:");
+    ImGui::TextDisabled("decimate N, dc [Hz], fir lowpass|highpass Hz [taps],\n"
+                        "lowpass|highpass|bandpass|notch Hz [Q], gain dB,\n"
+                        "plugin path [args]");
+    ImGui::PushStyleColor(ImGuiCol_FrameBg, {.8, .8, .8, 1});
+    ImGui::InputTextMultiline("##stages", processingInput.data(),
+        processingInput.size(), {-1, ImGui::GetTextLineHeight() * 6});
+    ImGui::PopStyleColor();
+
+    if (ImGui::Button("Apply"))
+        deviceSetProcessing(processingInput.substr(0, processingInput.find('\0')));
+    ImGui::SameLine();
+    if (ImGui::Button("Off")) {
+        processingInput[0] = '\0';
+        deviceSetProcessing({});
+    }
+
+    renderStats("output", false);
+    renderStats("input", true);
+
+    ImGui::End();
+}
@@ -0,0 +1,109 @@
+/**
+ * @file gui_sequence.cpp
+ * @brief Contains the window for running sequence scripts.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sequencer.hpp"
+#include "imgui.h"
+
+#include <string>
+#include <vector>
+
+static Sequencer sequencer;
+static std::string sequencePath;
+static bool showSequence = false;
+static bool sequenceDraw = false;
+
+// Copied from the sequencer whenever a run finishes.
+static std::vector<SequenceResult> results;
+
+bool sequenceIsRunning()
+{
+    return sequencer.running();
+}
+
+void sequenceStop()
+{
+    sequencer.stop();
+}
+
+// Stops a running script and waits for it, before the device goes away.
+void sequenceShutdown()
+{
+    sequencer.stop();
+    sequencer.wait();
+}
+
+/**
+ * Loads the given script and starts running it.
+ * @param draw Whether the runs are shown in the draw window.
+ */
+void sequenceOpen(const std::string& path, bool draw)
+{
+    if (sequencer.running() || !sequencer.load(path))
+        return;
+
+    sequencePath = path;
+    sequenceDraw = draw;
+    showSequence = true;
+    results.clear();
+    sequencer.start(draw);
+}
+
+void sequenceRenderWindow()
+{
+    if (!showSequence)
+        return;
+
+    if (sequencer.resultCount() != results.size())
+        results = sequencer.results();
+
+    ImGui::SetNextWindowSize({760, 320}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("Sequence", &showSequence);
+
+    const bool running = sequencer.running();
+    ImGui::Text("%s: %zu of %zu runs done", sequencePath.c_str(),
+        results.size(), sequencer.runCount());
+    ImGui::SameLine();
+    if (running) {
+        if (ImGui::Button("Stop"))
+            sequencer.stop();
+    } else if (ImGui::Button("Run again")) {
+        results.clear();
+        sequencer.start(sequenceDraw);
+    }
+
+    const auto header = Sequencer::tableHeader();
+    const auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+        ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY |
+        ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("results", header.size(), flags)) {
+        ImGui::TableSetupScrollFreeze(1, 1);
+        for (const auto& h : header)
+            ImGui::TableSetupColumn(h.c_str());
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(results.size());
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+                ImGui::TableNextRow();
+                for (const auto& cell : Sequencer::tableRow(results[i])) {
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(cell.c_str());
+                }
+            }
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
@@ -0,0 +1,293 @@
+/**
+ * @file gui_spectrogram.cpp
+ * @brief Contains the scrolling spectrogram (waterfall) window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.hpp"
+#include "fft.hpp"
+#include "imgui.h"
+#include "kernels.hpp"
+
+#include <SDL2/SDL_opengl.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// Wider spectra are reduced by taking the largest of each group of bins.
+constexpr std::size_t MaxColumns = 2048;
+
+static int fftSizeIndex = 3;  // 256 << 3 = 2048
+static int overlapIndex = 1;  // 50%
+static int rowsIndex = 1;     // 512
+static int windowType = static_cast<int>(FFTWindow::Hann);
+static float levelMin = -100.f;
+static float levelMax = 0.f;
+static bool showInput = false;
+
+static std::unique_ptr<FFT> fft;
+static std::vector<float> window;
+static float windowScale = 1;
+
+static GLuint texture = 0;
+static std::size_t columns = 0;
+static std::size_t rows = 0;
+static std::vector<uint32_t> pixels; // CPU copy of the texture, RGBA8.
+static std::array<uint32_t, 256> palette;
+
+static std::size_t position = 0; // Stream position of the next FFT.
+static std::size_t rowCount = 0; // Rows produced since the last reset.
+static bool positionValid = false;
+
+bool spectrogramWantsInput()
+{
+    return showInput;
+}
+
+static std::size_t hopSize()
+{
+    // Overlaps of 0, 50, 75 and 87.5 percent.
+    return fft->size() >> overlapIndex;
+}
+
+static void makePalette()
+{
+    // Black through blue, red and yellow to white.
+    constexpr std::array<std::array<float, 3>, 5> stops {{
+        {0.f, 0.f, 0.f},
+        {0.1f, 0.f, 0.5f},
+        {0.8f, 0.1f, 0.2f},
+        {1.f, 0.8f, 0.f},
+        {1.f, 1.f, 1.f}
+    }};
+
+    for (std::size_t i = 0; i < palette.size(); ++i) {
+        const float f = i / 255.f * (stops.size() - 1);
+        const auto s = std::min<std::size_t>(f, stops.size() - 2);
+        const float t = f - s;
+        uint32_t c = 0xFF000000u; // Alpha in the last byte, as RGBA in memory.
+        for (int ch = 0; ch < 3; ++ch) {
+            const float v = stops[s][ch] + t * (stops[s + 1][ch] - stops[s][ch]);
+            c |= static_cast<uint32_t>(v * 255.f + 0.5f) << (8 * ch);
+        }
+        palette[i] = c;
+    }
+}
+
+static void spectrogramReset()
+{
+    const std::size_t size = 256u << fftSizeIndex;
+    if (!fft || fft->size() != size)
+        fft = std::make_unique<FFT>(size);
+
+    window = fftMakeWindow(static_cast<FFTWindow>(windowType), size);
+    float gain = 0;
+    for (const auto w : window)
+        gain += w;
+    windowScale = 2.f / gain;
+
+    columns = std::min(size / 2, MaxColumns);
+    rows = 256u << rowsIndex;
+    pixels.assign(columns * rows, palette[0]);
+
+    if (texture == 0)
+        glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    // Rows are a ring; wrapping lets it be drawn with one quad at any offset.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, columns, rows, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, pixels.data());
+
+    rowCount = 0;
+    positionValid = false;
+}
+
+/**
+ * Renders one spectrum into the given texture row.
+ */
+static void computeRow(const float *samples, uint32_t *row)
+{
+    static std::vector<float> windowed;
+    static std::vector<std::complex<float>> bins;
+
+    const auto size = fft->size();
+    windowed.resize(size);
+    bins.resize(size / 2 + 1);
+
+    kernels::multiply(samples, window.data(), windowed.data(), size);
+    fft->forward(windowed.data(), bins.data());
+
+    // Work in squared magnitude so only one log is needed per column.
+    const std::size_t group = size / 2 / columns;
+    const float scale = windowScale * windowScale;
+    const float range = 255.f / (levelMax - levelMin);
+    for (std::size_t c = 0; c < columns; ++c) {
+        float power = 0;
+        for (std::size_t k = c * group; k < (c + 1) * group; ++k)
+            power = std::max(power, std::norm(bins[k]));
+
+        const float db = 10 * std::log10(std::max(power * scale, 1e-14f));
+        const float index = std::clamp((db - levelMin) * range, 0.f, 255.f);
+        row[c] = palette[static_cast<int>(index)];
+    }
+}
+
+/**
+ * Runs every FFT that new samples allow and uploads only the rows that
+ * changed. If the view has fallen behind by more than a screen of rows, the
+ * older spectra are skipped since they would scroll away unseen.
+ */
+static void spectrogramUpdate()
+{
+    static std::vector<float> samples;
+
+    const auto stream = showInput ? AnalysisStream::Input : AnalysisStream::Output;
+    const auto size = fft->size();
+    const auto hop = hopSize();
+    const auto written = analysisWritten(stream);
+    if (written < size)
+        return;
+
+    const auto newest = written - size;
+    if (!positionValid || position > written || position + hop * rows < newest) {
+        position = newest - std::min(newest, hop * (rows - 1));
+        positionValid = true;
+    }
+
+    const auto firstRow = rowCount;
+    samples.resize(size);
+    for (; position <= newest; position += hop) {
+        if (!analysisRead(stream, position, size, samples.data()))
+            continue;
+        computeRow(samples.data(), pixels.data() + (rowCount % rows) * columns);
+        ++rowCount;
+    }
+
+    if (rowCount == firstRow)
+        return;
+
+    // At most two uploads: the changed rows may wrap around the ring.
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    auto first = firstRow % rows;
+    auto count = std::min(rowCount - firstRow, rows);
+    if (count == rows)
+        first = rowCount % rows;
+    while (count > 0) {
+        const auto n = std::min(count, rows - first);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, columns, n, GL_RGBA,
+            GL_UNSIGNED_BYTE, pixels.data() + first * columns);
+        first = (first + n) % rows;
+        count -= n;
+    }
+}
+
+static void renderControls()
+{
+    static const char *sizes[] = {"256", "512", "1024", "2048", "4096",
+                                  "8192", "16384"};
+    static const char *overlaps[] = {"0%", "50%", "75%", "87.5%"};
+    static const char *rowCounts[] = {"256", "512", "1024"};
+
+    bool reset = false;
+
+    ImGui::SetNextItemWidth(80);
+    reset |= ImGui::Combo("Size", &fftSizeIndex, sizes, IM_ARRAYSIZE(sizes));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    reset |= ImGui::Combo("Overlap", &overlapIndex, overlaps, IM_ARRAYSIZE(overlaps));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(130);
+    reset |= ImGui::Combo("Window", &windowType, fftWindowNames,
+        IM_ARRAYSIZE(fftWindowNames));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    reset |= ImGui::Combo("History", &rowsIndex, rowCounts, IM_ARRAYSIZE(rowCounts));
+
+    ImGui::SetNextItemWidth(200);
+    ImGui::DragFloatRange2("dBV", &levelMin, &levelMax, 0.5f, -160.f, 20.f,
+        "%.0f", "%.0f", ImGuiSliderFlags_AlwaysClamp);
+    if (levelMax - levelMin < 1.f)
+        levelMax = levelMin + 1.f;
+    ImGui::SameLine();
+    reset |= ImGui::Checkbox("Input", &showInput);
+    ImGui::SameLine();
+    reset |= ImGui::Button("Clear");
+
+    if (reset || !fft)
+        spectrogramReset();
+}
+
+void spectrogramRenderWindow(bool *open)
+{
+    if (texture == 0)
+        makePalette();
+
+    ImGui::SetNextWindowSize({640, 480}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("spectrogram", open);
+
+    renderControls();
+    spectrogramUpdate();
+
+    const unsigned int rate = analysisSampleRate();
+    auto drawList = ImGui::GetWindowDrawList();
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    const ImVec2 size = ImGui::GetContentRegionAvail();
+    if (size.x < 20 || size.y < 20 || rate == 0) {
+        ImGui::End();
+        return;
+    }
+
+    // Newest row at the top; texture coordinates run past the ring's end.
+    const float vTop = static_cast<float>(rowCount % rows) / rows;
+    drawList->AddImage(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(texture)),
+        p0, {p0.x + size.x, p0.y + size.y}, {0, vTop}, {1, vTop - 1});
+
+    const auto lcGrid = IM_COL32(255, 255, 255, 60);
+    const auto lcText = IM_COL32(255, 255, 255, 200);
+    const float nyquist = rate / 2.f;
+    const float rowTime = static_cast<float>(hopSize()) / rate;
+    char buf[32];
+    for (int i = 1; i < 10; ++i) {
+        const float x = p0.x + size.x * i / 10;
+        drawList->AddLine({x, p0.y}, {x, p0.y + size.y}, lcGrid);
+        snprintf(buf, sizeof(buf), "%.0f Hz", nyquist * i / 10);
+        drawList->AddText({x + 2, p0.y + size.y - 18}, lcText, buf);
+    }
+    for (int i = 1; i < 4; ++i) {
+        const float y = p0.y + size.y * i / 4;
+        drawList->AddLine({p0.x, y}, {p0.x + size.x, y}, lcGrid);
+        snprintf(buf, sizeof(buf), "-%.2f s", rowTime * rows * i / 4);
+        drawList->AddText({p0.x + 2, y + 1}, lcText, buf);
+    }
+
+    const auto mouse = ImGui::GetMousePos();
+    if (mouse.x > p0.x && mouse.x < p0.x + size.x &&
+        mouse.y > p0.y && mouse.y < p0.y + size.y)
+    {
+        const float freq = (mouse.x - p0.x) / size.x * nyquist;
+        const float time = (mouse.y - p0.y) / size.y * rows * rowTime;
+        drawList->AddLine({mouse.x, p0.y}, {mouse.x, p0.y + size.y}, IM_COL32(255, 255, 0, 255));
+        snprintf(buf, sizeof(buf), "   %.1f Hz, -%.3f s", freq, time);
+        drawList->AddText(mouse, IM_COL32(255, 255, 0, 255), buf);
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,280 @@
+/**
+ * @file gui_spectrum.cpp
+ * @brief Contains the spectrum analyzer window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.hpp"
+#include "fft.hpp"
+#include "imgui.h"
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+enum class Averaging : int {
+    None = 0,
+    Exponential,
+    PeakHold
+};
+
+struct SpectrumTrace
+{
+    std::vector<float> magnitude; // Volts, peak.
+    std::size_t position = 0;     // Stream position of the last FFT.
+    bool valid = false;
+};
+
+static int fftSizeIndex = 5; // 256 << 5 = 8192
+static int windowType = static_cast<int>(FFTWindow::Hann);
+static int averaging = static_cast<int>(Averaging::None);
+static float averageWeight = 0.2f;
+static bool logFrequency = false;
+static bool logLevel = true;
+static bool showInput = false;
+
+static std::unique_ptr<FFT> fft;
+static std::vector<float> window;
+static float windowGain = 1;
+static std::array<SpectrumTrace, 2> traces;
+
+bool spectrumWantsInput()
+{
+    return showInput;
+}
+
+static void spectrumReset()
+{
+    const std::size_t size = 256u << fftSizeIndex;
+    if (!fft || fft->size() != size)
+        fft = std::make_unique<FFT>(size);
+
+    window = fftMakeWindow(static_cast<FFTWindow>(windowType), size);
+    windowGain = 0;
+    for (const auto w : window)
+        windowGain += w;
+
+    for (auto& t : traces) {
+        t.magnitude.assign(size / 2 + 1, 0.f);
+        t.valid = false;
+    }
+}
+
+/**
+ * Runs one FFT over the newest samples of the stream, if any have arrived,
+ * and folds the result into the trace's average. At most one FFT is done per
+ * trace per frame so the view can never fall behind the stream.
+ */
+static void spectrumUpdate(AnalysisStream stream, SpectrumTrace& trace)
+{
+    static std::vector<float> samples;
+    static std::vector<std::complex<float>> bins;
+
+    const auto size = fft->size();
+    const auto written = analysisWritten(stream);
+    if (written < size || (trace.valid && written == trace.position))
+        return;
+
+    samples.resize(size);
+    bins.resize(size / 2 + 1);
+    if (!analysisRead(stream, written - size, size, samples.data()))
+        return;
+
+    kernels::multiply(samples.data(), window.data(), samples.data(), size);
+    fft->forward(samples.data(), bins.data());
+
+    // Scale to the peak amplitude of a sinusoid; DC has no mirror image.
+    const float scale = 2.f / windowGain;
+    const auto mode = static_cast<Averaging>(averaging);
+    for (std::size_t k = 0; k < bins.size(); ++k) {
+        const float m = std::abs(bins[k]) * (k == 0 ? scale / 2 : scale);
+        auto& avg = trace.magnitude[k];
+
+        if (!trace.valid || mode == Averaging::None)
+            avg = m;
+        else if (mode == Averaging::Exponential)
+            avg += averageWeight * (m - avg);
+        else
+            avg = std::max(avg, m);
+    }
+
+    trace.position = written;
+    trace.valid = true;
+}
+
+static void renderControls()
+{
+    static const char *sizes[] = {"256", "512", "1024", "2048", "4096",
+                                  "8192", "16384", "32768", "65536"};
+    static const char *averagings[] = {"None", "Exponential", "Peak hold"};
+
+    bool reset = false;
+
+    ImGui::SetNextItemWidth(80);
+    reset |= ImGui::Combo("Size", &fftSizeIndex, sizes, IM_ARRAYSIZE(sizes));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(130);
+    reset |= ImGui::Combo("Window", &windowType, fftWindowNames,
+        IM_ARRAYSIZE(fftWindowNames));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(110);
+    reset |= ImGui::Combo("Average", &averaging, averagings,
+        IM_ARRAYSIZE(averagings));
+    if (static_cast<Averaging>(averaging) == Averaging::Exponential) {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80);
+        ImGui::SliderFloat("Weight", &averageWeight, 0.01f, 1.f, "%.2f");
+    }
+
+    ImGui::Checkbox("Log freq.", &logFrequency);
+    ImGui::SameLine();
+    ImGui::Checkbox("dB", &logLevel);
+    ImGui::SameLine();
+    ImGui::Checkbox("Input", &showInput);
+    ImGui::SameLine();
+    reset |= ImGui::Button("Reset");
+
+    if (reset || !fft)
+        spectrumReset();
+}
+
+void spectrumRenderWindow(bool *open)
+{
+    ImGui::SetNextWindowSize({640, 400}, ImGuiCond_FirstUseEver);
+    ImGui::Begin("spectrum", open);
+
+    renderControls();
+
+    const unsigned int rate = analysisSampleRate();
+    spectrumUpdate(AnalysisStream::Output, traces[0]);
+    if (showInput)
+        spectrumUpdate(AnalysisStream::Input, traces[1]);
+
+    auto drawList = ImGui::GetWindowDrawList();
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    const ImVec2 size = ImGui::GetContentRegionAvail();
+    if (size.x < 20 || size.y < 20 || rate == 0) {
+        ImGui::End();
+        return;
+    }
+
+    drawList->AddRectFilled(p0, {p0.x + size.x, p0.y + size.y}, IM_COL32_BLACK);
+
+    const float nyquist = rate / 2.f;
+    const float binWidth = static_cast<float>(rate) / fft->size();
+    const float minFreq = logFrequency ? binWidth : 0.f;
+
+    // Level range: -120 to 0 dBV, or zero to the largest peak shown.
+    float maxLevel = 0.001f;
+    if (!logLevel) {
+        for (const auto& t : traces) {
+            if (t.valid)
+                maxLevel = std::max(maxLevel, *std::max_element(t.magnitude.cbegin(), t.magnitude.cend()));
+        }
+        maxLevel *= 1.1f;
+    }
+
+    const auto xToFreq = [&](float x) {
+        const float f = x / size.x;
+        return logFrequency ? minFreq * std::pow(nyquist / minFreq, f)
+                            : nyquist * f;
+    };
+    const auto freqToX = [&](float freq) {
+        const float f = logFrequency ? std::log(freq / minFreq) / std::log(nyquist / minFreq)
+                                     : freq / nyquist;
+        return p0.x + f * size.x;
+    };
+    const auto levelToY = [&](float v) {
+        const float f = logLevel ? (20 * std::log10(std::max(v, 1e-7f)) + 120) / 120
+                                 : v / maxLevel;
+        return p0.y + size.y * (1 - std::clamp(f, 0.f, 1.f));
+    };
+
+    // Grid and labels.
+    const auto lcGrid = IM_COL32(60, 60, 60, 255);
+    const auto lcText = IM_COL32(180, 180, 180, 255);
+    char buf[32];
+    if (logFrequency) {
+        for (float decade = 1; decade < nyquist; decade *= 10) {
+            for (int m = 1; m < 10; ++m) {
+                const float f = decade * m;
+                if (f < minFreq || f > nyquist)
+                    continue;
+                const float x = freqToX(f);
+                drawList->AddLine({x, p0.y}, {x, p0.y + size.y}, lcGrid);
+                if (m == 1) {
+                    snprintf(buf, sizeof(buf), "%g Hz", f);
+                    drawList->AddText({x + 2, p0.y + size.y - 18}, lcText, buf);
+                }
+            }
+        }
+    } else {
+        for (int i = 1; i < 10; ++i) {
+            const float x = p0.x + size.x * i / 10;
+            drawList->AddLine({x, p0.y}, {x, p0.y + size.y}, lcGrid);
+            snprintf(buf, sizeof(buf), "%.0f Hz", nyquist * i / 10);
+            drawList->AddText({x + 2, p0.y + size.y - 18}, lcText, buf);
+        }
+    }
+    for (int i = 1; i < 6; ++i) {
+        const float y = p0.y + size.y * i / 6;
+        drawList->AddLine({p0.x, y}, {p0.x + size.x, y}, lcGrid);
+        if (logLevel)
+            snprintf(buf, sizeof(buf), "%d dBV", -20 * i);
+        else
+            snprintf(buf, sizeof(buf), "%.3f V", maxLevel * (6 - i) / 6);
+        drawList->AddText({p0.x + 2, y + 1}, lcText, buf);
+    }
+
+    // Each pixel column shows the largest bin it covers.
+    static std::vector<ImVec2> points;
+    const std::array<ImU32, 2> colors {IM_COL32(255, 0, 0, 255), IM_COL32(80, 80, 255, 255)};
+    for (int t = 0; t < (showInput ? 2 : 1); ++t) {
+        const auto& trace = traces[t];
+        if (!trace.valid)
+            continue;
+
+        points.clear();
+        const int columns = static_cast<int>(size.x);
+        for (int x = 0; x < columns; ++x) {
+            const auto first = std::min<std::size_t>(std::lround(xToFreq(x) / binWidth),
+                trace.magnitude.size() - 1);
+            const auto last = std::clamp<std::size_t>(std::lround(xToFreq(x + 1) / binWidth),
+                first + 1, trace.magnitude.size());
+            const float m = *std::max_element(trace.magnitude.cbegin() + first,
+                                              trace.magnitude.cbegin() + last);
+            points.emplace_back(p0.x + x + 0.5f, levelToY(m));
+        }
+
+        drawList->AddPolyline(points.data(), points.size(), colors[t], ImDrawFlags_None, 1.f);
+    }
+
+    const auto mouse = ImGui::GetMousePos();
+    if (mouse.x > p0.x && mouse.x < p0.x + size.x &&
+        mouse.y > p0.y && mouse.y < p0.y + size.y && traces[0].valid)
+    {
+        const float freq = xToFreq(mouse.x - p0.x);
+        const auto bin = std::min<std::size_t>(std::lround(freq / binWidth),
+            traces[0].magnitude.size() - 1);
+        const float m = traces[0].magnitude[bin];
+
+        drawList->AddLine({mouse.x, p0.y}, {mouse.x, p0.y + size.y}, IM_COL32(255, 255, 0, 255));
+        if (logLevel)
+            snprintf(buf, sizeof(buf), "   %.1f Hz, %.1f dBV", bin * binWidth, 20 * std::log10(std::max(m, 1e-7f)));
+        else
+            snprintf(buf, sizeof(buf), "   %.1f Hz, %.4f V", bin * binWidth, m);
+        drawList->AddText(mouse, IM_COL32(255, 255, 0, 255), buf);
+    }
+
+    ImGui::End();
+}
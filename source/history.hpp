@@ -0,0 +1,276 @@
+/**
+ * @file history.hpp
+ * @brief Long, chunked sample history with a multi-resolution min/max summary.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_HISTORY_HPP
+#define STMDSPGUI_HISTORY_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * Keeps the most recent samples of a stream, up to a memory budget, in
+ * fixed-size chunks. Chunks are recycled once the budget is reached, so
+ * memory use stays flat and nothing is ever reallocated or moved.
+ *
+ * Every chunk carries min/max summaries of its blocks of 16, 256 and 4096
+ * samples, plus one of the whole chunk. The summaries are updated as samples
+ * are appended, so the exact min/max of any range costs a few hundred steps
+ * at most, whether it covers ten samples or hours of them.
+ *
+ * Samples are addressed by stream position: the number of samples written
+ * before them since the last reset.
+ */
+template<typename T>
+class SampleHistory
+{
+public:
+    static constexpr std::size_t ChunkBits = 16;
+    static constexpr std::size_t ChunkSize = std::size_t(1) << ChunkBits;
+
+    explicit SampleHistory(std::size_t budgetBytes = 64 << 20) {
+        setBudget(budgetBytes);
+    }
+
+    /**
+     * Limits the memory held for samples and their summaries. At least two
+     * chunks are always kept.
+     */
+    void setBudget(std::size_t bytes) {
+        m_maxChunks = std::max<std::size_t>(2, bytes / sizeof(Chunk));
+        while (m_chunks.size() > m_maxChunks)
+            evict();
+        m_spare.clear();
+    }
+
+    /**
+     * The longest history kept, in samples.
+     */
+    std::size_t capacity() const noexcept {
+        return m_maxChunks * ChunkSize;
+    }
+
+    /**
+     * Discards all samples, keeping their memory for reuse. Positions start
+     * over from zero.
+     */
+    void reset() {
+        while (!m_chunks.empty()) {
+            m_spare.push_back(std::move(m_chunks.front()));
+            m_chunks.pop_front();
+        }
+        m_begin = 0;
+        m_end = 0;
+    }
+
+    // Position of the oldest sample still held.
+    std::size_t begin() const noexcept {
+        return m_begin;
+    }
+
+    // Position one past the newest sample; the total written since reset.
+    std::size_t end() const noexcept {
+        return m_end;
+    }
+
+    template<typename It>
+    void write(It first, It last) {
+        while (first != last) {
+            const auto offset = m_end & (ChunkSize - 1);
+            if (offset == 0)
+                m_chunks.push_back(acquire());
+
+            auto& chunk = *m_chunks.back();
+            const auto n = std::min<std::size_t>(ChunkSize - offset,
+                std::distance(first, last));
+            auto next = first;
+            std::advance(next, n);
+            std::copy(first, next, chunk.samples.begin() + offset);
+            update(chunk, offset, offset + n);
+
+            first = next;
+            m_end += n;
+        }
+    }
+
+    /**
+     * Returns the sample at the given position, which must be held.
+     */
+    T operator[](std::size_t position) const noexcept {
+        return chunkAt(position).samples[position & (ChunkSize - 1)];
+    }
+
+    /**
+     * Returns the longest contiguous run of samples starting at first and
+     * ending no later than last. Empty if first is not held.
+     */
+    std::span<const T> contiguous(std::size_t first, std::size_t last) const noexcept {
+        last = std::min(last, m_end);
+        if (first < m_begin || first >= last)
+            return {};
+
+        const auto offset = first & (ChunkSize - 1);
+        const auto n = std::min(last - first, ChunkSize - offset);
+        return {chunkAt(first).samples.data() + offset, n};
+    }
+
+    /**
+     * Appends the held samples in [first, last) to out.
+     */
+    void copy(std::size_t first, std::size_t last, std::vector<T>& out) const {
+        first = std::max(first, m_begin);
+        for (auto s = contiguous(first, last); !s.empty(); s = contiguous(first, last)) {
+            out.insert(out.end(), s.begin(), s.end());
+            first += s.size();
+        }
+    }
+
+    /**
+     * Finds the smallest and largest samples in the position range
+     * [first, last), clamped to what is held. An empty range gives the
+     * sample at first, or the nearest held one.
+     */
+    std::pair<T, T> minmax(std::size_t first, std::size_t last) const noexcept {
+        if (m_end == m_begin)
+            return {};
+
+        first = std::clamp(first, m_begin, m_end - 1);
+        last = std::min(last, m_end);
+        if (first >= last)
+            return {(*this)[first], (*this)[first]};
+
+        std::pair<T, T> result ((*this)[first], (*this)[first]);
+        while (first < last) {
+            const auto& chunk = chunkAt(first);
+            const auto offset = first & (ChunkSize - 1);
+            const auto n = std::min(last - first, ChunkSize - offset);
+            chunkMinmax(chunk, offset, offset + n, result);
+            first += n;
+        }
+
+        return result;
+    }
+
+private:
+    // Each summary level covers blocks 16 times larger than the one below.
+    static constexpr std::size_t FanoutBits = 4;
+    static constexpr std::size_t Fanout = std::size_t(1) << FanoutBits;
+    static constexpr std::size_t Levels = ChunkBits / FanoutBits;
+
+    // Where each level's summaries start in Chunk::summary.
+    static constexpr std::array<std::size_t, Levels + 1> LevelOffsets = [] {
+        std::array<std::size_t, Levels + 1> offsets {};
+        for (std::size_t i = 1; i <= Levels; ++i)
+            offsets[i] = offsets[i - 1] + (ChunkSize >> (FanoutBits * i));
+        return offsets;
+    }();
+
+    struct Chunk {
+        std::array<T, ChunkSize> samples;
+        std::array<std::pair<T, T>, LevelOffsets[Levels]> summary;
+    };
+
+    std::deque<std::unique_ptr<Chunk>> m_chunks;
+    std::vector<std::unique_ptr<Chunk>> m_spare;
+    std::size_t m_maxChunks = 2;
+    std::size_t m_begin = 0;
+    std::size_t m_end = 0;
+
+    const Chunk& chunkAt(std::size_t position) const noexcept {
+        return *m_chunks[(position >> ChunkBits) - (m_begin >> ChunkBits)];
+    }
+
+    void evict() {
+        m_spare.push_back(std::move(m_chunks.front()));
+        m_chunks.pop_front();
+        m_begin += ChunkSize;
+    }
+
+    std::unique_ptr<Chunk> acquire() {
+        if (m_chunks.size() >= m_maxChunks)
+            evict();
+        if (m_spare.empty())
+            return std::make_unique_for_overwrite<Chunk>();
+
+        auto chunk = std::move(m_spare.back());
+        m_spare.pop_back();
+        return chunk;
+    }
+
+    // Level zero is the samples themselves.
+    static std::pair<T, T> node(const Chunk& chunk, std::size_t level, std::size_t index) noexcept {
+        if (level == 0)
+            return {chunk.samples[index], chunk.samples[index]};
+        else
+            return chunk.summary[LevelOffsets[level - 1] + index];
+    }
+
+    // Recomputes the summaries covering the chunk's samples in [first, last).
+    // Only samples before last have been written, so blocks are summarized
+    // up to there.
+    static void update(Chunk& chunk, std::size_t first, std::size_t last) {
+        for (std::size_t level = 0; level < Levels; ++level) {
+            const auto childCount = last;
+            first >>= FanoutBits;
+            last = ((last - 1) >> FanoutBits) + 1;
+
+            for (auto i = first; i < last; ++i) {
+                auto mm = node(chunk, level, i * Fanout);
+                const auto end = std::min((i + 1) * Fanout, childCount);
+                for (auto j = i * Fanout + 1; j < end; ++j) {
+                    const auto c = node(chunk, level, j);
+                    mm.first = std::min(mm.first, c.first);
+                    mm.second = std::max(mm.second, c.second);
+                }
+                chunk.summary[LevelOffsets[level] + i] = mm;
+            }
+        }
+    }
+
+    // Merges the min/max of the chunk's samples [first, last) into result.
+    // Unaligned ends are taken a level at a time until what remains lines up
+    // with the blocks of the next level.
+    static void chunkMinmax(const Chunk& chunk, std::size_t first, std::size_t last,
+        std::pair<T, T>& result) noexcept
+    {
+        const auto merge = [&result](const std::pair<T, T>& mm) {
+            result.first = std::min(result.first, mm.first);
+            result.second = std::max(result.second, mm.second);
+        };
+
+        for (std::size_t level = 0; first < last; ++level) {
+            const auto shift = FanoutBits * level;
+            if (level == Levels) {
+                merge(node(chunk, level, 0));
+                break;
+            }
+
+            const auto unit = std::size_t(1) << shift;
+            const auto mask = (unit << FanoutBits) - 1;
+            while (first < last && (first & mask) != 0) {
+                merge(node(chunk, level, first >> shift));
+                first += unit;
+            }
+            while (first < last && (last & mask) != 0) {
+                last -= unit;
+                merge(node(chunk, level, last >> shift));
+            }
+        }
+    }
+};
+
+#endif // STMDSPGUI_HISTORY_HPP
@@ -0,0 +1,558 @@
+/**
+ * @file kernels.cpp
+ * @brief Vectorized sample processing kernels, chosen for the host CPU.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STMDSP_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace kernels
+{
+    // The moments are accumulated in this many interleaved partial sums.
+    constexpr std::size_t MomentLanes = 8;
+
+    struct Table {
+        Variant variant;
+        void (*samplesToVolts)(const uint16_t *, float *, std::size_t);
+        void (*pcmToDac)(const int16_t *, uint16_t *, std::size_t);
+        void (*unitToDac)(const double *, uint16_t *, std::size_t);
+        void (*multiply)(const float *, const float *, float *, std::size_t);
+        void (*multiplyAdd)(const float *, float, float *, std::size_t);
+        void (*moments)(const float *, std::size_t, float *, float *, float *, float *);
+        uint32_t (*packDeltas)(const uint16_t *, std::size_t, int32_t, uint32_t *);
+    };
+
+    static inline float toVolts(uint16_t s) {
+        return s / 4095.f * 6.6f - 3.3f;
+    }
+
+    static inline uint16_t toDac(int16_t s) {
+        return static_cast<uint16_t>(s / 16 + 2048);
+    }
+
+    static inline uint16_t unitToDac(double v) {
+        const auto s = std::clamp(v, -1., 1.) * 2048. + 2048.;
+        return static_cast<uint16_t>(std::min(s, 4095.));
+    }
+
+    static inline uint32_t zigzag(int32_t n) {
+        return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+    }
+
+    /**
+     * Finishes the moments from the lanes' partial results, taking the
+     * samples left over after the last whole group of lanes in lane zero.
+     */
+    static void finishMoments(const float *x, std::size_t i, std::size_t n,
+        float *s, float *q, float *lo, float *hi, Moments& m)
+    {
+        for (; i < n; ++i) {
+            s[0] += x[i];
+            q[0] += x[i] * x[i];
+            lo[0] = std::min(lo[0], x[i]);
+            hi[0] = std::max(hi[0], x[i]);
+        }
+
+        m.sum = m.sumSquares = 0;
+        m.min = lo[0];
+        m.max = hi[0];
+        for (std::size_t j = 0; j < MomentLanes; ++j) {
+            m.sum += s[j];
+            m.sumSquares += q[j];
+            m.min = std::min(m.min, lo[j]);
+            m.max = std::max(m.max, hi[j]);
+        }
+    }
+
+    namespace scalar
+    {
+        static void samplesToVolts(const uint16_t *in, float *out, std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = toVolts(in[i]);
+        }
+
+        static void pcmToDac(const int16_t *in, uint16_t *out, std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = toDac(in[i]);
+        }
+
+        static void unitToDac(const double *in, uint16_t *out, std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = kernels::unitToDac(in[i]);
+        }
+
+        static void multiply(const float *a, const float *b, float *out, std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = a[i] * b[i];
+        }
+
+        static void multiplyAdd(const float *a, float scale, float *out, std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] += a[i] * scale;
+        }
+
+        static void moments(const float *x, std::size_t n, float *s, float *q,
+            float *lo, float *hi)
+        {
+            for (std::size_t j = 0; j < MomentLanes; ++j) {
+                s[j] = q[j] = 0;
+                lo[j] = hi[j] = x[0];
+            }
+
+            std::size_t i = 0;
+            for (; i + MomentLanes <= n; i += MomentLanes) {
+                for (std::size_t j = 0; j < MomentLanes; ++j) {
+                    const float v = x[i + j];
+                    s[j] += v;
+                    q[j] += v * v;
+                    lo[j] = v < lo[j] ? v : lo[j];
+                    hi[j] = v > hi[j] ? v : hi[j];
+                }
+            }
+        }
+
+        static uint32_t packDeltas(const uint16_t *in, std::size_t count,
+            int32_t prev, uint32_t *out)
+        {
+            uint32_t bits = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                out[i] = zigzag(static_cast<int32_t>(in[i]) - prev);
+                prev = in[i];
+                bits |= out[i];
+            }
+            return bits;
+        }
+
+        static const Table table {
+            Variant::Scalar, samplesToVolts, pcmToDac, unitToDac, multiply,
+            multiplyAdd, moments, packDeltas
+        };
+    }
+
+#ifdef STMDSP_KERNELS_X86
+    namespace sse2
+    {
+        __attribute__((target("sse2")))
+        static inline __m128 toVolts(__m128i v)
+        {
+            const auto f = _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(4095.f));
+            return _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.6f)), _mm_set1_ps(3.3f));
+        }
+
+        // Operand order matches std::clamp and std::min, down to NaNs.
+        __attribute__((target("sse2")))
+        static inline __m128i unitToDac(__m128d v)
+        {
+            v = _mm_max_pd(_mm_set1_pd(-1.), _mm_min_pd(_mm_set1_pd(1.), v));
+            v = _mm_add_pd(_mm_mul_pd(v, _mm_set1_pd(2048.)), _mm_set1_pd(2048.));
+            return _mm_cvttpd_epi32(_mm_min_pd(_mm_set1_pd(4095.), v));
+        }
+
+        __attribute__((target("sse2")))
+        static inline __m128i zigzag(__m128i d)
+        {
+            return _mm_xor_si128(_mm_slli_epi32(d, 1), _mm_srai_epi32(d, 31));
+        }
+
+        __attribute__((target("sse2")))
+        static void samplesToVolts(const uint16_t *in, float *out, std::size_t count)
+        {
+            const auto zero = _mm_setzero_si128();
+
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+                _mm_storeu_ps(out + i, toVolts(_mm_unpacklo_epi16(v, zero)));
+                _mm_storeu_ps(out + i + 4, toVolts(_mm_unpackhi_epi16(v, zero)));
+            }
+            for (; i < count; ++i)
+                out[i] = kernels::toVolts(in[i]);
+        }
+
+        __attribute__((target("sse2")))
+        static void pcmToDac(const int16_t *in, uint16_t *out, std::size_t count)
+        {
+            const auto bias = _mm_set1_epi16(15);
+            const auto mid = _mm_set1_epi16(2048);
+
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+                // Division truncates toward zero, so negatives are biased
+                // before the arithmetic shift.
+                const auto r = _mm_srai_epi16(_mm_add_epi16(v,
+                    _mm_and_si128(_mm_srai_epi16(v, 15), bias)), 4);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_add_epi16(r, mid));
+            }
+            for (; i < count; ++i)
+                out[i] = toDac(in[i]);
+        }
+
+        __attribute__((target("sse2")))
+        static void unitToDac(const double *in, uint16_t *out, std::size_t count)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const auto a = _mm_unpacklo_epi64(unitToDac(_mm_loadu_pd(in + i)),
+                    unitToDac(_mm_loadu_pd(in + i + 2)));
+                const auto b = _mm_unpacklo_epi64(unitToDac(_mm_loadu_pd(in + i + 4)),
+                    unitToDac(_mm_loadu_pd(in + i + 6)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(a, b));
+            }
+            for (; i < count; ++i)
+                out[i] = kernels::unitToDac(in[i]);
+        }
+
+        __attribute__((target("sse2")))
+        static void multiply(const float *a, const float *b, float *out, std::size_t count)
+        {
+            std::size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            for (; i < count; ++i)
+                out[i] = a[i] * b[i];
+        }
+
+        __attribute__((target("sse2")))
+        static void multiplyAdd(const float *a, float scale, float *out, std::size_t count)
+        {
+            const auto s = _mm_set1_ps(scale);
+
+            std::size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+                    _mm_mul_ps(_mm_loadu_ps(a + i), s)));
+            }
+            for (; i < count; ++i)
+                out[i] += a[i] * scale;
+        }
+
+        // Lanes 0-3 and 4-7 are each a vector.
+        __attribute__((target("sse2")))
+        static void moments(const float *x, std::size_t n, float *s, float *q,
+            float *lo, float *hi)
+        {
+            auto s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+            auto q0 = _mm_setzero_ps(), q1 = _mm_setzero_ps();
+            auto lo0 = _mm_set1_ps(x[0]), lo1 = lo0;
+            auto hi0 = lo0, hi1 = lo0;
+
+            for (std::size_t i = 0; i + MomentLanes <= n; i += MomentLanes) {
+                const auto v0 = _mm_loadu_ps(x + i);
+                const auto v1 = _mm_loadu_ps(x + i + 4);
+                s0 = _mm_add_ps(s0, v0);
+                s1 = _mm_add_ps(s1, v1);
+                q0 = _mm_add_ps(q0, _mm_mul_ps(v0, v0));
+                q1 = _mm_add_ps(q1, _mm_mul_ps(v1, v1));
+                lo0 = _mm_min_ps(v0, lo0);
+                lo1 = _mm_min_ps(v1, lo1);
+                hi0 = _mm_max_ps(v0, hi0);
+                hi1 = _mm_max_ps(v1, hi1);
+            }
+
+            _mm_storeu_ps(s, s0);
+            _mm_storeu_ps(s + 4, s1);
+            _mm_storeu_ps(q, q0);
+            _mm_storeu_ps(q + 4, q1);
+            _mm_storeu_ps(lo, lo0);
+            _mm_storeu_ps(lo + 4, lo1);
+            _mm_storeu_ps(hi, hi0);
+            _mm_storeu_ps(hi + 4, hi1);
+        }
+
+        __attribute__((target("sse2")))
+        static uint32_t packDeltas(const uint16_t *in, std::size_t count,
+            int32_t prev, uint32_t *out)
+        {
+            if (count == 0)
+                return 0;
+
+            // The first delta is from prev; the rest are from the sample
+            // before, read as a second, overlapping load.
+            uint32_t bits = out[0] = kernels::zigzag(static_cast<int32_t>(in[0]) - prev);
+            const auto zero = _mm_setzero_si128();
+            auto acc = _mm_setzero_si128();
+
+            std::size_t i = 1;
+            for (; i + 8 <= count; i += 8) {
+                const auto cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+                const auto last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i - 1));
+                const auto lo = zigzag(_mm_sub_epi32(_mm_unpacklo_epi16(cur, zero),
+                    _mm_unpacklo_epi16(last, zero)));
+                const auto hi = zigzag(_mm_sub_epi32(_mm_unpackhi_epi16(cur, zero),
+                    _mm_unpackhi_epi16(last, zero)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), lo);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 4), hi);
+                acc = _mm_or_si128(acc, _mm_or_si128(lo, hi));
+            }
+
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+            bits |= lanes[0] | lanes[1] | lanes[2] | lanes[3];
+            return bits | scalar::packDeltas(in + i, count - i, in[i - 1], out + i);
+        }
+
+        static const Table table {
+            Variant::SSE2, samplesToVolts, pcmToDac, unitToDac, multiply,
+            multiplyAdd, moments, packDeltas
+        };
+    }
+
+    namespace avx2
+    {
+        __attribute__((target("avx2")))
+        static inline __m128i unitToDac(__m256d v)
+        {
+            v = _mm256_max_pd(_mm256_set1_pd(-1.), _mm256_min_pd(_mm256_set1_pd(1.), v));
+            v = _mm256_add_pd(_mm256_mul_pd(v, _mm256_set1_pd(2048.)), _mm256_set1_pd(2048.));
+            return _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_set1_pd(4095.), v));
+        }
+
+        __attribute__((target("avx2")))
+        static void samplesToVolts(const uint16_t *in, float *out, std::size_t count)
+        {
+            const auto full = _mm256_set1_ps(4095.f);
+            const auto span = _mm256_set1_ps(6.6f);
+            const auto offset = _mm256_set1_ps(3.3f);
+
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const auto v = _mm256_cvtepu16_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+                const auto f = _mm256_div_ps(_mm256_cvtepi32_ps(v), full);
+                _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_mul_ps(f, span), offset));
+            }
+            for (; i < count; ++i)
+                out[i] = toVolts(in[i]);
+        }
+
+        __attribute__((target("avx2")))
+        static void pcmToDac(const int16_t *in, uint16_t *out, std::size_t count)
+        {
+            const auto bias = _mm256_set1_epi16(15);
+            const auto mid = _mm256_set1_epi16(2048);
+
+            std::size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+                const auto r = _mm256_srai_epi16(_mm256_add_epi16(v,
+                    _mm256_and_si256(_mm256_srai_epi16(v, 15), bias)), 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_add_epi16(r, mid));
+            }
+            for (; i < count; ++i)
+                out[i] = toDac(in[i]);
+        }
+
+        __attribute__((target("avx2")))
+        static void unitToDac(const double *in, uint16_t *out, std::size_t count)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const auto a = unitToDac(_mm256_loadu_pd(in + i));
+                const auto b = unitToDac(_mm256_loadu_pd(in + i + 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(a, b));
+            }
+            for (; i < count; ++i)
+                out[i] = kernels::unitToDac(in[i]);
+        }
+
+        __attribute__((target("avx2")))
+        static void multiply(const float *a, const float *b, float *out, std::size_t count)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                _mm256_storeu_ps(out + i,
+                    _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+            }
+            for (; i < count; ++i)
+                out[i] = a[i] * b[i];
+        }
+
+        // Multiplies and adds separately, as fused they would round differently.
+        __attribute__((target("avx2")))
+        static void multiplyAdd(const float *a, float scale, float *out, std::size_t count)
+        {
+            const auto s = _mm256_set1_ps(scale);
+
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i),
+                    _mm256_mul_ps(_mm256_loadu_ps(a + i), s)));
+            }
+            for (; i < count; ++i)
+                out[i] += a[i] * scale;
+        }
+
+        // All eight lanes in one vector.
+        __attribute__((target("avx2")))
+        static void moments(const float *x, std::size_t n, float *s, float *q,
+            float *lo, float *hi)
+        {
+            auto vs = _mm256_setzero_ps();
+            auto vq = _mm256_setzero_ps();
+            auto vlo = _mm256_set1_ps(x[0]);
+            auto vhi = vlo;
+
+            for (std::size_t i = 0; i + MomentLanes <= n; i += MomentLanes) {
+                const auto v = _mm256_loadu_ps(x + i);
+                vs = _mm256_add_ps(vs, v);
+                vq = _mm256_add_ps(vq, _mm256_mul_ps(v, v));
+                vlo = _mm256_min_ps(v, vlo);
+                vhi = _mm256_max_ps(v, vhi);
+            }
+
+            _mm256_storeu_ps(s, vs);
+            _mm256_storeu_ps(q, vq);
+            _mm256_storeu_ps(lo, vlo);
+            _mm256_storeu_ps(hi, vhi);
+        }
+
+        __attribute__((target("avx2")))
+        static uint32_t packDeltas(const uint16_t *in, std::size_t count,
+            int32_t prev, uint32_t *out)
+        {
+            if (count == 0)
+                return 0;
+
+            uint32_t bits = out[0] = kernels::zigzag(static_cast<int32_t>(in[0]) - prev);
+            auto acc = _mm256_setzero_si256();
+
+            std::size_t i = 1;
+            for (; i + 8 <= count; i += 8) {
+                const auto cur = _mm256_cvtepu16_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+                const auto last = _mm256_cvtepu16_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i - 1)));
+                const auto d = _mm256_sub_epi32(cur, last);
+                const auto z = _mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), z);
+                acc = _mm256_or_si256(acc, z);
+            }
+
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+            for (const auto l : lanes)
+                bits |= l;
+            return bits | scalar::packDeltas(in + i, count - i, in[i - 1], out + i);
+        }
+
+        static const Table table {
+            Variant::AVX2, samplesToVolts, pcmToDac, unitToDac, multiply,
+            multiplyAdd, moments, packDeltas
+        };
+    }
+#endif // STMDSP_KERNELS_X86
+
+    static const Table *tableOf(Variant v)
+    {
+        switch (v) {
+        case Variant::Scalar:
+            return &scalar::table;
+#ifdef STMDSP_KERNELS_X86
+        case Variant::SSE2:
+            return __builtin_cpu_supports("sse2") ? &sse2::table : nullptr;
+        case Variant::AVX2:
+            return __builtin_cpu_supports("avx2") ? &avx2::table : nullptr;
+#endif
+        default:
+            return nullptr;
+        }
+    }
+
+    static std::atomic<const Table *> active = nullptr;
+
+    static const Table& table()
+    {
+        auto t = active.load(std::memory_order_acquire);
+        if (t == nullptr) {
+            for (const auto v : {Variant::AVX2, Variant::SSE2, Variant::Scalar}) {
+                if ((t = tableOf(v)) != nullptr)
+                    break;
+            }
+            active.store(t, std::memory_order_release);
+        }
+        return *t;
+    }
+
+    void samplesToVolts(const uint16_t *in, float *out, std::size_t count)
+    {
+        table().samplesToVolts(in, out, count);
+    }
+
+    void pcmToDac(const int16_t *in, uint16_t *out, std::size_t count)
+    {
+        table().pcmToDac(in, out, count);
+    }
+
+    void unitToDac(const double *in, uint16_t *out, std::size_t count)
+    {
+        table().unitToDac(in, out, count);
+    }
+
+    void multiply(const float *a, const float *b, float *out, std::size_t count)
+    {
+        table().multiply(a, b, out, count);
+    }
+
+    void multiplyAdd(const float *a, float scale, float *out, std::size_t count)
+    {
+        table().multiplyAdd(a, scale, out, count);
+    }
+
+    Moments moments(const float *in, std::size_t count)
+    {
+        Moments m;
+        if (count == 0)
+            return m;
+
+        float s[MomentLanes], q[MomentLanes], lo[MomentLanes], hi[MomentLanes];
+        table().moments(in, count, s, q, lo, hi);
+        finishMoments(in, count - count % MomentLanes, count, s, q, lo, hi, m);
+        return m;
+    }
+
+    uint32_t packDeltas(const uint16_t *in, std::size_t count, int32_t prev,
+        uint32_t *out)
+    {
+        return table().packDeltas(in, count, prev, out);
+    }
+
+    Variant variant()
+    {
+        return table().variant;
+    }
+
+    const char *variantName(Variant v)
+    {
+        static const char *names[] = {"scalar", "SSE2", "AVX2"};
+        return names[static_cast<int>(v)];
+    }
+
+    bool select(Variant v)
+    {
+        if (const auto t = tableOf(v); t != nullptr) {
+            active.store(t, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file kernels.hpp
+ * @brief Vectorized sample processing kernels, chosen for the host CPU.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_KERNELS_HPP
+#define STMDSPGUI_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The per-sample loops of the host side. Each kernel has a scalar reference
+ * and, on x86, SSE2 and AVX2 variants; the best one the CPU supports is
+ * picked the first time a kernel is called.
+ *
+ * Every variant gives bit-for-bit the same results as the scalar one: the
+ * vector code performs the same operations in the same order, and keeps
+ * the same number of partial sums.
+ */
+namespace kernels
+{
+    enum class Variant : int {
+        Scalar = 0,
+        SSE2,
+        AVX2
+    };
+
+    struct Moments {
+        float sum = 0;
+        float sumSquares = 0;
+        float min = 0;
+        float max = 0;
+    };
+
+    // ADC samples to volts, as s / 4095 * 6.6 - 3.3.
+    void samplesToVolts(const uint16_t *in, float *out, std::size_t count);
+
+    // Signed 16-bit PCM to DAC samples, as s / 16 + 2048.
+    void pcmToDac(const int16_t *in, uint16_t *out, std::size_t count);
+
+    // Values from -1 to 1 to DAC samples; values out of range are clamped.
+    void unitToDac(const double *in, uint16_t *out, std::size_t count);
+
+    // out[i] = a[i] * b[i]. out may be a.
+    void multiply(const float *a, const float *b, float *out, std::size_t count);
+
+    // out[i] += a[i] * scale, as in each tap of an FIR filter.
+    void multiplyAdd(const float *a, float scale, float *out, std::size_t count);
+
+    // Sum, sum of squares, min and max; all zero if count is zero.
+    Moments moments(const float *in, std::size_t count);
+
+    /**
+     * Zigzag-encodes the differences between consecutive samples, starting
+     * from prev, for the capture file's packed blocks.
+     * @return All of the encoded values or'd together.
+     */
+    uint32_t packDeltas(const uint16_t *in, std::size_t count, int32_t prev,
+        uint32_t *out);
+
+    // The variant in use.
+    Variant variant();
+    const char *variantName(Variant v);
+
+    /**
+     * Switches to the given variant, for comparing them.
+     * @return False, leaving the variant as it was, if the CPU lacks it.
+     */
+    bool select(Variant v);
+}
+
+#endif // STMDSPGUI_KERNELS_HPP
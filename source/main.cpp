@@ -16,14 +16,18 @@
 #include "gui_help.hpp"
 #include "logview.h"
 #include "main.hpp"
+#include "runtime.hpp"
 #include "stmdsp.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <iostream>
 #include <string>
 #include <thread>
 
+void analysisRenderMenu();
+void analysisRenderWindows();
 void codeEditorInit();
 void codeRenderMenu();
 void codeRenderToolbar();
@@ -35,8 +39,12 @@ void deviceRenderWidgets();
 void fileRenderMenu();
 void fileRenderDialog();
 void fileInit();
+void processingRenderWindow();
+void sequenceRenderWindow();
+void sequenceShutdown();
+bool deviceIsStreaming();
 bool guiInitialize();
-bool guiHandleEvents();
+bool guiHandleEvents(int timeout, bool& input);
 void guiShutdown();
 void guiRender();
 
@@ -65,19 +73,37 @@ int main(int, char **)
 
     renderWindow<true>();
 
+    // Frames are rendered at up to 60 FPS while samples are streaming or the
+    // user is interacting. Otherwise the loop sleeps until an event or a
+    // guiWake() arrives, waking a few times a second so that the editor's
+    // cursor keeps blinking.
+    constexpr int IdleTimeout = 400; // milliseconds
+    // ImGui needs a couple of frames after an input to settle hover states
+    // and the like.
+    constexpr int SettleFrames = 3;
+
+    int settle = SettleFrames;
     while (1) {
         constexpr std::chrono::duration<double> fpsDelay (1. / 60.);
         const auto endTime = std::chrono::steady_clock::now() + fpsDelay;
 
-        const bool isDone = guiHandleEvents();
+        const bool animating = settle > 0 || deviceIsStreaming();
+        bool input;
+        const bool isDone = guiHandleEvents(animating ? 0 : IdleTimeout, input);
         if (!isDone) {
+            settle = input ? SettleFrames : std::max(settle - 1, 0);
             renderWindow();
-            std::this_thread::sleep_until(endTime);
+            if (animating)
+                std::this_thread::sleep_until(endTime);
         } else {
             break;
         }
     }
 
+    // Background tasks stop before anything they use goes away; a running
+    // sequence still drives the device, so it finishes first.
+    sequenceShutdown();
+    runtime().shutdown();
     guiShutdown();
     return 0;
 }
@@ -85,6 +111,7 @@ int main(int, char **)
 void log(const std::string& str)
 {
     logView.AddLog(str);
+    guiWake();
 }
 
 template<bool first>
@@ -99,6 +126,7 @@ void renderWindow()
         fileRenderMenu();
         deviceRenderMenu();
         codeRenderMenu();
+        analysisRenderMenu();
 	helpRenderMenu();
 
         ImGui::EndMainMenuBar();
@@ -141,6 +169,9 @@ void renderWindow()
     ImGui::PopFont();
 
     deviceRenderDraw();
+    analysisRenderWindows();
+    processingRenderWindow();
+    sequenceRenderWindow();
 
     // Draw everything to the screen.
     guiRender();
@@ -16,5 +16,10 @@
 
 void log(const std::string& str);
 
+/**
+ * Asks the main loop for a new frame; safe to call from any thread.
+ */
+void guiWake();
+
 #endif // STMDSPGUI_MAIN_HPP
 
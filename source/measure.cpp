@@ -0,0 +1,232 @@
+/**
+ * @file measure.cpp
+ * @brief Streaming signal measurements for the measurements panel.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "measure.hpp"
+#include "fft.hpp"
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+void Measurement::configure(std::size_t blockSize, std::size_t blockCount)
+{
+    m_blockSize = std::max<std::size_t>(blockSize, 1);
+    m_blockCount = std::max<std::size_t>(blockCount, 1);
+    reset();
+}
+
+void Measurement::reset()
+{
+    m_blocks.clear();
+    m_current = Block();
+    m_position = 0;
+    m_level = 0;
+    m_hysteresis = 0;
+    m_armed = false;
+}
+
+void Measurement::process(const float *samples, std::size_t count)
+{
+    while (count > 0) {
+        const auto n = std::min(count, m_blockSize - m_current.count);
+        processBlock(samples, n);
+        if (m_current.count == m_blockSize)
+            finishBlock();
+
+        samples += n;
+        count -= n;
+    }
+}
+
+void Measurement::processBlock(const float *samples, std::size_t count)
+{
+    auto& b = m_current;
+
+    const auto m = kernels::moments(samples, count);
+    b.sum += m.sum;
+    b.sumSquares += m.sumSquares;
+    b.min = b.count == 0 ? m.min : std::min(b.min, m.min);
+    b.max = b.count == 0 ? m.max : std::max(b.max, m.max);
+    b.count += count;
+
+    constexpr float scale = HistogramBins / (HistogramMax - HistogramMin);
+    for (std::size_t i = 0; i < count; ++i) {
+        const int bin = static_cast<int>((samples[i] - HistogramMin) * scale);
+        ++b.histogram[std::clamp<int>(bin, 0, HistogramBins - 1)];
+    }
+
+    // Rising crossings of the level, each only after the signal has fallen
+    // below the hysteresis band.
+    for (std::size_t i = 0; i < count; ++i) {
+        const float v = samples[i];
+        if (v < m_level - m_hysteresis) {
+            m_armed = true;
+        } else if (m_armed && v >= m_level && m_last < m_level) {
+            const double t = (m_level - m_last) / (v - m_last);
+            const double position = static_cast<double>(m_position + i) - 1 + t;
+            if (b.crossings == 0)
+                b.firstCrossing = position;
+            b.lastCrossing = position;
+            ++b.crossings;
+            m_armed = false;
+        }
+        m_last = v;
+    }
+
+    m_position += count;
+}
+
+void Measurement::finishBlock()
+{
+    m_blocks.push_back(m_current);
+    while (m_blocks.size() > m_blockCount)
+        m_blocks.pop_front();
+    m_current = Block();
+
+    // Follow the signal: cross at its mean, ignoring ripple under a tenth
+    // of its swing.
+    double sum = 0;
+    std::size_t count = 0;
+    float min = m_blocks.front().min, max = m_blocks.front().max;
+    for (const auto& b : m_blocks) {
+        sum += b.sum;
+        count += b.count;
+        min = std::min(min, b.min);
+        max = std::max(max, b.max);
+    }
+    m_level = sum / count;
+    m_hysteresis = (max - min) * 0.1f;
+}
+
+Measurement::Result Measurement::result(unsigned int sampleRate) const
+{
+    Result r;
+
+    double sum = 0, sumSquares = 0;
+    std::size_t crossings = 0;
+    double firstCrossing = 0, lastCrossing = 0;
+    std::array<std::size_t, HistogramBins> histogram {};
+
+    const auto add = [&](const Block& b) {
+        if (b.count == 0)
+            return;
+
+        r.min = r.count == 0 ? b.min : std::min(r.min, b.min);
+        r.max = r.count == 0 ? b.max : std::max(r.max, b.max);
+        r.count += b.count;
+        sum += b.sum;
+        sumSquares += b.sumSquares;
+        for (std::size_t i = 0; i < HistogramBins; ++i)
+            histogram[i] += b.histogram[i];
+
+        if (b.crossings > 0) {
+            if (crossings == 0)
+                firstCrossing = b.firstCrossing;
+            lastCrossing = b.lastCrossing;
+            crossings += b.crossings;
+        }
+    };
+
+    for (const auto& b : m_blocks)
+        add(b);
+    add(m_current);
+
+    if (r.count == 0)
+        return r;
+
+    r.mean = sum / r.count;
+    const double meanSquare = sumSquares / r.count;
+    r.rms = std::sqrt(meanSquare);
+    r.acRms = std::sqrt(std::max(0., meanSquare - static_cast<double>(r.mean) * r.mean));
+    r.crest = r.rms > 0 ? std::max(std::abs(r.min), std::abs(r.max)) / r.rms : 0;
+
+    if (crossings > 1 && lastCrossing > firstCrossing)
+        r.frequency = (crossings - 1) * sampleRate / (lastCrossing - firstCrossing);
+
+    for (std::size_t i = 0; i < HistogramBins; ++i)
+        r.histogram[i] = static_cast<float>(histogram[i]) / r.count;
+
+    return r;
+}
+
+float autocorrelationFrequency(const float *samples, std::size_t count,
+    FFT& fft, unsigned int sampleRate)
+{
+    // Per thread, since the streams may be measured in parallel.
+    static thread_local std::vector<float> buffer;
+    static thread_local std::vector<std::complex<float>> bins;
+
+    const auto size = fft.size();
+    count = std::min(count, size / 2);
+    if (count < 4 || sampleRate == 0)
+        return 0;
+
+    // Zero-padding to twice the length keeps the correlation from wrapping.
+    double mean = 0;
+    for (std::size_t i = 0; i < count; ++i)
+        mean += samples[i];
+    mean /= count;
+
+    buffer.assign(size, 0.f);
+    bins.resize(size / 2 + 1);
+    for (std::size_t i = 0; i < count; ++i)
+        buffer[i] = samples[i] - mean;
+    fft.forward(buffer.data(), bins.data());
+
+    // The power spectrum is real and even, so its forward transform is the
+    // (scaled) inverse transform: the autocorrelation.
+    for (std::size_t k = 0; k <= size / 2; ++k) {
+        const float p = std::norm(bins[k]);
+        buffer[k] = p;
+        if (k > 0 && k < size / 2)
+            buffer[size - k] = p;
+    }
+    fft.forward(buffer.data(), bins.data());
+
+    // Unbiased: each lag is averaged over the samples that overlap at it.
+    const auto r = [&](std::size_t lag) { return bins[lag].real() / (count - lag); };
+    const float r0 = r(0);
+    if (r0 <= 0)
+        return 0;
+
+    // Lags past half the samples overlap too little to trust.
+    const std::size_t maxLag = count / 2;
+    std::size_t first = 1;
+    while (first < maxLag && r(first) > 0)
+        ++first;
+
+    float highest = 0;
+    for (auto lag = first; lag < maxLag; ++lag)
+        highest = std::max(highest, r(lag));
+    if (highest < 0.3f * r0)
+        return 0;
+
+    // Multiples of the period peak nearly as high (or higher, when the
+    // period is not a whole number of samples), so take the first peak that
+    // comes close to the highest.
+    std::size_t peak = 0;
+    for (auto lag = std::max<std::size_t>(first, 1); lag + 1 < maxLag; ++lag) {
+        if (r(lag) >= 0.9f * highest && r(lag) >= r(lag - 1) && r(lag) >= r(lag + 1)) {
+            peak = lag;
+            break;
+        }
+    }
+    if (peak == 0)
+        return 0;
+
+    // Parabolic interpolation between the neighbouring lags.
+    const float a = r(peak - 1), b = r(peak), c = r(peak + 1);
+    const float denom = a - 2 * b + c;
+    const float offset = denom != 0 ? 0.5f * (a - c) / denom : 0.f;
+    return sampleRate / (peak + offset);
+}
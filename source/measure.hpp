@@ -0,0 +1,107 @@
+/**
+ * @file measure.hpp
+ * @brief Streaming signal measurements for the measurements panel.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_MEASURE_HPP
+#define STMDSPGUI_MEASURE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+class FFT;
+
+/**
+ * Measurements over a sliding window of a stream of samples, in volts.
+ * Samples are summarized in fixed-size blocks as they arrive; the window's
+ * results are then combined from the block summaries, so no sample is ever
+ * visited twice.
+ */
+class Measurement
+{
+public:
+    // Amplitude histogram across the full +/-3.3V range.
+    static constexpr std::size_t HistogramBins = 128;
+    static constexpr float HistogramMin = -3.3f;
+    static constexpr float HistogramMax = 3.3f;
+
+    struct Result {
+        std::size_t count = 0;
+        float mean = 0;
+        float rms = 0;
+        float acRms = 0;
+        float min = 0;
+        float max = 0;
+        float crest = 0;
+        float frequency = 0; // Hz, from zero crossings; zero if unknown.
+        std::array<float, HistogramBins> histogram {};
+    };
+
+    /**
+     * Sets the block size and the number of blocks in the window, and
+     * discards everything measured so far.
+     */
+    void configure(std::size_t blockSize, std::size_t blockCount);
+
+    void reset();
+
+    /**
+     * Adds the next samples of the stream.
+     */
+    void process(const float *samples, std::size_t count);
+
+    /**
+     * Combines the blocks in the window.
+     * @param sampleRate Used to convert the crossing period to a frequency.
+     */
+    Result result(unsigned int sampleRate) const;
+
+private:
+    struct Block {
+        std::size_t count = 0;
+        double sum = 0;
+        double sumSquares = 0;
+        float min = 0;
+        float max = 0;
+        std::size_t crossings = 0;
+        double firstCrossing = 0; // Stream positions, interpolated.
+        double lastCrossing = 0;
+        std::array<uint32_t, HistogramBins> histogram {};
+    };
+
+    std::size_t m_blockSize = 1024;
+    std::size_t m_blockCount = 64;
+    std::deque<Block> m_blocks;
+    Block m_current;
+    std::size_t m_position = 0;
+
+    // Zero-crossing detector state; the level and hysteresis follow the
+    // window's mean and peak-to-peak as of the last completed block.
+    float m_level = 0;
+    float m_hysteresis = 0;
+    float m_last = 0;
+    bool m_armed = false;
+
+    void processBlock(const float *samples, std::size_t count);
+    void finishBlock();
+};
+
+/**
+ * Estimates the fundamental frequency of the given samples from the first
+ * peak of their autocorrelation. Copes with noise and harmonics better
+ * than counting zero crossings.
+ * @param fft A transform of at least twice count; count is cut to half its size.
+ * @return The frequency in Hz, or zero if no periodicity was found.
+ */
+float autocorrelationFrequency(const float *samples, std::size_t count,
+    FFT& fft, unsigned int sampleRate);
+
+#endif // STMDSPGUI_MEASURE_HPP
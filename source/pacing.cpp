@@ -0,0 +1,101 @@
+/**
+ * @file pacing.cpp
+ * @brief Paces the release of streamed samples to the draw window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pacing.hpp"
+
+#include <algorithm>
+
+// Arrivals further back than this no longer affect the delay.
+constexpr double HistorySeconds = 2;
+// Slack for scheduling noise in the arrival times.
+constexpr double Margin = 0.001;
+// While shedding excess delay, the display runs this much faster than real time.
+constexpr double CatchUpRate = 0.05;
+
+void DisplayClock::reset() noexcept
+{
+    m_rate = 0;
+    m_received = 0;
+    m_released = 0;
+    m_arrivals.clear();
+    m_lag = 0;
+    m_needed = 0;
+    m_origin = 0;
+}
+
+double DisplayClock::seconds(clock::time_point t) const noexcept
+{
+    return std::chrono::duration<double>(t - m_start).count();
+}
+
+void DisplayClock::arrived(std::size_t count, double rate, clock::time_point when)
+{
+    if (count == 0 || rate <= 0)
+        return;
+
+    if (rate != m_rate) {
+        reset();
+        m_rate = rate;
+    }
+    if (m_received == 0) {
+        m_start = when;
+        m_last = when;
+    }
+
+    // Had this chunk arrived on time, the display could have been as far as
+    // the chunk's first sample when it came in.
+    const double t = seconds(when);
+    const double ready = t - m_received / m_rate;
+    m_received += count;
+    const double early = t - m_received / m_rate;
+
+    m_arrivals.push_back({t, ready, early});
+    while (m_arrivals.front().time < t - HistorySeconds)
+        m_arrivals.pop_front();
+
+    // The earliest arrival relative to the stream is the best estimate of
+    // when its samples were taken; the latest decides the delay needed.
+    m_origin = early;
+    m_needed = ready;
+    for (const auto& a : m_arrivals) {
+        m_origin = std::min(m_origin, a.early);
+        m_needed = std::max(m_needed, a.ready);
+    }
+    m_needed += Margin;
+}
+
+std::size_t DisplayClock::advance(clock::time_point now, std::size_t queued)
+{
+    if (m_received == 0)
+        return 0;
+
+    const double t = seconds(now);
+    const double elapsed = std::max(0., t - seconds(m_last));
+    m_last = now;
+
+    if (m_needed > m_lag)
+        m_lag = m_needed;
+    else
+        m_lag = std::max(m_needed, m_lag - CatchUpRate * elapsed);
+    m_lag = std::min(m_lag, m_origin + MaxDelay);
+
+    const double target = std::clamp((t - m_lag) * m_rate, 0.,
+        static_cast<double>(m_received));
+    const auto due = static_cast<std::size_t>(target);
+    const auto count = std::min(due > m_released ? due - m_released : 0, queued);
+    m_released += count;
+    return count;
+}
+
+double DisplayClock::delay() const noexcept
+{
+    return m_received > 0 ? m_lag - m_origin : 0;
+}
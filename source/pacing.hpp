@@ -0,0 +1,84 @@
+/**
+ * @file pacing.hpp
+ * @brief Paces the release of streamed samples to the draw window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_PACING_HPP
+#define STMDSPGUI_PACING_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+/**
+ * Decides how many queued samples the display should show at a given moment.
+ *
+ * Samples arrive in bursts, one device buffer at a time, and frames are
+ * rendered whenever the renderer gets to it. Rather than moving a frame's
+ * worth of samples per frame, the clock timestamps every sample from the
+ * arrival times of the chunks and shows each one a fixed delay after it was
+ * taken. That delay is measured from recent arrivals: it is the smallest
+ * that keeps the display from running dry between chunks. Frame hitches
+ * then only change how many samples move at once, never the time base.
+ *
+ * When the needed delay grows, the display holds until it is met; when it
+ * shrinks, the display runs slightly fast until it has caught up.
+ */
+class DisplayClock
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Longest delay allowed; the display skips ahead rather than lag further.
+    static constexpr double MaxDelay = 0.5;
+
+    void reset() noexcept;
+
+    /**
+     * Records the arrival of the next samples of the stream.
+     * @param rate Samples per second of the stream (times any playback speed).
+     */
+    void arrived(std::size_t count, double rate, clock::time_point when);
+
+    /**
+     * Returns how many more samples are due to be shown by the given time.
+     * @param queued The number of samples waiting to be shown.
+     */
+    std::size_t advance(clock::time_point now, std::size_t queued);
+
+    /**
+     * Time from when a sample was taken (as estimated from arrivals) to when
+     * it is shown, in seconds.
+     */
+    double delay() const noexcept;
+
+private:
+    struct Arrival {
+        double time;  // Seconds since m_start.
+        double ready; // Earliest moment this chunk allowed a display to start.
+        double early; // Estimated time of stream position zero.
+    };
+
+    double m_rate = 0;
+    std::size_t m_received = 0;
+    std::size_t m_released = 0;
+    clock::time_point m_start;
+    clock::time_point m_last;
+    std::deque<Arrival> m_arrivals;
+
+    // Samples are shown m_lag seconds after they would have arrived if the
+    // stream's clock started at m_start.
+    double m_lag = 0;
+    double m_needed = 0; // Smallest lag that would have kept up lately.
+    double m_origin = 0; // Estimated time of stream position zero.
+
+    double seconds(clock::time_point t) const noexcept;
+};
+
+#endif // STMDSPGUI_PACING_HPP
@@ -0,0 +1,164 @@
+/**
+ * @file phosphor.cpp
+ * @brief Intensity accumulation for the draw window's persistence mode.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "phosphor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void Phosphor::configure(unsigned int width, unsigned int height,
+    unsigned int yMinMax)
+{
+    if (width == m_width && height == m_height && yMinMax == m_yMinMax)
+        return;
+
+    m_width = width;
+    m_height = height;
+    m_yMinMax = yMinMax;
+    m_intensity.resize(static_cast<std::size_t>(width) * height);
+    m_image.resize(m_intensity.size());
+    m_extents.resize(width);
+
+    // Black through red and yellow to white, like the output trace glowing.
+    constexpr float stops[][3] = {
+        {0.f, 0.f, 0.f},
+        {0.5f, 0.f, 0.f},
+        {1.f, 0.2f, 0.f},
+        {1.f, 0.8f, 0.2f},
+        {1.f, 1.f, 1.f}
+    };
+    constexpr std::size_t segments = std::size(stops) - 1;
+    for (std::size_t i = 0; i < m_palette.size(); ++i) {
+        const float f = i / 255.f * segments;
+        const auto s = std::min<std::size_t>(f, segments - 1);
+        const float t = f - s;
+        uint32_t c = 0xFF000000u; // RGBA in memory order.
+        for (int ch = 0; ch < 3; ++ch) {
+            const float v = stops[s][ch] + t * (stops[s + 1][ch] - stops[s][ch]);
+            c |= static_cast<uint32_t>(v * 255.f + 0.5f) << (8 * ch);
+        }
+        m_palette[i] = c;
+    }
+
+    // Intensity curve, indexed by intensity relative to the brightest pixel.
+    // The fourth root and the floor keep a pixel that was hit only once
+    // visible next to a trace that is hit on every sweep.
+    for (std::size_t i = 0; i < m_levels.size(); ++i) {
+        const float t = static_cast<float>(i) / (m_levels.size() - 1);
+        const auto level = static_cast<int>(std::sqrt(std::sqrt(t)) * 255.f);
+        m_levels[i] = i == 0 ? m_palette[0] : m_palette[std::max(level, 48)];
+    }
+
+    clear();
+}
+
+void Phosphor::clear()
+{
+    std::fill(m_intensity.begin(), m_intensity.end(), 0.f);
+    std::fill(m_image.begin(), m_image.end(), m_palette[0]);
+    std::fill(m_extents.begin(), m_extents.end(), std::pair(m_height, 0u));
+    m_lastValid = false;
+}
+
+unsigned int Phosphor::toY(stmdsp::dacsample_t s) const noexcept
+{
+    const float n = std::clamp((s - 2048.f) / m_yMinMax, -0.5f, 0.5f);
+    return static_cast<unsigned int>((0.5f - n) * (m_height - 1) + 0.5f);
+}
+
+void Phosphor::accumulate(std::span<const stmdsp::dacsample_t> samples,
+    std::size_t index, std::size_t sweep)
+{
+    if (m_width == 0 || m_height == 0 || samples.empty() || index >= sweep)
+        return;
+
+    // Only connect to the previous piece if this one carries on from it.
+    if (index != m_lastIndex)
+        m_lastValid = false;
+
+    const std::size_t count = std::min(samples.size(), sweep - index);
+    const std::size_t firstColumn = index * m_width / sweep;
+    // The sweep's last sample holds through to the right edge.
+    const std::size_t lastColumn = index + count == sweep ? m_width - 1
+        : (index + count - 1) * m_width / sweep;
+
+    std::size_t i = 0;
+    for (auto c = firstColumn; c <= lastColumn; ++c) {
+        // Samples j of the sweep with j * width / sweep == c.
+        const auto end = std::min(count,
+            ((c + 1) * sweep + m_width - 1) / m_width - index);
+
+        unsigned int top, bottom;
+        if (i < end) {
+            auto min = samples[i];
+            auto max = samples[i];
+            for (auto j = i + 1; j < end; ++j) {
+                min = std::min(min, samples[j]);
+                max = std::max(max, samples[j]);
+            }
+
+            top = toY(max);
+            bottom = toY(min);
+            if (m_lastValid) {
+                top = std::min(top, m_lastY);
+                bottom = std::max(bottom, m_lastY);
+            }
+            m_lastY = toY(samples[end - 1]);
+            m_lastValid = true;
+            i = end;
+        } else if (m_lastValid) {
+            // Fewer samples than columns: hold the last level across the gap.
+            top = bottom = m_lastY;
+        } else {
+            continue;
+        }
+
+        float *column = m_intensity.data() + c * m_height;
+        for (auto y = top; y <= bottom; ++y)
+            column[y] += 1.f;
+
+        auto& extent = m_extents[c];
+        extent.first = std::min(extent.first, top);
+        extent.second = std::max(extent.second, bottom + 1);
+    }
+
+    // A new sweep starts over from the left edge, unconnected.
+    m_lastIndex = index + count;
+    if (m_lastIndex == sweep) {
+        m_lastIndex = 0;
+        m_lastValid = false;
+    }
+}
+
+void Phosphor::render(float decay)
+{
+    // Pixels outside each column's extent have never been hit, and stay
+    // black without being visited.
+    float peak = 0;
+    for (std::size_t c = 0; c < m_width; ++c) {
+        float *column = m_intensity.data() + c * m_height;
+        for (auto y = m_extents[c].first; y < m_extents[c].second; ++y) {
+            column[y] *= decay;
+            peak = std::max(peak, column[y]);
+        }
+    }
+
+    if (peak <= 0)
+        return;
+
+    const float scale = (m_levels.size() - 1) / peak;
+    for (std::size_t c = 0; c < m_width; ++c) {
+        const float *column = m_intensity.data() + c * m_height;
+        uint32_t *out = m_image.data() + c * m_height;
+        for (auto y = m_extents[c].first; y < m_extents[c].second; ++y)
+            out[y] = m_levels[static_cast<int>(column[y] * scale)];
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file phosphor.hpp
+ * @brief Intensity accumulation for the draw window's persistence mode.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_PHOSPHOR_HPP
+#define STMDSPGUI_PHOSPHOR_HPP
+
+#include "stmdsp.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * Rasterizes sweeps of samples into an intensity image that fades over time,
+ * like the phosphor of an analog oscilloscope. Sweeps are added piece by
+ * piece as samples arrive, so history is never redrawn.
+ *
+ * The image is stored column-major (one pixel column after another) so that
+ * rasterizing a column's vertical span touches contiguous memory. image()
+ * is laid out the same way, i.e. it is the transpose of the plot.
+ */
+class Phosphor
+{
+public:
+    /**
+     * Sets the image size in pixels and the vertical scale, clearing the
+     * image if any of them changed.
+     * @param yMinMax Range of sample values spanned by the image's height,
+     *                centered on mid-scale; matches the draw window's zoom.
+     */
+    void configure(unsigned int width, unsigned int height, unsigned int yMinMax);
+
+    void clear();
+
+    unsigned int width() const noexcept {
+        return m_width;
+    }
+
+    unsigned int height() const noexcept {
+        return m_height;
+    }
+
+    /**
+     * Adds samples that sit at indices [index, index + samples.size()) of a
+     * sweep of the given length. A sweep spans the image's full width.
+     * Consecutive calls continue the same trace, so pieces can be any size.
+     */
+    void accumulate(std::span<const stmdsp::dacsample_t> samples,
+        std::size_t index, std::size_t sweep);
+
+    /**
+     * Scales all intensities by decay, then updates image() from them.
+     * Brightness is normalized to the brightest pixel.
+     */
+    void render(float decay);
+
+    /**
+     * RGBA pixels, column-major; valid after render().
+     */
+    const std::vector<uint32_t>& image() const noexcept {
+        return m_image;
+    }
+
+private:
+    unsigned int m_width = 0;
+    unsigned int m_height = 0;
+    unsigned int m_yMinMax = 0;
+    std::vector<float> m_intensity;
+    std::vector<uint32_t> m_image;
+    std::vector<std::pair<unsigned int, unsigned int>> m_extents; // [top, bottom)
+    std::array<uint32_t, 256> m_palette {};
+    std::array<uint32_t, 16384> m_levels {};
+
+    // End of the previous piece, to connect the trace across calls.
+    std::size_t m_lastIndex = 0;
+    unsigned int m_lastY = 0;
+    bool m_lastValid = false;
+
+    unsigned int toY(stmdsp::dacsample_t s) const noexcept;
+};
+
+#endif // STMDSPGUI_PHOSPHOR_HPP
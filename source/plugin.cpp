@@ -0,0 +1,208 @@
+/**
+ * @file plugin.cpp
+ * @brief Loads host processing stages from shared libraries.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "plugin.hpp"
+#include "stmdsp_plugin.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef STMDSP_WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Most metrics a plugin can report per block.
+constexpr std::size_t MaxMetrics = 32;
+
+/**
+ * An open shared library; closed when the last reference goes.
+ */
+class PluginLibrary
+{
+public:
+    PluginLibrary() = default;
+    PluginLibrary(const PluginLibrary&) = delete;
+    PluginLibrary& operator=(const PluginLibrary&) = delete;
+
+    ~PluginLibrary() {
+        if (m_handle) {
+#ifdef STMDSP_WIN32
+            FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+            dlclose(m_handle);
+#endif
+        }
+    }
+
+    bool open(const std::string& path, std::string& error) {
+#ifdef STMDSP_WIN32
+        m_handle = LoadLibraryA(path.c_str());
+        if (!m_handle)
+            error = "could not load " + path + '.';
+#else
+        // A path without a slash would be searched for, not opened.
+        const auto name = path.find('/') == std::string::npos ? "./" + path : path;
+        m_handle = dlopen(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!m_handle)
+            error = dlerror();
+#endif
+        return m_handle != nullptr;
+    }
+
+    void *symbol(const char *name) const {
+#ifdef STMDSP_WIN32
+        return reinterpret_cast<void *>(
+            GetProcAddress(static_cast<HMODULE>(m_handle), name));
+#else
+        return dlsym(m_handle, name);
+#endif
+    }
+
+private:
+    void *m_handle = nullptr;
+};
+
+/**
+ * Runs a plugin on the blocks passing through its place in the chain. A
+ * plugin that fails is skipped until the next stream, with its error code
+ * reported as a metric.
+ */
+class PluginStage : public ProcessingStage
+{
+public:
+    PluginStage(std::shared_ptr<PluginLibrary> library,
+        const stmdsp_plugin *plugin, const std::string& path,
+        const std::string& args) :
+        m_library(std::move(library)), m_plugin(plugin), m_path(path),
+        m_args(args) {}
+
+    ~PluginStage() override {
+        destroyState();
+    }
+
+    std::string name() const override {
+        return std::string(m_plugin->name ? m_plugin->name : m_path) +
+            (m_args.empty() ? "" : " " + m_args);
+    }
+
+    double reset(double rate) override {
+        destroyState();
+        m_state = m_plugin->create(m_args.c_str(), rate);
+        m_rate = rate;
+        m_position = 0;
+        m_metrics.clear();
+        if (!m_state)
+            fail(-1);
+        return rate;
+    }
+
+    void process(std::vector<float>& samples) override {
+        if (!m_state)
+            return;
+
+        stmdsp_block block {};
+        block.samples = samples.data();
+        block.count = samples.size();
+        block.rate = m_rate;
+        block.position = m_position;
+        block.metrics = m_reported.data();
+        block.metric_capacity = m_reported.size();
+
+        if (const int result = m_plugin->process(m_state, &block); result != 0) {
+            destroyState();
+            fail(result);
+            return;
+        }
+
+        m_position += samples.size();
+        collectMetrics(block);
+    }
+
+    const std::vector<ProcessingMetric> *metrics() const override {
+        return &m_metrics;
+    }
+
+private:
+    // Declared first so that the library outlives the plugin's state.
+    std::shared_ptr<PluginLibrary> m_library;
+    const stmdsp_plugin *m_plugin;
+    std::string m_path;
+    std::string m_args;
+
+    void *m_state = nullptr;
+    double m_rate = 0;
+    uint64_t m_position = 0;
+    std::array<stmdsp_metric, MaxMetrics> m_reported {};
+    std::vector<ProcessingMetric> m_metrics;
+
+    void destroyState() {
+        if (m_state) {
+            m_plugin->destroy(m_state);
+            m_state = nullptr;
+        }
+    }
+
+    void fail(int code) {
+        m_metrics.assign(1, {"error", static_cast<double>(code)});
+    }
+
+    // Copies the reported metrics, reusing the strings already held.
+    void collectMetrics(const stmdsp_block& block) {
+        const auto count = std::min(block.metric_count, m_reported.size());
+        m_metrics.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto name = m_reported[i].name ? m_reported[i].name : "";
+            if (m_metrics[i].name != name)
+                m_metrics[i].name = name;
+            m_metrics[i].value = m_reported[i].value;
+        }
+    }
+};
+
+std::unique_ptr<ProcessingStage> pluginLoadStage(const std::string& path,
+    const std::string& args, std::string& error)
+{
+    auto library = std::make_shared<PluginLibrary>();
+    if (!library->open(path, error))
+        return nullptr;
+
+    const auto entry = reinterpret_cast<stmdsp_plugin_entry_fn>(
+        library->symbol(STMDSP_PLUGIN_ENTRY_NAME));
+    if (!entry) {
+        error = path + " has no " STMDSP_PLUGIN_ENTRY_NAME "().";
+        return nullptr;
+    }
+
+    // The version comes first: the rest of the description is only known to
+    // be laid out as expected once it matches.
+    const auto plugin = entry();
+    if (!plugin) {
+        error = path + " did not describe a plugin.";
+        return nullptr;
+    }
+    if (plugin->api_version != STMDSP_PLUGIN_API_VERSION) {
+        error = path + " is built for plugin interface version " +
+            std::to_string(plugin->api_version) + ", not " +
+            std::to_string(STMDSP_PLUGIN_API_VERSION) + '.';
+        return nullptr;
+    }
+    if (!plugin->create || !plugin->destroy || !plugin->process) {
+        error = path + " did not describe a plugin.";
+        return nullptr;
+    }
+
+    return std::make_unique<PluginStage>(std::move(library), plugin, path, args);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file plugin.hpp
+ * @brief Loads host processing stages from shared libraries.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_PLUGIN_HPP
+#define STMDSPGUI_PLUGIN_HPP
+
+#include "processing.hpp"
+
+#include <memory>
+#include <string>
+
+/**
+ * Loads the plugin at the given path as a processing stage. The library
+ * stays loaded for as long as the stage exists.
+ * @param args Passed to the plugin each time it is set up for a stream.
+ * @return Null, with error saying why, if the plugin could not be loaded.
+ */
+std::unique_ptr<ProcessingStage> pluginLoadStage(const std::string& path,
+    const std::string& args, std::string& error);
+
+#endif // STMDSPGUI_PLUGIN_HPP
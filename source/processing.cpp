@@ -0,0 +1,501 @@
+/**
+ * @file processing.cpp
+ * @brief Host-side processing of the sample stream: decimation, filters, gain.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "processing.hpp"
+#include "kernels.hpp"
+#include "plugin.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <sstream>
+
+#ifndef STMDSP_WIN32
+#include <time.h>
+#endif
+
+template<typename T>
+static bool parseNumber(const std::string& str, T& value)
+{
+    const auto end = str.data() + str.size();
+    const auto [ptr, ec] = std::from_chars(str.data(), end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+static std::string formatNumber(double value)
+{
+    std::ostringstream str;
+    str << value;
+    return str.str();
+}
+
+/**
+ * CPU time of the calling thread, in seconds, for timing stages. Time the
+ * thread spends waiting for a CPU is not counted against the stage it
+ * interrupts. Falls back to wall time where there is no such clock.
+ */
+static double threadSeconds()
+{
+#ifndef STMDSP_WIN32
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Highest cutoff the filters are designed for, as a fraction of the rate.
+constexpr double MaxCutoff = 0.49;
+
+/**
+ * Averages each group of factor samples into one. The average doubles as a
+ * (weak) anti-aliasing filter; put a low-pass first for a clean result.
+ */
+class Decimator : public ProcessingStage
+{
+public:
+    explicit Decimator(unsigned int factor) : m_factor(factor) {}
+
+    std::string name() const override {
+        return "decimate " + std::to_string(m_factor);
+    }
+
+    double reset(double rate) override {
+        m_sum = 0;
+        m_count = 0;
+        return rate / m_factor;
+    }
+
+    void process(std::vector<float>& samples) override {
+        std::size_t out = 0;
+        for (const auto s : samples) {
+            m_sum += s;
+            if (++m_count == m_factor) {
+                samples[out++] = static_cast<float>(m_sum / m_factor);
+                m_sum = 0;
+                m_count = 0;
+            }
+        }
+        samples.resize(out);
+    }
+
+    unsigned int factor() const noexcept {
+        return m_factor;
+    }
+
+private:
+    unsigned int m_factor;
+    double m_sum = 0;
+    unsigned int m_count = 0;
+};
+
+// y[n] = x[n] - x[n-1] + a * y[n-1]
+class DcBlocker : public ProcessingStage
+{
+public:
+    explicit DcBlocker(double cutoff) : m_cutoff(cutoff) {}
+
+    std::string name() const override {
+        return "dc " + formatNumber(m_cutoff) + " Hz";
+    }
+
+    double reset(double rate) override {
+        m_a = rate > 0 ? std::exp(-2 * std::numbers::pi *
+            std::min(m_cutoff, rate * MaxCutoff) / rate) : 1;
+        m_x1 = m_y1 = 0;
+        m_primed = false;
+        return rate;
+    }
+
+    void process(std::vector<float>& samples) override {
+        // Starting from the first sample keeps the output from opening with
+        // a step of the whole DC level.
+        if (!m_primed && !samples.empty()) {
+            m_x1 = samples.front();
+            m_primed = true;
+        }
+
+        for (auto& s : samples) {
+            m_y1 = s - m_x1 + m_a * m_y1;
+            m_x1 = s;
+            s = static_cast<float>(m_y1);
+        }
+    }
+
+private:
+    double m_cutoff;
+    double m_a = 1;
+    double m_x1 = 0;
+    double m_y1 = 0;
+    bool m_primed = false;
+};
+
+/**
+ * Windowed-sinc (Hamming) FIR filter. Each block is appended to the last
+ * taps - 1 samples, so the convolution runs over one contiguous buffer.
+ */
+class FirFilter : public ProcessingStage
+{
+public:
+    FirFilter(bool highpass, double cutoff, std::size_t taps) :
+        m_highpass(highpass), m_cutoff(cutoff),
+        m_taps(highpass ? taps | 1 : taps) {}
+
+    std::string name() const override {
+        return std::string("fir ") + (m_highpass ? "highpass " : "lowpass ") +
+            formatNumber(m_cutoff) + " Hz, " + std::to_string(m_taps) + " taps";
+    }
+
+    double reset(double rate) override {
+        design(rate);
+        m_buffer.assign(m_taps - 1, 0.f);
+        m_primed = false;
+        return rate;
+    }
+
+    void process(std::vector<float>& samples) override {
+        const auto count = samples.size();
+        if (!m_primed && count > 0) {
+            // Start from the first sample rather than from zero.
+            std::fill(m_buffer.begin(), m_buffer.end(), samples.front());
+            m_primed = true;
+        }
+
+        const auto history = m_taps - 1;
+        m_buffer.resize(history + count);
+        std::copy(samples.cbegin(), samples.cend(), m_buffer.begin() + history);
+
+        // Tap by tap, so the inner loop runs down both arrays at once.
+        std::fill(samples.begin(), samples.end(), 0.f);
+        for (std::size_t k = 0; k < m_taps; ++k)
+            kernels::multiplyAdd(m_buffer.data() + k, m_reversed[k], samples.data(), count);
+
+        std::copy(m_buffer.cend() - history, m_buffer.cend(), m_buffer.begin());
+        m_buffer.resize(history);
+    }
+
+private:
+    bool m_highpass;
+    double m_cutoff;
+    std::size_t m_taps;
+    std::vector<float> m_reversed; // Taps, last first.
+    std::vector<float> m_buffer;
+    bool m_primed = false;
+
+    void design(double rate) {
+        m_reversed.assign(m_taps, 0.f);
+        if (rate <= 0) {
+            // Pass-through until the rate is known.
+            m_reversed[m_taps / 2] = 1;
+            return;
+        }
+
+        const double fc = std::min(m_cutoff, rate * MaxCutoff) / rate;
+        const double middle = (m_taps - 1) / 2.;
+        std::vector<double> h (m_taps);
+        double sum = 0;
+        for (std::size_t n = 0; n < m_taps; ++n) {
+            const double t = n - middle;
+            const double sinc = t == 0 ? 2 * fc :
+                std::sin(2 * std::numbers::pi * fc * t) / (std::numbers::pi * t);
+            const double window = m_taps > 1 ?
+                0.54 - 0.46 * std::cos(2 * std::numbers::pi * n / (m_taps - 1)) : 1;
+            h[n] = sinc * window;
+            sum += h[n];
+        }
+
+        // Unity gain at DC, then spectral inversion for the high-pass.
+        for (auto& v : h)
+            v /= sum;
+        if (m_highpass) {
+            for (auto& v : h)
+                v = -v;
+            h[m_taps / 2] += 1;
+        }
+
+        std::copy(h.crbegin(), h.crend(), m_reversed.begin());
+    }
+};
+
+/**
+ * Second-order section in transposed direct form II, from the Audio EQ
+ * Cookbook.
+ */
+class Biquad : public ProcessingStage
+{
+public:
+    enum class Type {
+        Lowpass,
+        Highpass,
+        Bandpass,
+        Notch
+    };
+
+    Biquad(Type type, double frequency, double q) :
+        m_type(type), m_frequency(frequency), m_q(q) {}
+
+    std::string name() const override {
+        static const char *types[] = {"lowpass ", "highpass ", "bandpass ", "notch "};
+        return types[static_cast<int>(m_type)] + formatNumber(m_frequency) +
+            " Hz, Q " + formatNumber(m_q);
+    }
+
+    double reset(double rate) override {
+        design(rate);
+        m_z1 = m_z2 = 0;
+        return rate;
+    }
+
+    void process(std::vector<float>& samples) override {
+        for (auto& s : samples) {
+            const double x = s;
+            const double y = m_b0 * x + m_z1;
+            m_z1 = m_b1 * x - m_a1 * y + m_z2;
+            m_z2 = m_b2 * x - m_a2 * y;
+            s = static_cast<float>(y);
+        }
+    }
+
+private:
+    Type m_type;
+    double m_frequency;
+    double m_q;
+    double m_b0 = 1, m_b1 = 0, m_b2 = 0, m_a1 = 0, m_a2 = 0;
+    double m_z1 = 0, m_z2 = 0;
+
+    void design(double rate) {
+        if (rate <= 0) {
+            m_b0 = 1;
+            m_b1 = m_b2 = m_a1 = m_a2 = 0;
+            return;
+        }
+
+        const double w = 2 * std::numbers::pi *
+            std::min(m_frequency, rate * MaxCutoff) / rate;
+        const double alpha = std::sin(w) / (2 * m_q);
+        const double c = std::cos(w);
+
+        double b0, b1, b2;
+        switch (m_type) {
+        case Type::Lowpass:
+            b0 = b2 = (1 - c) / 2;
+            b1 = 1 - c;
+            break;
+        case Type::Highpass:
+            b0 = b2 = (1 + c) / 2;
+            b1 = -(1 + c);
+            break;
+        case Type::Bandpass:
+            b0 = alpha;
+            b1 = 0;
+            b2 = -alpha;
+            break;
+        case Type::Notch:
+        default:
+            b0 = b2 = 1;
+            b1 = -2 * c;
+            break;
+        }
+
+        const double a0 = 1 + alpha;
+        m_b0 = b0 / a0;
+        m_b1 = b1 / a0;
+        m_b2 = b2 / a0;
+        m_a1 = -2 * c / a0;
+        m_a2 = (1 - alpha) / a0;
+    }
+};
+
+class Gain : public ProcessingStage
+{
+public:
+    explicit Gain(double db) : m_db(db), m_scale(std::pow(10., db / 20)) {}
+
+    std::string name() const override {
+        return "gain " + formatNumber(m_db) + " dB";
+    }
+
+    double reset(double rate) override {
+        return rate;
+    }
+
+    void process(std::vector<float>& samples) override {
+        for (auto& s : samples)
+            s *= m_scale;
+    }
+
+private:
+    double m_db;
+    float m_scale;
+};
+
+// Parses one stage's line, already split into words.
+static std::unique_ptr<ProcessingStage> parseStage(
+    const std::vector<std::string>& words, std::string& error)
+{
+    const auto& command = words[0];
+    const auto argCount = words.size() - 1;
+    const auto number = [&words](std::size_t i, auto& value) {
+        return i < words.size() && parseNumber(words[i], value);
+    };
+
+    if (command == "decimate") {
+        unsigned int factor;
+        if (argCount != 1 || !number(1, factor) || factor < 1 || factor > 1000)
+            error = "decimate takes a factor of 1 to 1000.";
+        else
+            return std::make_unique<Decimator>(factor);
+    } else if (command == "dc") {
+        double cutoff = 1;
+        if (argCount > 1 || (argCount == 1 && !number(1, cutoff)) || !(cutoff > 0))
+            error = "dc takes an optional cutoff above 0 Hz.";
+        else
+            return std::make_unique<DcBlocker>(cutoff);
+    } else if (command == "fir") {
+        double cutoff;
+        std::size_t taps = 63;
+        if (argCount < 2 || argCount > 3 ||
+            (words[1] != "lowpass" && words[1] != "highpass") ||
+            !number(2, cutoff) || !(cutoff > 0) ||
+            (argCount == 3 && !number(3, taps)) || taps < 3 || taps > 1023)
+        {
+            error = "fir takes lowpass or highpass, a cutoff, and optionally "
+                    "3 to 1023 taps.";
+        } else {
+            return std::make_unique<FirFilter>(words[1] == "highpass", cutoff, taps);
+        }
+    } else if (command == "lowpass" || command == "highpass" ||
+               command == "bandpass" || command == "notch")
+    {
+        double frequency;
+        double q = std::numbers::sqrt2 / 2;
+        if (argCount < 1 || argCount > 2 || !number(1, frequency) ||
+            !(frequency > 0) || (argCount == 2 && !number(2, q)) || !(q > 0))
+        {
+            error = command + " takes a frequency and optionally a Q, both above 0.";
+        } else {
+            const auto type = command == "lowpass" ? Biquad::Type::Lowpass :
+                              command == "highpass" ? Biquad::Type::Highpass :
+                              command == "bandpass" ? Biquad::Type::Bandpass :
+                                                      Biquad::Type::Notch;
+            return std::make_unique<Biquad>(type, frequency, q);
+        }
+    } else if (command == "plugin") {
+        if (argCount < 1) {
+            error = "plugin takes the path to a shared library.";
+        } else {
+            std::string args;
+            for (std::size_t i = 2; i < words.size(); ++i)
+                args += (i > 2 ? " " : "") + words[i];
+            return pluginLoadStage(words[1], args, error);
+        }
+    } else if (command == "gain") {
+        double db;
+        if (argCount != 1 || !number(1, db) || std::abs(db) > 120)
+            error = "gain takes a level of -120 to 120 dB.";
+        else
+            return std::make_unique<Gain>(db);
+    } else {
+        error = "unknown stage " + command + '.';
+    }
+
+    return nullptr;
+}
+
+bool ProcessingChain::configure(const std::string& spec, std::string& error)
+{
+    std::vector<std::unique_ptr<ProcessingStage>> stages;
+    unsigned int decimation = 1;
+
+    std::string line;
+    std::istringstream lines (spec);
+    while (std::getline(lines, line)) {
+        std::istringstream parts (line);
+        std::string part;
+        while (std::getline(parts, part, ';')) {
+            std::vector<std::string> words;
+            std::istringstream wordStream (part);
+            for (std::string word; wordStream >> word;)
+                words.push_back(word);
+            if (words.empty())
+                continue;
+
+            auto stage = parseStage(words, error);
+            if (!stage)
+                return false;
+            if (const auto d = dynamic_cast<Decimator *>(stage.get()))
+                decimation *= d->factor();
+            stages.push_back(std::move(stage));
+        }
+    }
+
+    m_stages = std::move(stages);
+    m_decimation = decimation;
+
+    std::scoped_lock lock (m_statsLock);
+    m_stats.clear();
+    for (const auto& stage : m_stages)
+        m_stats.emplace_back().name = stage->name();
+    return true;
+}
+
+double ProcessingChain::reset(double rate)
+{
+    for (auto& stage : m_stages)
+        rate = stage->reset(rate);
+    return rate;
+}
+
+void ProcessingChain::process(const std::vector<stmdsp::adcsample_t>& in,
+    std::vector<stmdsp::adcsample_t>& out)
+{
+    m_volts.resize(in.size());
+    kernels::samplesToVolts(in.data(), m_volts.data(), in.size());
+
+    auto& times = m_times;
+    auto& counts = m_counts;
+    times.resize(m_stages.size());
+    counts.resize(m_stages.size());
+    for (std::size_t i = 0; i < m_stages.size(); ++i) {
+        counts[i] = m_volts.size();
+        const auto start = threadSeconds();
+        m_stages[i]->process(m_volts);
+        times[i] = threadSeconds() - start;
+    }
+
+    out.resize(m_volts.size());
+    std::transform(m_volts.cbegin(), m_volts.cend(), out.begin(),
+        [](float v) {
+            const auto s = std::round((v + 3.3f) / 6.6f * 4095.f);
+            return static_cast<stmdsp::adcsample_t>(std::clamp(s, 0.f, 4095.f));
+        });
+
+    std::scoped_lock lock (m_statsLock);
+    for (std::size_t i = 0; i < m_stats.size(); ++i) {
+        auto& s = m_stats[i];
+        ++s.blocks;
+        s.samples += counts[i];
+        s.seconds += times[i];
+        s.last = times[i];
+        if (const auto metrics = m_stages[i]->metrics())
+            s.metrics = *metrics;
+    }
+}
+
+std::vector<ProcessingChain::StageStats> ProcessingChain::stats() const
+{
+    std::scoped_lock lock (m_statsLock);
+    return m_stats;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file processing.hpp
+ * @brief Host-side processing of the sample stream: decimation, filters, gain.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_PROCESSING_HPP
+#define STMDSPGUI_PROCESSING_HPP
+
+#include "stmdsp.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProcessingMetric
+{
+    std::string name;
+    double value = 0;
+};
+
+/**
+ * One step of a ProcessingChain. Stages work on blocks of samples in volts
+ * and carry whatever state they need from one block to the next, so a
+ * stream can be cut into blocks anywhere.
+ */
+class ProcessingStage
+{
+public:
+    virtual ~ProcessingStage() = default;
+
+    // What the stage does, with its settings, for display.
+    virtual std::string name() const = 0;
+
+    /**
+     * Clears the stage's state and designs it for the given input rate.
+     * @return The rate of the stage's output.
+     */
+    virtual double reset(double rate) = 0;
+
+    // Processes the block in place. The block may shrink.
+    virtual void process(std::vector<float>& samples) = 0;
+
+    // Values the stage reports, as of the last block.
+    virtual const std::vector<ProcessingMetric> *metrics() const {
+        return nullptr;
+    }
+};
+
+/**
+ * A series of stages applied to a stream of ADC samples, configured from a
+ * text description with one stage per line or between semicolons:
+ *
+ *   decimate N           Averages each N samples into one.
+ *   dc [HZ]              Removes DC with a one-pole high-pass (default 1 Hz).
+ *   fir lowpass HZ [N]   Windowed-sinc FIR of N taps (default 63); also
+ *   fir highpass HZ [N]  highpass, for which N is made odd.
+ *   lowpass HZ [Q]       Biquad filters (default Q 0.707); also highpass,
+ *                        bandpass and notch.
+ *   gain DB
+ *   plugin PATH [ARGS]   A shared library; see stmdsp_plugin.h.
+ *
+ * Samples are processed in volts, and are clamped back into the ADC's range
+ * afterwards. Each stage is timed by the CPU time of the thread running it.
+ */
+class ProcessingChain
+{
+public:
+    struct StageStats {
+        std::string name;
+        std::size_t blocks = 0;
+        std::size_t samples = 0; // Samples into the stage.
+        double seconds = 0;      // Total CPU time spent in the stage.
+        double last = 0;         // Seconds for the last block.
+        std::vector<ProcessingMetric> metrics;
+    };
+
+    /**
+     * Replaces the stages with those described.
+     * @return False, leaving the chain as it was, if the description is bad;
+     *         error then says why.
+     */
+    bool configure(const std::string& spec, std::string& error);
+
+    bool empty() const noexcept {
+        return m_stages.empty();
+    }
+
+    /**
+     * Clears every stage's state and designs them for the given input rate,
+     * which may be zero if unknown.
+     * @return The rate of the chain's output.
+     */
+    double reset(double rate);
+
+    // Total decimation of the chain.
+    unsigned int decimation() const noexcept {
+        return m_decimation;
+    }
+
+    // Runs the next block of the stream through the chain into out.
+    void process(const std::vector<stmdsp::adcsample_t>& in,
+        std::vector<stmdsp::adcsample_t>& out);
+
+    // Timing of each stage so far; safe to call while processing.
+    std::vector<StageStats> stats() const;
+
+private:
+    std::vector<std::unique_ptr<ProcessingStage>> m_stages;
+    unsigned int m_decimation = 1;
+    std::vector<float> m_volts;
+    std::vector<double> m_times;       // Of each stage, for the last block.
+    std::vector<std::size_t> m_counts;
+
+    mutable std::mutex m_statsLock;
+    std::vector<StageStats> m_stats;
+};
+
+#endif // STMDSPGUI_PROCESSING_HPP
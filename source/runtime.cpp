@@ -0,0 +1,260 @@
+/**
+ * @file runtime.cpp
+ * @brief Owns the program's background threads: device I/O and pooled jobs.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "runtime.hpp"
+
+#include <algorithm>
+
+// The pool worker running on this thread, if any, so that jobs it submits
+// go to its own queue.
+static thread_local const Runtime *workerRuntime = nullptr;
+static thread_local std::size_t workerIndex = 0;
+
+Runtime& runtime()
+{
+    static Runtime rt;
+    return rt;
+}
+
+Runtime::Runtime(unsigned int workers)
+{
+    if (workers == 0)
+        workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+    for (unsigned int i = 0; i < workers; ++i)
+        m_workers.push_back(std::make_unique<Worker>());
+    for (unsigned int i = 0; i < workers; ++i)
+        m_threads.emplace_back(&Runtime::workerMain, this, i);
+}
+
+Runtime::~Runtime()
+{
+    shutdown();
+}
+
+void Runtime::startIo(const std::string& name, std::function<void(std::stop_token)> task)
+{
+    auto running = std::make_shared<std::atomic_bool>(true);
+
+    // The last task of this name is joined outside of the lock, since it
+    // may itself be starting or stopping other tasks.
+    for (;;) {
+        IoTask last;
+        {
+            std::scoped_lock lock (m_ioLock);
+            if (m_ioStopped)
+                return;
+
+            auto& slot = m_io[name];
+            if (!slot.thread.joinable()) {
+                slot.running = running;
+                slot.thread = std::jthread(
+                    [this, name, task = std::move(task), running] (std::stop_token stop) {
+                        execute(name, stop, [&] { task(stop); });
+                        *running = false;
+                    });
+                return;
+            }
+
+            last = std::move(slot);
+        }
+
+        last.thread.request_stop();
+        if (last.thread.get_id() == std::this_thread::get_id())
+            last.thread.detach();
+        // Otherwise the jthread joins as it goes.
+    }
+}
+
+void Runtime::stopIo(const std::string& name)
+{
+    IoTask task;
+    {
+        std::scoped_lock lock (m_ioLock);
+        auto it = m_io.find(name);
+        if (it == m_io.end())
+            return;
+
+        it->second.thread.request_stop();
+        if (it->second.thread.get_id() == std::this_thread::get_id())
+            return; // Joined by whoever stops or restarts it next.
+
+        task = std::move(it->second);
+        m_io.erase(it);
+    }
+
+    if (task.thread.joinable())
+        task.thread.join();
+}
+
+bool Runtime::ioRunning(const std::string& name) const
+{
+    std::scoped_lock lock (m_ioLock);
+    const auto it = m_io.find(name);
+    return it != m_io.end() && it->second.running && *it->second.running;
+}
+
+void Runtime::enqueue(PoolJob job)
+{
+    {
+        std::scoped_lock lock (m_poolLock);
+        if (m_stopping)
+            return; // Still runs if waited on.
+    }
+
+    // Workers queue their own jobs, the rest are spread around.
+    const auto index = workerRuntime == this ? workerIndex :
+        m_nextWorker++ % m_workers.size();
+    {
+        auto& worker = *m_workers[index];
+        std::scoped_lock lock (worker.lock);
+        worker.jobs.push_back(std::move(job));
+    }
+    {
+        std::scoped_lock lock (m_poolLock);
+        ++m_pending;
+    }
+    m_wake.notify_one();
+}
+
+bool Runtime::takeJob(std::size_t index, PoolJob& job)
+{
+    // Own jobs newest first, while they are likely still in cache.
+    {
+        auto& own = *m_workers[index];
+        std::scoped_lock lock (own.lock);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    // Then the oldest of another worker's.
+    for (std::size_t i = 1; i < m_workers.size(); ++i) {
+        auto& other = *m_workers[(index + i) % m_workers.size()];
+        std::scoped_lock lock (other.lock);
+        if (!other.jobs.empty()) {
+            job = std::move(other.jobs.front());
+            other.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Runtime::workerMain(std::size_t index)
+{
+    workerRuntime = this;
+    workerIndex = index;
+
+    auto& worker = *m_workers[index];
+    for (;;) {
+        PoolJob job;
+        if (takeJob(index, job)) {
+            {
+                std::scoped_lock lock (m_poolLock);
+                --m_pending;
+            }
+
+            // Jobs already run or cancelled elsewhere are only dropped.
+            if (!job.claimed->exchange(true)) {
+                {
+                    std::scoped_lock lock (worker.lock);
+                    worker.current = job.stop;
+                }
+                execute(job.name, job.stop.get_token(), [&job] { job.run(true); });
+                {
+                    std::scoped_lock lock (worker.lock);
+                    worker.current = std::stop_source(std::nostopstate);
+                }
+            }
+        } else {
+            std::unique_lock lock (m_poolLock);
+            m_wake.wait(lock, [this] { return m_pending > 0 || m_stopping; });
+            if (m_stopping)
+                return;
+        }
+    }
+}
+
+void Runtime::execute(const std::string& name, std::stop_token stop,
+    const std::function<void()>& fn)
+{
+    {
+        std::scoped_lock lock (m_statsLock);
+        auto& s = m_stats[name];
+        s.name = name;
+        ++s.active;
+    }
+
+    const auto start = clock::now();
+    fn();
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+
+    std::scoped_lock lock (m_statsLock);
+    auto& s = m_stats[name];
+    --s.active;
+    ++s.runs;
+    s.cancelled += stop.stop_requested();
+    s.total += elapsed.count();
+    s.longest = std::max(s.longest, elapsed.count());
+    s.last = elapsed.count();
+}
+
+void Runtime::shutdown()
+{
+    std::map<std::string, IoTask> io;
+    {
+        std::scoped_lock lock (m_ioLock);
+        m_ioStopped = true;
+        io = std::move(m_io);
+        m_io.clear();
+    }
+    for (auto& [name, task] : io) {
+        task.thread.request_stop();
+        if (task.thread.get_id() == std::this_thread::get_id())
+            task.thread.detach();
+    }
+    io.clear(); // Joins the rest.
+
+    {
+        std::scoped_lock lock (m_poolLock);
+        if (m_stopping)
+            return;
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto& worker : m_workers) {
+        std::scoped_lock lock (worker->lock);
+        worker->current.request_stop();
+        for (auto& job : worker->jobs) {
+            job.stop.request_stop();
+            if (!job.claimed->exchange(true))
+                job.run(false);
+        }
+        worker->jobs.clear();
+    }
+
+    m_threads.clear(); // Joins them.
+}
+
+std::vector<TaskStats> Runtime::stats() const
+{
+    std::scoped_lock lock (m_statsLock);
+
+    std::vector<TaskStats> stats;
+    for (const auto& [name, s] : m_stats)
+        stats.push_back(s);
+    return stats;
+}
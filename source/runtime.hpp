@@ -0,0 +1,284 @@
+/**
+ * @file runtime.hpp
+ * @brief Owns the program's background threads: device I/O and pooled jobs.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_RUNTIME_HPP
+#define STMDSPGUI_RUNTIME_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Timing of every run of one named task, on either lane.
+ */
+struct TaskStats
+{
+    std::string name;
+    std::size_t runs = 0;      // Runs finished.
+    std::size_t cancelled = 0; // Runs that were asked to stop first.
+    std::size_t active = 0;    // Runs in progress.
+    double total = 0;          // Seconds, over all finished runs.
+    double longest = 0;
+    double last = 0;
+};
+
+class Runtime;
+
+/**
+ * A job queued on the pool, and its eventual result. Waiting on a job that
+ * no worker has started runs it on the waiting thread instead, so a caller
+ * that forks work out and joins it again never waits behind other jobs.
+ */
+template<typename R>
+class Job
+{
+public:
+    Job() = default;
+
+    bool valid() const noexcept {
+        return m_state != nullptr;
+    }
+
+    void wait() {
+        claim();
+        m_state->future.wait();
+    }
+
+    /**
+     * Returns the job's result. Throws std::future_error if the job was
+     * cancelled before it started.
+     */
+    R get() {
+        claim();
+        auto state = std::move(m_state);
+        return state->future.get();
+    }
+
+    /**
+     * Asks the job to stop, through its stop token. A job that has not
+     * started yet never will.
+     */
+    void cancel() {
+        if (m_state) {
+            m_state->stop.request_stop();
+            if (!m_state->claimed.exchange(true))
+                m_state->task = {};
+        }
+    }
+
+private:
+    friend class Runtime;
+
+    struct State {
+        std::packaged_task<R()> task;
+        std::future<R> future;
+        std::atomic_bool claimed = false; // Set by whoever runs or drops it.
+        std::stop_source stop;
+        std::string name;
+    };
+
+    std::shared_ptr<State> m_state;
+    Runtime *m_runtime = nullptr;
+
+    void claim();
+};
+
+/**
+ * Runs the program's background work on two lanes:
+ *
+ * The I/O lane gives each named task a thread of its own, so device reads
+ * and writes are never queued behind other work. Only one task of a name
+ * runs at a time: starting one cancels and joins the last. Tasks are handed
+ * a stop token, which they check and which cuts short sleepUntil().
+ *
+ * The pool runs short jobs, such as analysis and compiling, on a fixed set
+ * of workers. Each worker takes its own newest jobs first and steals the
+ * oldest from the others once it runs out.
+ *
+ * Every task and job is timed under its name; see stats().
+ */
+class Runtime
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @param workers Pool threads; zero uses one fewer than the number of
+     *                cores, and at least one.
+     */
+    explicit Runtime(unsigned int workers = 0);
+    ~Runtime();
+
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    /**
+     * Starts the given function on the I/O lane, after cancelling and
+     * joining any task of the same name.
+     */
+    void startIo(const std::string& name, std::function<void(std::stop_token)> task);
+
+    /**
+     * Cancels the named task and waits for it to return. Called from the
+     * task itself, it only asks it to stop.
+     */
+    void stopIo(const std::string& name);
+
+    bool ioRunning(const std::string& name) const;
+
+    /**
+     * Queues the given function on the pool. It may take a std::stop_token,
+     * which is stopped if the job is cancelled or the runtime shuts down.
+     */
+    template<typename F>
+    auto submit(const std::string& name, F&& fn);
+
+    /**
+     * Cancels and joins every I/O task and stops the pool. Jobs that have
+     * not started are dropped. After this, I/O tasks are not started and
+     * jobs only run when waited on.
+     */
+    void shutdown();
+
+    std::vector<TaskStats> stats() const;
+
+    /**
+     * Sleeps until the given time, waking early if stop is requested.
+     * @return False if woken by the stop request.
+     */
+    template<typename Clock, typename Duration>
+    static bool sleepUntil(std::stop_token stop,
+        const std::chrono::time_point<Clock, Duration>& when)
+    {
+        std::mutex lock;
+        std::condition_variable_any cv;
+        std::unique_lock<std::mutex> ulock (lock);
+        cv.wait_until(ulock, stop, when, [] { return false; });
+        return !stop.stop_requested();
+    }
+
+    template<typename Rep, typename Period>
+    static bool sleepFor(std::stop_token stop,
+        const std::chrono::duration<Rep, Period>& duration)
+    {
+        return sleepUntil(stop, clock::now() + duration);
+    }
+
+private:
+    template<typename R>
+    friend class Job;
+
+    // What the pool's queues hold, whatever the job returns.
+    struct PoolJob {
+        std::string name;
+        std::shared_ptr<void> keep;   // Holds the job's state alive.
+        std::atomic_bool *claimed;
+        std::stop_source stop;
+        std::function<void(bool)> run; // Runs the job, or drops it if false.
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<PoolJob> jobs;
+        std::stop_source current; // Of the job being run.
+    };
+
+    struct IoTask {
+        std::jthread thread;
+        std::shared_ptr<std::atomic_bool> running;
+    };
+
+    mutable std::mutex m_ioLock;
+    std::map<std::string, IoTask> m_io;
+    bool m_ioStopped = false;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::jthread> m_threads;
+    std::atomic_size_t m_nextWorker = 0;
+    std::mutex m_poolLock; // Guards m_pending and m_stopping, for m_wake.
+    std::condition_variable m_wake;
+    std::size_t m_pending = 0;
+    bool m_stopping = false;
+
+    mutable std::mutex m_statsLock;
+    std::map<std::string, TaskStats> m_stats;
+
+    void enqueue(PoolJob job);
+    bool takeJob(std::size_t index, PoolJob& job);
+    void workerMain(std::size_t index);
+    // Runs fn on this thread, timing it under the given name.
+    void execute(const std::string& name, std::stop_token stop,
+        const std::function<void()>& fn);
+};
+
+/**
+ * The program's runtime. Front ends should call shutdown() before they
+ * return from main().
+ */
+Runtime& runtime();
+
+template<typename R>
+void Job<R>::claim()
+{
+    if (m_state && !m_state->claimed.exchange(true)) {
+        auto& state = *m_state;
+        m_runtime->execute(state.name, state.stop.get_token(),
+            [&state] { state.task(); });
+    }
+}
+
+template<typename F>
+auto Runtime::submit(const std::string& name, F&& fn)
+{
+    constexpr bool takesToken = std::is_invocable_v<F, std::stop_token>;
+    using R = typename std::conditional_t<takesToken,
+        std::invoke_result<F, std::stop_token>, std::invoke_result<F>>::type;
+
+    Job<R> job;
+    job.m_runtime = this;
+    job.m_state = std::make_shared<typename Job<R>::State>();
+
+    auto& state = *job.m_state;
+    state.name = name;
+    if constexpr (takesToken) {
+        state.task = std::packaged_task<R()>(
+            [fn = std::forward<F>(fn), stop = state.stop.get_token()] () mutable {
+                return fn(stop);
+            });
+    } else {
+        state.task = std::packaged_task<R()>(std::forward<F>(fn));
+    }
+    state.future = state.task.get_future();
+
+    enqueue({name, job.m_state, &state.claimed, state.stop,
+        [&state](bool run) {
+            if (run)
+                state.task();
+            else
+                state.task = {};
+        }});
+
+    return job;
+}
+
+#endif // STMDSPGUI_RUNTIME_HPP
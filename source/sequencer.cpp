@@ -0,0 +1,551 @@
+/**
+ * @file sequencer.cpp
+ * @brief Runs scripted sequences of captures for automated experiments.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sequencer.hpp"
+#include "capture.hpp"
+#include "code.hpp"
+#include "device.hpp"
+#include "kernels.hpp"
+#include "main.hpp"
+#include "runtime.hpp"
+
+#include "stmdsp.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+extern std::shared_ptr<stmdsp::device> m_device;
+extern std::array<unsigned int, 6> sampleRateInts;
+
+// Guards against a runaway "repeat".
+constexpr std::size_t MaxRuns = 100000;
+
+struct ScriptLine {
+    int number;
+    std::string command;
+    std::string argument;
+};
+
+// Settings that carry over from one run to the next while parsing.
+struct ScriptState {
+    SequenceRun settings;
+    std::string capture; // May hold "{run}".
+    std::string summary;
+};
+
+static std::string trim(std::string_view str)
+{
+    const auto first = str.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos)
+        return {};
+    const auto last = str.find_last_not_of(" \t\r");
+    return std::string(str.substr(first, last - first + 1));
+}
+
+template<typename T>
+static bool parseNumber(const std::string& str, T& value)
+{
+    const auto end = str.data() + str.size();
+    const auto [ptr, ec] = std::from_chars(str.data(), end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+// Logs the error; always returns false.
+static bool scriptError(int line, const std::string& what)
+{
+    log("Sequence error on line " + std::to_string(line) + ": " + what);
+    return false;
+}
+
+// Parses lines [first, last), expanding repeats into runs.
+static bool parseLines(const std::vector<ScriptLine>& lines, std::size_t first,
+    std::size_t last, ScriptState& state, std::vector<SequenceRun>& runs)
+{
+    for (auto i = first; i < last; ++i) {
+        const auto& [number, command, arg] = lines[i];
+        auto& settings = state.settings;
+
+        if (command == "rate") {
+            if (!parseNumber(arg, settings.rate) || std::find(sampleRateInts.cbegin(),
+                sampleRateInts.cend(), settings.rate) == sampleRateInts.cend())
+            {
+                std::string rates;
+                for (const auto r : sampleRateInts)
+                    rates += ' ' + std::to_string(r);
+                return scriptError(number, "unsupported sample rate; choose from" +
+                    rates + '.');
+            }
+        } else if (command == "buffer") {
+            if (!parseNumber(arg, settings.buffer) || settings.buffer < 100 ||
+                settings.buffer > stmdsp::SAMPLES_MAX)
+            {
+                return scriptError(number, "buffer size must be 100 to " +
+                    std::to_string(stmdsp::SAMPLES_MAX) + '.');
+            }
+        } else if (command == "algorithm") {
+            settings.unload = arg == "none";
+            settings.algorithm = settings.unload ? "" : arg;
+            if (!settings.unload && !std::filesystem::exists(arg))
+                return scriptError(number, "no such file " + arg + '.');
+        } else if (command == "generator") {
+            settings.generator = arg == "off" ? "" : arg;
+        } else if (command == "input") {
+            if (arg != "on" && arg != "off")
+                return scriptError(number, "input must be on or off.");
+            settings.input = arg == "on";
+        } else if (command == "capture") {
+            state.capture = arg == "off" ? "" : arg;
+        } else if (command == "summary") {
+            state.summary = arg;
+        } else if (command == "repeat") {
+            // Find the matching end.
+            std::size_t end = i + 1;
+            for (int depth = 1; end < last; ++end) {
+                if (lines[end].command == "repeat")
+                    ++depth;
+                else if (lines[end].command == "end" && --depth == 0)
+                    break;
+            }
+
+            std::size_t count;
+            if (end >= last)
+                return scriptError(number, "repeat without end.");
+            if (!parseNumber(arg, count))
+                return scriptError(number, "bad repeat count.");
+
+            for (std::size_t n = 0; n < count; ++n) {
+                if (!parseLines(lines, i + 1, end, state, runs))
+                    return false;
+            }
+            i = end;
+        } else if (command == "end") {
+            return scriptError(number, "end without repeat.");
+        } else if (command == "run") {
+            const auto space = arg.find_first_of(" \t");
+            auto run = settings;
+            run.label = space != std::string::npos ? trim(arg.substr(space)) : "";
+            if (!parseNumber(arg.substr(0, space), run.seconds) || !(run.seconds > 0))
+                return scriptError(number, "bad run time.");
+
+            run.capture = state.capture;
+            if (const auto at = run.capture.find("{run}"); at != std::string::npos)
+                run.capture.replace(at, 5, std::to_string(runs.size() + 1));
+
+            if (runs.size() >= MaxRuns)
+                return scriptError(number, "too many runs.");
+            runs.push_back(std::move(run));
+        } else {
+            return scriptError(number, "unknown command " + command + '.');
+        }
+    }
+
+    return true;
+}
+
+Sequencer::~Sequencer()
+{
+    stop();
+    wait();
+}
+
+bool Sequencer::load(const std::string& path)
+{
+    if (m_running) {
+        log("Cannot load a sequence while one is running.");
+        return false;
+    }
+
+    std::ifstream file (path);
+    if (!file.good()) {
+        log("Error: Could not open sequence " + path + '.');
+        return false;
+    }
+
+    std::vector<ScriptLine> lines;
+    std::string text;
+    for (int number = 1; std::getline(file, text); ++number) {
+        if (const auto hash = text.find('#'); hash != std::string::npos)
+            text.erase(hash);
+        text = trim(text);
+        if (text.empty())
+            continue;
+
+        const auto space = text.find_first_of(" \t");
+        lines.push_back({number, text.substr(0, space),
+            space != std::string::npos ? trim(text.substr(space)) : ""});
+    }
+
+    ScriptState state;
+    std::vector<SequenceRun> runs;
+    if (!parseLines(lines, 0, lines.size(), state, runs))
+        return false;
+    if (runs.empty()) {
+        log("Error: The sequence has no runs.");
+        return false;
+    }
+
+    m_runs = std::move(runs);
+    m_summary = state.summary;
+    log("Sequence loaded: " + std::to_string(m_runs.size()) + " runs.");
+    return true;
+}
+
+bool Sequencer::start(bool draw)
+{
+    if (m_running || m_runs.empty())
+        return false;
+    if (!m_device) {
+        log("No device connected.");
+        return false;
+    }
+
+    wait();
+    {
+        std::scoped_lock lock (m_lock);
+        m_results.clear();
+    }
+
+    m_draw = draw;
+    m_stop = false;
+    m_running = true;
+    m_thread = std::thread(&Sequencer::run, this);
+    return true;
+}
+
+void Sequencer::stop()
+{
+    {
+        std::scoped_lock lock (m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+}
+
+void Sequencer::wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+std::size_t Sequencer::resultCount() const
+{
+    std::scoped_lock lock (m_lock);
+    return m_results.size();
+}
+
+std::vector<SequenceResult> Sequencer::results() const
+{
+    std::scoped_lock lock (m_lock);
+    return m_results;
+}
+
+// Waits out a run. Returns false if stopped early or the stream ended.
+bool Sequencer::sleep(double seconds)
+{
+    using clock = std::chrono::steady_clock;
+
+    const auto until = clock::now() + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(seconds));
+
+    std::unique_lock lock (m_lock);
+    while (clock::now() < until) {
+        if (m_stop || !m_device || !m_device->is_running())
+            return false;
+
+        // Disconnects are not signalled, so check back now and then.
+        m_wake.wait_until(lock, std::min(until,
+            clock::now() + std::chrono::milliseconds(100)));
+    }
+
+    return true;
+}
+
+static bool compileFile(const std::string& path, unsigned int bufferSize)
+{
+    std::ifstream file (path);
+    if (!file.good()) {
+        log("Error: Could not read " + path + '.');
+        return false;
+    }
+
+    std::ostringstream code;
+    code << file.rdbuf();
+    return compileEditorCode(code.str(), bufferSize);
+}
+
+// Measures the whole of the given capture.
+static bool measureCapture(const std::string& path, SequenceResult& result)
+{
+    capture::reader reader;
+    if (!reader.open(path) || reader.sample_rate() == 0)
+        return false;
+
+    // Block sizes as in the measurements panel, with enough blocks to keep
+    // every sample in the window.
+    const std::size_t blockSize = std::max(1u, reader.sample_rate() / 100);
+    const std::size_t blockCount = result.samples / blockSize + 2;
+    Measurement output, input;
+    output.configure(blockSize, blockCount);
+    input.configure(blockSize, blockCount);
+
+    std::vector<stmdsp::adcsample_t> chunk;
+    std::vector<float> volts;
+    for (std::size_t i = 0; i < reader.block_count(); ++i) {
+        if (!reader.read_block(i, chunk))
+            return false;
+
+        volts.resize(chunk.size());
+        kernels::samplesToVolts(chunk.data(), volts.data(), chunk.size());
+        auto& m = reader.block_channel(i) == capture::channel::Input ? input : output;
+        m.process(volts.data(), volts.size());
+    }
+
+    result.output = output.result(reader.sample_rate());
+    if (result.run.input)
+        result.input = input.result(reader.sample_rate());
+    return true;
+}
+
+void Sequencer::run()
+{
+    using Build = std::pair<std::string, unsigned int>; // Source file, buffer size.
+
+    const auto temporary = (std::filesystem::temp_directory_path() /
+        "stmdspgui_sequence.stmcap").string();
+    const auto deviceBuffer = m_device ? m_device->get_buffer_size() : 0;
+    const auto bufferOf = [deviceBuffer](const SequenceRun& r) {
+        return r.buffer != 0 ? r.buffer : deviceBuffer;
+    };
+
+    std::optional<Build> built;    // The binary compileOpenBinaryFile() gives.
+    std::optional<Build> uploaded; // What the device is running.
+    Job<bool> building;
+    Build buildingKey;
+
+    for (std::size_t i = 0; i < m_runs.size() && !m_stop; ++i) {
+        const auto& run = m_runs[i];
+        SequenceResult result;
+        result.index = i + 1;
+        result.run = run;
+
+        // Any compile started during the last run must finish before the
+        // binary is used, or another build is started over it.
+        if (building.valid())
+            built = building.get() ? std::optional(buildingKey) : std::nullopt;
+
+        const auto fail = [&result](const std::string& error) {
+            if (result.error.empty())
+                result.error = error;
+        };
+
+        if (!m_device) {
+            fail("No device connected.");
+        } else {
+            if (run.rate != 0 && m_device->get_sample_rate() != run.rate &&
+                !deviceSetSampleRate(run.rate))
+            {
+                fail("Device did not accept the sample rate.");
+            }
+            if (bufferOf(run) != m_device->get_buffer_size())
+                deviceSetBufferSize(bufferOf(run));
+
+            if (run.unload) {
+                deviceAlgorithmUnload();
+                uploaded.reset();
+            } else if (!run.algorithm.empty()) {
+                const Build key {run.algorithm, bufferOf(run)};
+                if (uploaded != key) {
+                    if (built != key)
+                        built = compileFile(key.first, key.second) ? std::optional(key) : std::nullopt;
+
+                    if (built != key)
+                        fail("Compile failed.");
+                    else if (!deviceAlgorithmUpload())
+                        fail("Upload failed.");
+                    else
+                        uploaded = key;
+                }
+            }
+
+            if (!run.generator.empty() && !deviceGenLoad(run.generator))
+                fail("Bad generator.");
+        }
+
+        // Compile the next variant while this run captures. The binary now
+        // being overwritten has already been uploaded.
+        if (i + 1 < m_runs.size()) {
+            const auto& next = m_runs[i + 1];
+            const Build key {next.algorithm, bufferOf(next)};
+            if (!next.algorithm.empty() && !next.unload && key != uploaded && key != built) {
+                buildingKey = key;
+                building = runtime().submit("compile",
+                    [key] { return compileFile(key.first, key.second); });
+            }
+        }
+
+        const auto path = run.capture.empty() ? temporary : run.capture;
+        if (result.error.empty()) {
+            deviceSetInputLogging(run.input);
+            if (!deviceLoadLogFile(path))
+                fail("Could not open the capture file.");
+        }
+
+        if (result.error.empty()) {
+            log("Run " + std::to_string(i + 1) + " of " + std::to_string(m_runs.size()) + "...");
+            deviceStart(true, m_draw);
+            if (!run.generator.empty())
+                deviceGenStartToggle();
+
+            const bool completed = sleep(run.seconds);
+
+            if (m_device && m_device->is_running())
+                deviceStart(false, false);
+            if (m_device && m_device->is_siggening())
+                deviceGenStartToggle();
+
+            const auto stats = deviceStreamStats();
+            result.rate = m_device ? m_device->get_sample_rate() : 0;
+            result.buffer = m_device ? m_device->get_buffer_size() : 0;
+            result.seconds = stats.seconds;
+            result.samples = stats.samples;
+            result.missed = stats.missed;
+            result.late = stats.late;
+
+            if (!completed)
+                fail(m_stop ? "Stopped." : "Stream ended early.");
+            else if (!measureCapture(path, result))
+                fail("Could not read the capture.");
+            else
+                result.ok = true;
+        }
+
+        if (path == temporary)
+            std::filesystem::remove(temporary);
+
+        {
+            std::scoped_lock lock (m_lock);
+            m_results.push_back(result);
+        }
+        if (onResult)
+            onResult(result);
+    }
+
+    if (building.valid())
+        building.wait();
+
+    const auto results = this->results();
+    if (!m_summary.empty()) {
+        if (std::ofstream file (m_summary); file.good())
+            writeCsv(file, results);
+        else
+            log("Error: Could not write " + m_summary + '.');
+    }
+
+    const auto passed = std::count_if(results.cbegin(), results.cend(),
+        [](const auto& r) { return r.ok; });
+    log("Sequence finished: " + std::to_string(passed) + " of " +
+        std::to_string(m_runs.size()) + " runs succeeded.");
+    m_running = false;
+}
+
+static std::string format(const char *fmt, double value)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), fmt, value);
+    return buf;
+}
+
+std::vector<std::string> Sequencer::tableHeader()
+{
+    return {"run", "label", "algorithm", "generator", "rate", "buffer",
+        "seconds", "samples", "missed", "late", "mean", "rms", "min", "max",
+        "freq", "gain_db", "status"};
+}
+
+std::vector<std::string> Sequencer::tableRow(const SequenceResult& r)
+{
+    const auto algorithm = r.run.unload ? std::string("none") :
+        std::filesystem::path(r.run.algorithm).filename().string();
+    const auto& out = r.output;
+
+    std::string gain;
+    if (r.ok && r.input && r.input->acRms > 0 && out.acRms > 0)
+        gain = format("%.2f", 20 * std::log10(out.acRms / r.input->acRms));
+
+    if (!r.ok && r.samples == 0) {
+        return {std::to_string(r.index), r.run.label, algorithm,
+            r.run.generator, "", "", "", "", "", "", "", "", "", "", "", "",
+            r.error};
+    }
+
+    return {std::to_string(r.index), r.run.label, algorithm, r.run.generator,
+        std::to_string(r.rate), std::to_string(r.buffer),
+        format("%.2f", r.seconds), std::to_string(r.samples),
+        std::to_string(r.missed), std::to_string(r.late),
+        format("%.4f", out.mean), format("%.4f", out.rms),
+        format("%.4f", out.min), format("%.4f", out.max),
+        format("%.1f", out.frequency), gain, r.ok ? "ok" : r.error};
+}
+
+void Sequencer::writeTable(std::ostream& os, const std::vector<SequenceResult>& results)
+{
+    std::vector<std::vector<std::string>> rows {tableHeader()};
+    for (const auto& r : results)
+        rows.push_back(tableRow(r));
+
+    std::vector<std::size_t> widths (rows.front().size());
+    for (const auto& row : rows) {
+        for (std::size_t c = 0; c < row.size(); ++c)
+            widths[c] = std::max(widths[c], row[c].size());
+    }
+
+    for (const auto& row : rows) {
+        for (std::size_t c = 0; c < row.size(); ++c) {
+            os << row[c];
+            if (c + 1 < row.size())
+                os << std::string(widths[c] - row[c].size() + 2, ' ');
+        }
+        os << '\n';
+    }
+}
+
+void Sequencer::writeCsv(std::ostream& os, const std::vector<SequenceResult>& results)
+{
+    const auto writeRow = [&os](const std::vector<std::string>& row) {
+        for (std::size_t c = 0; c < row.size(); ++c) {
+            if (c > 0)
+                os << ',';
+            if (row[c].find_first_of(",\"") != std::string::npos) {
+                os << '"';
+                for (char ch : row[c])
+                    os << (ch == '"' ? "\"\"" : std::string(1, ch));
+                os << '"';
+            } else {
+                os << row[c];
+            }
+        }
+        os << '\n';
+    };
+
+    writeRow(tableHeader());
+    for (const auto& r : results)
+        writeRow(tableRow(r));
+}
+
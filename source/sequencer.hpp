@@ -0,0 +1,144 @@
+/**
+ * @file sequencer.hpp
+ * @brief Runs scripted sequences of captures for automated experiments.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_SEQUENCER_HPP
+#define STMDSPGUI_SEQUENCER_HPP
+
+#include "measure.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * The settings of one run of a sequence. Zero or empty settings leave the
+ * device as it is.
+ */
+struct SequenceRun
+{
+    std::string label;
+    unsigned int rate = 0;
+    unsigned int buffer = 0;
+    std::string algorithm; // Source file to compile and upload.
+    bool unload = false;   // Unload the algorithm instead.
+    std::string generator; // As for deviceGenLoad(); empty leaves it off.
+    bool input = false;    // Capture and measure the input stream too.
+    std::string capture;   // Capture file; empty uses a temporary one.
+    double seconds = 1;
+};
+
+/**
+ * What a run produced. Measurements cover the whole capture.
+ */
+struct SequenceResult
+{
+    std::size_t index = 0; // Counted from one.
+    SequenceRun run;
+    bool ok = false;
+    std::string error;
+
+    unsigned int rate = 0;
+    unsigned int buffer = 0;
+    double seconds = 0;
+    std::size_t samples = 0;
+    std::size_t missed = 0;
+    std::size_t late = 0;
+    Measurement::Result output;
+    std::optional<Measurement::Result> input;
+};
+
+/**
+ * Parses and runs sequence scripts, through the same device functions as
+ * the GUI. A script is a list of commands, one per line; "#" starts a
+ * comment:
+ *
+ *   rate HZ              Sample rate of the runs that follow, one the device
+ *                        supports (8000, 16000, 20000, 32000, 48000 or 96000).
+ *   buffer N             Buffer size of the runs that follow.
+ *   algorithm FILE|none  Algorithm to compile and upload, or none to unload.
+ *   generator SPEC|off   Signal generator, as for deviceGenLoad().
+ *   input on|off         Whether the input stream is captured too.
+ *   capture PATH|off     Capture file; "{run}" is replaced by the run number.
+ *   summary PATH         Also write the summary table to PATH as CSV.
+ *   repeat N ... end     Repeats the enclosed commands N times.
+ *   run SECONDS [LABEL]  Captures for SECONDS with the settings so far.
+ *
+ * Runs execute on the sequencer's own thread. While one run captures, the
+ * next one's algorithm is compiled, so back-to-back variants only wait on
+ * the upload.
+ */
+class Sequencer
+{
+public:
+    ~Sequencer();
+
+    /**
+     * Parses the given script, replacing any loaded one. Errors are logged
+     * with their line numbers.
+     */
+    bool load(const std::string& path);
+
+    /**
+     * Starts running the loaded script.
+     * @param draw Whether samples are also queued for the draw window.
+     */
+    bool start(bool draw = false);
+
+    // Asks the running script to stop after the current step.
+    void stop();
+    void wait();
+
+    bool running() const noexcept {
+        return m_running;
+    }
+
+    std::size_t runCount() const noexcept {
+        return m_runs.size();
+    }
+
+    std::size_t resultCount() const;
+    std::vector<SequenceResult> results() const;
+
+    // Called on the sequencer's thread after each run.
+    std::function<void(const SequenceResult&)> onResult;
+
+    // The summary table, as column names and one row of text per run.
+    static std::vector<std::string> tableHeader();
+    static std::vector<std::string> tableRow(const SequenceResult& result);
+
+    static void writeTable(std::ostream& os, const std::vector<SequenceResult>& results);
+    static void writeCsv(std::ostream& os, const std::vector<SequenceResult>& results);
+
+private:
+    std::vector<SequenceRun> m_runs;
+    std::string m_summary;
+    bool m_draw = false;
+
+    std::thread m_thread;
+    std::atomic_bool m_running = false;
+    std::atomic_bool m_stop = false;
+    mutable std::mutex m_lock; // Guards m_results and wakes m_wake.
+    std::condition_variable m_wake;
+    std::vector<SequenceResult> m_results;
+
+    void run();
+    bool sleep(double seconds);
+};
+
+#endif // STMDSPGUI_SEQUENCER_HPP
+
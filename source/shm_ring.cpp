@@ -0,0 +1,199 @@
+/**
+ * @file shm_ring.cpp
+ * @brief Writes the stream to shared memory for other processes to read.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "shm_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+
+#ifndef STMDSP_WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(stmdsp_shm_header) % 64 == 0);
+static_assert(sizeof(stmdsp::adcsample_t) == sizeof(uint16_t));
+
+ShmRing::~ShmRing()
+{
+    close();
+}
+
+#ifdef STMDSP_WIN32
+
+bool ShmRing::open(const std::string&, std::size_t, std::string& error)
+{
+    error = "shared-memory export is not supported on this platform.";
+    return false;
+}
+
+void ShmRing::close() {}
+
+#else
+
+// True if the named segment was left by a writer that has since gone.
+static bool isAbandoned(const std::string& name)
+{
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    bool abandoned = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(stmdsp_shm_header))) {
+        const auto p = mmap(nullptr, sizeof(stmdsp_shm_header), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            const auto h = static_cast<const stmdsp_shm_header *>(p);
+            const bool alive = h->live && h->writer_pid > 0 &&
+                (kill(h->writer_pid, 0) == 0 || errno == EPERM);
+            abandoned = h->magic == STMDSP_SHM_MAGIC && !alive;
+            munmap(p, sizeof(stmdsp_shm_header));
+        }
+    }
+
+    ::close(fd);
+    return abandoned;
+}
+
+bool ShmRing::open(const std::string& name, std::size_t capacity, std::string& error)
+{
+    close();
+
+    const auto path = name.starts_with('/') ? name : '/' + name;
+    capacity = std::bit_ceil(std::max<std::size_t>(capacity, 4096));
+    const auto ringBytes = capacity * sizeof(stmdsp::adcsample_t);
+    const auto size = sizeof(stmdsp_shm_header) + STMDSP_SHM_CHANNELS * ringBytes;
+
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && isAbandoned(path)) {
+        shm_unlink(path.c_str());
+        fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        error = path + (errno == EEXIST ? " is in use by another process." :
+                                          ": " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        error = path + ": " + std::strerror(errno);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    // The segment comes zeroed. The magic number goes in last, so that a
+    // reader never sees it half set up.
+    const auto h = static_cast<stmdsp_shm_header *>(p);
+    h->version = STMDSP_SHM_VERSION;
+    h->header_size = sizeof(stmdsp_shm_header);
+    h->capacity = capacity;
+    h->sample_size = sizeof(stmdsp::adcsample_t);
+    h->channel_count = STMDSP_SHM_CHANNELS;
+    h->segment_size = size;
+    h->writer_pid = getpid();
+    h->live = 1;
+    for (std::size_t i = 0; i < STMDSP_SHM_CHANNELS; ++i)
+        h->channels[i].offset = sizeof(stmdsp_shm_header) + i * ringBytes;
+    std::atomic_ref(h->magic).store(STMDSP_SHM_MAGIC, std::memory_order_release);
+
+    m_header = h;
+    m_size = size;
+    m_name = path;
+    return true;
+}
+
+void ShmRing::close()
+{
+    if (!m_header)
+        return;
+
+    // Readers keep their mappings; they see live drop and stop waiting.
+    std::atomic_ref(m_header->live).store(0, std::memory_order_release);
+    munmap(m_header, m_size);
+    shm_unlink(m_name.c_str());
+    m_header = nullptr;
+}
+
+#endif // STMDSP_WIN32
+
+void ShmRing::beginStream(uint64_t stream, uint64_t rate)
+{
+    if (!m_header)
+        return;
+
+    // A sequence lock: odd while the fields change.
+    std::atomic_ref seq (m_header->stream_seq);
+    const auto s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::atomic_ref(m_header->stream).store(stream, std::memory_order_relaxed);
+    std::atomic_ref(m_header->rate).store(rate, std::memory_order_relaxed);
+    for (auto& ch : m_header->channels) {
+        std::atomic_ref(ch.stream_start).store(
+            std::atomic_ref(ch.end).load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+
+    seq.store(s + 2, std::memory_order_release);
+}
+
+void ShmRing::write(unsigned int channel, const stmdsp::adcsample_t *samples,
+    std::size_t count)
+{
+    if (!m_header || count == 0)
+        return;
+
+    auto& ch = m_header->channels[channel];
+    const auto capacity = m_header->capacity;
+    const auto ring = reinterpret_cast<stmdsp::adcsample_t *>(
+        reinterpret_cast<char *>(m_header) + ch.offset);
+
+    std::atomic_ref begin (ch.begin);
+    std::atomic_ref end (ch.end);
+    auto position = end.load(std::memory_order_relaxed);
+
+    // Of a block longer than the ring, only its end would be kept.
+    if (count > capacity) {
+        position += count - capacity;
+        samples += count - capacity;
+        count = capacity;
+    }
+
+    // Claim the samples about to be overwritten before touching them, so a
+    // reader checking begin afterwards knows what it read was intact.
+    begin.store(position + count, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const auto index = position & (capacity - 1);
+    const auto first = std::min<std::size_t>(count, capacity - index);
+    std::copy_n(samples, first, ring + index);
+    std::copy_n(samples + first, count - first, ring);
+
+    end.store(position + count, std::memory_order_release);
+}
+
+void ShmRing::addDropped(uint64_t chunks)
+{
+    if (m_header)
+        std::atomic_ref(m_header->dropped).fetch_add(chunks, std::memory_order_relaxed);
+}
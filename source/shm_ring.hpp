@@ -0,0 +1,71 @@
+/**
+ * @file shm_ring.hpp
+ * @brief Writes the stream to shared memory for other processes to read.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_SHM_RING_HPP
+#define STMDSPGUI_SHM_RING_HPP
+
+#include "stmdsp.hpp"
+#include "stmdsp_shm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * The writing end of a shared-memory segment laid out as in stmdsp_shm.h.
+ * One thread writes; readers in other processes never hold it up.
+ */
+class ShmRing
+{
+public:
+    static constexpr std::size_t DefaultCapacity = 1 << 20; // Samples per ring.
+
+    ShmRing() = default;
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+    ~ShmRing();
+
+    /**
+     * Creates the named segment with rings of the given capacity, rounded up
+     * to a power of two. A segment of the same name left by a writer that is
+     * gone is replaced.
+     * @return False if it could not be created; error then says why.
+     */
+    bool open(const std::string& name, std::size_t capacity, std::string& error);
+
+    // Marks the segment closed and unlinks it.
+    void close();
+
+    bool isOpen() const noexcept {
+        return m_header != nullptr;
+    }
+
+    const std::string& name() const noexcept {
+        return m_name;
+    }
+
+    // Starts a new stream at the channels' current positions.
+    void beginStream(uint64_t stream, uint64_t rate);
+
+    // Appends samples to a channel's ring.
+    void write(unsigned int channel, const stmdsp::adcsample_t *samples,
+        std::size_t count);
+
+    // Counts chunks of the stream that were never written.
+    void addDropped(uint64_t chunks);
+
+private:
+    stmdsp_shm_header *m_header = nullptr;
+    std::size_t m_size = 0;
+    std::string m_name;
+};
+
+#endif // STMDSPGUI_SHM_RING_HPP
@@ -170,45 +170,36 @@ namespace stmdsp
     }
 
     std::vector<adcsample_t> device::continuous_read() {
-        if (connected()) {
-            try {
-                m_serial->write("s");
-                unsigned char sizebytes[2];
-                m_serial->read(sizebytes, 2);
-                unsigned int size = sizebytes[0] | (sizebytes[1] << 8);
-                if (size > 0) {
-                    std::vector<adcsample_t> data (size);
-                    unsigned int total = size * sizeof(adcsample_t);
-                    unsigned int offset = 0;
+        std::vector<adcsample_t> data;
+        continuous_read(data);
+        return data;
+    }
 
-                    while (total > 512) {
-                        m_serial->read(reinterpret_cast<uint8_t *>(&data[0]) + offset, 512);
-                        m_serial->write("n");
-                        offset += 512;
-                        total -= 512;
-                    }
-                    m_serial->read(reinterpret_cast<uint8_t *>(&data[0]) + offset, total);
-                    m_serial->write("n");
-                    return data;
+    std::vector<adcsample_t> device::continuous_read_input() {
+        std::vector<adcsample_t> data;
+        continuous_read_input(data);
+        return data;
+    }
 
-                }
-            } catch (...) {
-                handle_disconnect();
-            }
-        }
+    void device::continuous_read(std::vector<adcsample_t>& data) {
+        read_samples('s', data);
+    }
 
-        return {};
+    void device::continuous_read_input(std::vector<adcsample_t>& data) {
+        read_samples('t', data);
     }
 
-    std::vector<adcsample_t> device::continuous_read_input() {
+    void device::read_samples(char command, std::vector<adcsample_t>& data) {
+        data.clear();
+
         if (connected()) {
             try {
-                m_serial->write("t");
+                m_serial->write(reinterpret_cast<uint8_t *>(&command), 1);
                 unsigned char sizebytes[2];
                 m_serial->read(sizebytes, 2);
                 unsigned int size = sizebytes[0] | (sizebytes[1] << 8);
                 if (size > 0) {
-                    std::vector<adcsample_t> data (size);
+                    data.resize(size);
                     unsigned int total = size * sizeof(adcsample_t);
                     unsigned int offset = 0;
 
@@ -220,15 +211,12 @@ namespace stmdsp
                     }
                     m_serial->read(reinterpret_cast<uint8_t *>(&data[0]) + offset, total);
                     m_serial->write("n");
-                    return data;
-
                 }
             } catch (...) {
+                data.clear();
                 handle_disconnect();
             }
         }
-
-        return {};
     }
 
     void device::continuous_stop() {
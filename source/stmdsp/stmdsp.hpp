@@ -131,6 +131,9 @@ namespace stmdsp
 
         std::vector<adcsample_t> continuous_read();
         std::vector<adcsample_t> continuous_read_input();
+        // As above, but reusing the given vector's storage.
+        void continuous_read(std::vector<adcsample_t>& data);
+        void continuous_read_input(std::vector<adcsample_t>& data);
 
         bool siggen_upload(dacsample_t *buffer, unsigned int size);
         void siggen_start();
@@ -158,6 +161,7 @@ namespace stmdsp
 
         bool try_command(std::basic_string<uint8_t> data);
         bool try_read(std::basic_string<uint8_t> cmd, uint8_t *dest, unsigned int dest_size);
+        void read_samples(char command, std::vector<adcsample_t>& data);
         void handle_disconnect();
     };
 }
@@ -0,0 +1,91 @@
+/**
+ * @file stmdsp_plugin.h
+ * @brief The C interface of host processing plugins.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A plugin is a shared library that exports stmdsp_plugin_entry(), returning
+ * a description of itself. It is added to the host processing chain with a
+ * stage line of "plugin PATH [ARGS...]", and then sees every block of the
+ * stream that passes through that point of the chain.
+ *
+ * Each use of a plugin gets its own state from create(): one for the output
+ * stream and one for the input, and a fresh one whenever a stream starts.
+ * All calls on one state come from one thread at a time, but states of the
+ * same plugin may be used from different threads at once.
+ *
+ * Nothing may be thrown or longjmp'd across this interface. The interface
+ * only changes along with STMDSP_PLUGIN_API_VERSION, and plugins built for
+ * another version are refused.
+ */
+
+#ifndef STMDSP_PLUGIN_H
+#define STMDSP_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STMDSP_PLUGIN_API_VERSION 1
+
+#ifdef _WIN32
+#define STMDSP_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define STMDSP_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* A named value the plugin reports, such as a detected level. */
+typedef struct stmdsp_metric {
+    const char *name; /* Must stay valid until the next call on the state. */
+    double value;
+} stmdsp_metric;
+
+/* One block of the stream, and room for the plugin's results. */
+typedef struct stmdsp_block {
+    float *samples;         /* In volts; may be changed in place. */
+    size_t count;           /* Fixed: the block keeps its length. */
+    double rate;            /* Samples per second, or zero if unknown. */
+    uint64_t position;      /* Samples seen before this block, since create(). */
+
+    stmdsp_metric *metrics; /* Filled by the plugin, up to metric_capacity. */
+    size_t metric_capacity;
+    size_t metric_count;    /* Zero on entry; set to the number filled. */
+} stmdsp_block;
+
+typedef struct stmdsp_plugin {
+    uint32_t api_version;   /* STMDSP_PLUGIN_API_VERSION */
+    const char *name;
+
+    /*
+     * Makes a new state for a stream of the given rate (zero if unknown).
+     * args holds the rest of the stage line, or is empty.
+     * Returns NULL on failure.
+     */
+    void *(*create)(const char *args, double rate);
+    void (*destroy)(void *state);
+
+    /*
+     * Processes the next block. Metrics are kept by the host until they are
+     * next reported. Returns zero on success; on failure the plugin is
+     * passed over for the rest of the stream.
+     */
+    int (*process)(void *state, stmdsp_block *block);
+} stmdsp_plugin;
+
+#define STMDSP_PLUGIN_ENTRY_NAME "stmdsp_plugin_entry"
+typedef const stmdsp_plugin *(*stmdsp_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STMDSP_PLUGIN_H */
@@ -0,0 +1,158 @@
+/**
+ * @file stmdsp_shm.h
+ * @brief Layout of the shared-memory export of the stream, and how to read it.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * While the export is on, the stream is written to a POSIX shared-memory
+ * object (shm_open(), default name "/stmdsp") that any number of local
+ * processes may map read-only and read in place. The writer never waits for
+ * readers: a reader that falls more than a ring's capacity behind loses the
+ * oldest samples, and can tell that it did.
+ *
+ * The segment starts with a stmdsp_shm_header, followed by one ring for each
+ * channel: the output (STMDSP_SHM_OUTPUT) and the input (STMDSP_SHM_INPUT).
+ * A ring holds the last `capacity` samples of its channel as ADC codes
+ * (0 to 4095 for -3.3 V to +3.3 V), at the byte offset given in its
+ * stmdsp_shm_channel. Samples are numbered from zero for the life of the
+ * segment; sample N is at index N & (capacity - 1) of its ring. The input
+ * ring only gets the input of the periods it was read for.
+ *
+ * Reading, for one channel:
+ *   1. Call stmdsp_shm_readable() to get the range of samples written;
+ *      it moves your position up if the writer has lapped it.
+ *   2. Use the samples in place (stmdsp_shm_samples()), minding the wrap.
+ *   3. Call stmdsp_shm_intact() with the first position you used. If it
+ *      returns zero, the writer overwrote some of them while you read, and
+ *      the results from those samples must be thrown away.
+ * Reading well behind the writer (or copying out promptly) keeps step 3
+ * from failing. There is nothing to wait on; poll at whatever interval
+ * suits, keeping it well under capacity / rate.
+ *
+ * The header's stream fields change when a new stream starts; read them
+ * with stmdsp_shm_read_stream(). live drops to zero when the writer closes
+ * the segment, which is then unlinked; a mapping stays valid until unmapped.
+ *
+ * Fields the writer changes are read atomically, as the helpers below do.
+ * Readers must not write to the segment.
+ */
+
+#ifndef STMDSP_SHM_H
+#define STMDSP_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STMDSP_SHM_MAGIC    0x474e495250534453ull /* "SDSPRING" */
+#define STMDSP_SHM_VERSION  1
+#define STMDSP_SHM_DEFAULT_NAME "/stmdsp"
+
+#define STMDSP_SHM_OUTPUT   0
+#define STMDSP_SHM_INPUT    1
+#define STMDSP_SHM_CHANNELS 2
+
+typedef struct stmdsp_shm_channel {
+    uint64_t offset;       /* Bytes from the start of the segment to the ring. */
+    uint64_t begin;        /* Samples written or being written. */
+    uint64_t end;          /* Samples written; at most capacity of them remain. */
+    uint64_t stream_start; /* Number of the current stream's first sample. */
+    uint64_t reserved[4];
+} stmdsp_shm_channel;
+
+typedef struct stmdsp_shm_header {
+    uint64_t magic;        /* Set last, once the rest is ready. */
+    uint32_t version;      /* STMDSP_SHM_VERSION */
+    uint32_t header_size;  /* sizeof(stmdsp_shm_header) */
+    uint64_t capacity;     /* Samples in each ring; a power of two. */
+    uint32_t sample_size;  /* Bytes per sample: 2. */
+    uint32_t channel_count;
+    uint64_t segment_size;
+    int64_t writer_pid;
+    uint32_t live;         /* Non-zero while the writer has the segment open. */
+    uint32_t reserved0;
+
+    uint64_t stream_seq;   /* Odd while the writer changes the stream fields. */
+    uint64_t stream;       /* Changes each time a new stream starts. */
+    uint64_t rate;         /* Samples per second of the stream; zero if unknown. */
+    uint64_t dropped;      /* Chunks of the stream the writer fell behind on. */
+    uint64_t reserved[5];
+
+    stmdsp_shm_channel channels[STMDSP_SHM_CHANNELS];
+} stmdsp_shm_header;
+
+typedef struct stmdsp_shm_stream {
+    uint64_t stream;
+    uint64_t rate;
+    uint64_t start[STMDSP_SHM_CHANNELS];
+} stmdsp_shm_stream;
+
+/* Returns the given channel's ring. */
+static inline const uint16_t *stmdsp_shm_samples(const stmdsp_shm_header *h,
+    unsigned int channel)
+{
+    return (const uint16_t *)((const char *)h + h->channels[channel].offset);
+}
+
+/*
+ * Returns the number of samples written to the channel so far, and moves
+ * *position up to the oldest sample still held if it has been overwritten.
+ * Samples *position up to the returned end may then be read.
+ */
+static inline uint64_t stmdsp_shm_readable(const stmdsp_shm_header *h,
+    unsigned int channel, uint64_t *position)
+{
+    const uint64_t end = __atomic_load_n(&h->channels[channel].end, __ATOMIC_ACQUIRE);
+    const uint64_t begin = __atomic_load_n(&h->channels[channel].begin, __ATOMIC_RELAXED);
+    /* A write in progress is already overwriting samples past begin - capacity. */
+    const uint64_t oldest = begin > h->capacity ? begin - h->capacity : 0;
+    if (*position > end)
+        *position = end;
+    if (*position < oldest)
+        *position = oldest;
+    /* Lapped between the two loads: nothing is safe to read yet. */
+    return *position > end ? *position : end;
+}
+
+/*
+ * Returns non-zero if the samples read from the given position on were not
+ * overwritten while they were read.
+ */
+static inline int stmdsp_shm_intact(const stmdsp_shm_header *h,
+    unsigned int channel, uint64_t position)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint64_t begin = __atomic_load_n(&h->channels[channel].begin, __ATOMIC_RELAXED);
+    return begin - position <= h->capacity;
+}
+
+/* Reads the stream fields consistently. */
+static inline void stmdsp_shm_read_stream(const stmdsp_shm_header *h,
+    stmdsp_shm_stream *out)
+{
+    uint64_t seq;
+    do {
+        while ((seq = __atomic_load_n(&h->stream_seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        out->stream = __atomic_load_n(&h->stream, __ATOMIC_RELAXED);
+        out->rate = __atomic_load_n(&h->rate, __ATOMIC_RELAXED);
+        for (unsigned int i = 0; i < STMDSP_SHM_CHANNELS; ++i)
+            out->start[i] = __atomic_load_n(&h->channels[i].stream_start, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&h->stream_seq, __ATOMIC_RELAXED) != seq);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STMDSP_SHM_H */
@@ -0,0 +1,90 @@
+/**
+ * @file stmdsp_stream.h
+ * @brief Framing of the stream server's messages to its subscribers.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * While the stream server is on, it listens on a Unix domain socket or a
+ * loopback TCP port. Every connection is a subscriber: the server sends it
+ * a STMDSP_EVENT_HELLO status frame, then every chunk of the stream as a
+ * samples frame and every device event as a status frame, until one side
+ * closes. Subscribers send nothing; anything they do send is ignored.
+ *
+ * Each frame is a stmdsp_frame followed by `size` bytes of payload. All
+ * fields are in the host's byte order, as both ends are on the same machine.
+ *
+ * Samples frames (STMDSP_FRAME_SAMPLES) carry a stmdsp_frame_samples, then
+ * output_count output samples and input_count input samples as uint16_t ADC
+ * codes (0 to 4095 for -3.3 V to +3.3 V). The frame's sequence goes up by one
+ * for each chunk, so a gap shows chunks that were missed.
+ *
+ * Status frames (STMDSP_FRAME_STATUS) carry a stmdsp_frame_status, then a
+ * message of the remaining bytes (UTF-8, not NUL-terminated). A stream's
+ * stop event may arrive just ahead of its last few chunks.
+ *
+ * The server never waits for a subscriber. Each has a queue of at most
+ * STMDSP_STREAM_QUEUE frames; when it is full, the oldest samples frames not
+ * yet started are dropped and counted in `dropped`. Frames are always sent
+ * whole.
+ */
+
+#ifndef STMDSP_STREAM_H
+#define STMDSP_STREAM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STMDSP_STREAM_MAGIC   0x46535344u /* "DSSF" */
+#define STMDSP_STREAM_VERSION 1
+#define STMDSP_STREAM_QUEUE   128
+#define STMDSP_STREAM_DEFAULT_PATH "/tmp/stmdsp.sock"
+
+#define STMDSP_FRAME_SAMPLES 1
+#define STMDSP_FRAME_STATUS  2
+
+/* Status events. */
+#define STMDSP_EVENT_HELLO        0 /* value: STMDSP_STREAM_VERSION */
+#define STMDSP_EVENT_CONNECTED    1
+#define STMDSP_EVENT_DISCONNECTED 2
+#define STMDSP_EVENT_STREAM_START 3 /* value: samples per second */
+#define STMDSP_EVENT_STREAM_STOP  4
+#define STMDSP_EVENT_ERROR        5
+#define STMDSP_EVENT_CLOSING      6 /* The server is shutting down. */
+
+typedef struct stmdsp_frame {
+    uint32_t magic;    /* STMDSP_STREAM_MAGIC */
+    uint16_t type;     /* STMDSP_FRAME_* */
+    uint16_t version;  /* STMDSP_STREAM_VERSION */
+    uint32_t size;     /* Bytes of payload that follow. */
+    uint32_t reserved;
+    uint64_t sequence; /* Samples frames: the chunk's number. Otherwise zero. */
+} stmdsp_frame;
+
+typedef struct stmdsp_frame_samples {
+    uint64_t stream;       /* Changes each time a new stream starts. */
+    uint64_t dropped;      /* Frames dropped for this subscriber so far. */
+    uint32_t rate;         /* Samples per second; zero if unknown. */
+    uint32_t output_count;
+    uint32_t input_count;  /* Zero unless the input was read. */
+    uint32_t reserved;
+} stmdsp_frame_samples;
+
+typedef struct stmdsp_frame_status {
+    uint32_t event;        /* STMDSP_EVENT_* */
+    uint32_t value;
+} stmdsp_frame_status;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STMDSP_STREAM_H */
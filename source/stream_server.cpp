@@ -0,0 +1,433 @@
+/**
+ * @file stream_server.cpp
+ * @brief Serves the stream and device events to local subscribers over a socket.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stream_server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef STMDSP_WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+extern void log(const std::string& str);
+
+StreamServer::~StreamServer()
+{
+    close();
+}
+
+void StreamServer::publish(const ChunkRef& chunk, uint64_t sequence, unsigned int rate)
+{
+    bool wasIdle = false;
+    {
+        std::scoped_lock lock (m_lock);
+        for (auto& sub : m_subscribers) {
+            wasIdle |= sub->queue.empty();
+
+            Frame frame;
+            frame.sequence = sequence;
+            frame.chunk = chunk;
+            frame.rate = rate;
+            enqueue(*sub, std::move(frame));
+        }
+    }
+
+    // Busy subscribers are already being polled for room to write.
+    if (wasIdle)
+        wake();
+}
+
+void StreamServer::status(uint32_t event, uint32_t value, const std::string& message)
+{
+    {
+        std::scoped_lock lock (m_lock);
+        for (auto& sub : m_subscribers) {
+            Frame frame;
+            frame.type = STMDSP_FRAME_STATUS;
+            frame.status = {event, value};
+            frame.message = message;
+            enqueue(*sub, std::move(frame));
+        }
+    }
+
+    wake();
+}
+
+StreamServer::Stats StreamServer::stats() const
+{
+    std::scoped_lock lock (m_lock);
+    return {m_subscribers.size(), m_frames, m_bytes, m_dropped};
+}
+
+void StreamServer::enqueue(Subscriber& sub, Frame frame)
+{
+    if (sub.queue.size() >= STMDSP_STREAM_QUEUE) {
+        // Make room by dropping the oldest samples frame that has not
+        // started going out. Status frames are rare, and always kept.
+        const auto first = sub.queue.begin() + (sub.queue.front().headSize > 0 ? 1 : 0);
+        const auto victim = std::find_if(first, sub.queue.end(),
+            [](const Frame& f) { return f.type == STMDSP_FRAME_SAMPLES; });
+
+        // With none to drop, a new samples frame is dropped instead, while a
+        // status frame goes over the limit and nothing is dropped.
+        const bool found = victim != sub.queue.end();
+        if (found || frame.type == STMDSP_FRAME_SAMPLES) {
+            ++sub.dropped;
+            ++m_dropped;
+            if (!found)
+                return;
+            sub.queue.erase(victim);
+        }
+    }
+
+    sub.queue.push_back(std::move(frame));
+}
+
+#ifdef STMDSP_WIN32
+
+bool StreamServer::open(const std::string&, std::string& error)
+{
+    error = "the stream server is not supported on this platform.";
+    return false;
+}
+
+void StreamServer::run(std::stop_token) {}
+void StreamServer::close() {}
+void StreamServer::wake() {}
+
+#else
+
+// Creates a listening Unix domain socket at path, replacing a stale one.
+static int listenUnix(const std::string& path, std::string& error)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        error = path + ": path too long.";
+        return -1;
+    }
+    std::copy(path.cbegin(), path.cend(), addr.sun_path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return -1;
+    }
+
+    const auto sa = reinterpret_cast<const sockaddr *>(&addr);
+    int result = bind(fd, sa, sizeof(addr));
+    if (result < 0 && errno == EADDRINUSE) {
+        // Left by a server that is gone if nothing answers there.
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && connect(probe, sa, sizeof(addr)) < 0 && errno == ECONNREFUSED) {
+            unlink(path.c_str());
+            result = bind(fd, sa, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe >= 0)
+            ::close(probe);
+    }
+
+    if (result < 0 || listen(fd, 16) < 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Creates a listening TCP socket at HOST:PORT, or on loopback at PORT.
+// Whether the address is 127.0.0.0/8 or ::1 (or 127.0.0.0/8 mapped to IPv6).
+static bool isLoopback(const sockaddr *addr)
+{
+    if (addr->sa_family == AF_INET) {
+        const auto in = reinterpret_cast<const sockaddr_in *>(addr);
+        return (ntohl(in->sin_addr.s_addr) >> 24) == 127;
+    } else if (addr->sa_family == AF_INET6) {
+        const auto& in6 = reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(&in6) ||
+            (IN6_IS_ADDR_V4MAPPED(&in6) && in6.s6_addr[12] == 127);
+    }
+    return false;
+}
+
+/**
+ * Listens on a TCP port of a loopback address. Subscribers are sent the
+ * stream unauthenticated, so other hosts are never let in.
+ */
+static int listenTcp(const std::string& address, std::string& error)
+{
+    const auto colon = address.rfind(':');
+    const auto host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+    const auto port = colon == std::string::npos ? address : address.substr(colon + 1);
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo *info = nullptr;
+    if (const int e = getaddrinfo(host.c_str(), port.c_str(), &hints, &info); e != 0) {
+        error = address + ": " + gai_strerror(e);
+        return -1;
+    }
+    if (!isLoopback(info->ai_addr)) {
+        error = address + ": not a loopback address; the stream is only served locally.";
+        freeaddrinfo(info);
+        return -1;
+    }
+
+    const int fd = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        info->ai_protocol);
+    const int yes = 1;
+    const bool ok = fd >= 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == 0 &&
+        bind(fd, info->ai_addr, info->ai_addrlen) == 0 &&
+        listen(fd, 16) == 0;
+    freeaddrinfo(info);
+
+    if (!ok) {
+        error = address + ": " + std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool StreamServer::open(const std::string& address, std::string& error)
+{
+    close();
+
+    const bool isPath = address.find('/') != std::string::npos;
+    m_listen = isPath ? listenUnix(address, error) : listenTcp(address, error);
+    if (m_listen < 0)
+        return false;
+
+    if (pipe2(m_wake, O_NONBLOCK | O_CLOEXEC) < 0) {
+        error = std::strerror(errno);
+        close();
+        return false;
+    }
+
+    m_address = address;
+    m_path = isPath ? address : std::string();
+    return true;
+}
+
+void StreamServer::close()
+{
+    for (auto& fd : {&m_listen, &m_wake[0], &m_wake[1]}) {
+        if (*fd >= 0)
+            ::close(*fd);
+        *fd = -1;
+    }
+    if (!m_path.empty())
+        unlink(m_path.c_str());
+    m_path.clear();
+
+    for (auto& sub : m_subscribers)
+        ::close(sub->fd);
+    m_subscribers.clear();
+}
+
+void StreamServer::wake()
+{
+    const char c = 0;
+    [[maybe_unused]] const auto n = write(m_wake[1], &c, 1);
+}
+
+void StreamServer::acceptSubscribers()
+{
+    for (;;) {
+        const int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            break;
+
+        auto sub = std::make_unique<Subscriber>();
+        sub->fd = fd;
+
+        std::scoped_lock lock (m_lock);
+        Frame hello;
+        hello.type = STMDSP_FRAME_STATUS;
+        hello.status = {STMDSP_EVENT_HELLO, STMDSP_STREAM_VERSION};
+        hello.message = "stmdsp stream server";
+        enqueue(*sub, std::move(hello));
+        m_subscribers.push_back(std::move(sub));
+        log("Stream server: subscriber connected (" +
+            std::to_string(m_subscribers.size()) + " now).");
+    }
+}
+
+// Writes as much of the subscriber's queue as its socket will take.
+// Returns false if the subscriber is gone.
+bool StreamServer::flush(Subscriber& sub)
+{
+    while (!sub.queue.empty()) {
+        auto& f = sub.queue.front();
+
+        if (f.headSize == 0) {
+            stmdsp_frame header {};
+            header.magic = STMDSP_STREAM_MAGIC;
+            header.type = f.type;
+            header.version = STMDSP_STREAM_VERSION;
+            header.sequence = f.sequence;
+
+            if (f.type == STMDSP_FRAME_SAMPLES) {
+                stmdsp_frame_samples samples {};
+                samples.stream = f.chunk->stream;
+                samples.dropped = sub.dropped;
+                samples.rate = f.rate;
+                samples.output_count = f.chunk->output.size();
+                samples.input_count = f.chunk->input.size();
+                header.size = sizeof(samples) +
+                    (samples.output_count + samples.input_count) * sizeof(stmdsp::adcsample_t);
+                std::memcpy(f.head.data() + sizeof(header), &samples, sizeof(samples));
+                f.headSize = sizeof(header) + sizeof(samples);
+            } else {
+                header.size = sizeof(f.status) + f.message.size();
+                std::memcpy(f.head.data() + sizeof(header), &f.status, sizeof(f.status));
+                f.headSize = sizeof(header) + sizeof(f.status);
+            }
+            std::memcpy(f.head.data(), &header, sizeof(header));
+        }
+
+        // The samples go straight from the shared chunk to the socket.
+        std::array<iovec, 3> parts;
+        std::size_t count = 0;
+        const auto add = [&](const void *data, std::size_t size) {
+            if (size > 0)
+                parts[count++] = {const_cast<void *>(data), size};
+        };
+        add(f.head.data(), f.headSize);
+        if (f.type == STMDSP_FRAME_SAMPLES) {
+            add(f.chunk->output.data(), f.chunk->output.size() * sizeof(stmdsp::adcsample_t));
+            add(f.chunk->input.data(), f.chunk->input.size() * sizeof(stmdsp::adcsample_t));
+        } else {
+            add(f.message.data(), f.message.size());
+        }
+
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < count; ++i)
+            total += parts[i].iov_len;
+
+        // Skip what went out before.
+        std::size_t first = 0;
+        for (auto skip = f.sent; skip > 0; ++first) {
+            if (skip < parts[first].iov_len) {
+                parts[first].iov_base = static_cast<char *>(parts[first].iov_base) + skip;
+                parts[first].iov_len -= skip;
+                break;
+            }
+            skip -= parts[first].iov_len;
+        }
+
+        msghdr msg {};
+        msg.msg_iov = parts.data() + first;
+        msg.msg_iovlen = count - first;
+        const auto n = sendmsg(sub.fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        f.sent += n;
+        m_bytes += n;
+        if (f.sent < total)
+            return true; // The socket is full.
+
+        sub.queue.pop_front();
+        ++m_frames;
+    }
+
+    return true;
+}
+
+void StreamServer::closeSubscriber(std::size_t index)
+{
+    ::close(m_subscribers[index]->fd);
+    m_subscribers.erase(m_subscribers.begin() + index);
+    log("Stream server: subscriber left (" +
+        std::to_string(m_subscribers.size()) + " now).");
+}
+
+void StreamServer::run(std::stop_token stop)
+{
+    std::stop_callback wakeOnStop (stop, [this] { wake(); });
+    std::vector<pollfd> fds;
+
+    while (!stop.stop_requested()) {
+        fds.assign({{m_wake[0], POLLIN, 0}, {m_listen, POLLIN, 0}});
+        {
+            std::scoped_lock lock (m_lock);
+            for (const auto& sub : m_subscribers) {
+                const short events = POLLIN | (sub->queue.empty() ? 0 : POLLOUT);
+                fds.push_back({sub->fd, events, 0});
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            log("Error: Stream server: " + std::string(std::strerror(errno)));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(m_wake[0], drain, sizeof(drain)) > 0) {}
+        }
+        if (fds[1].revents & POLLIN)
+            acceptSubscribers();
+
+        // Subscribers are only added (at the end) and removed on this thread,
+        // so those polled still line up with fds.
+        std::scoped_lock lock (m_lock);
+        for (auto i = fds.size() - 2; i-- > 0;) {
+            auto& sub = *m_subscribers[i];
+            const auto revents = fds[i + 2].revents;
+
+            bool ok = !(revents & (POLLERR | POLLNVAL));
+            if (ok && (revents & (POLLIN | POLLHUP))) {
+                // Subscribers have nothing to say; this only finds closes.
+                char ignored[256];
+                const auto n = recv(sub.fd, ignored, sizeof(ignored), 0);
+                ok = n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR));
+            }
+
+            // Queues filled since the poll are tried too.
+            if (ok)
+                ok = flush(sub);
+            if (!ok)
+                closeSubscriber(i);
+        }
+    }
+
+    // A last word for anyone still keeping up.
+    status(STMDSP_EVENT_CLOSING, 0, "Stream server closing.");
+    std::scoped_lock lock (m_lock);
+    for (auto& sub : m_subscribers)
+        flush(*sub);
+    while (!m_subscribers.empty())
+        closeSubscriber(m_subscribers.size() - 1);
+}
+
+#endif // STMDSP_WIN32
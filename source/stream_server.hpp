@@ -0,0 +1,115 @@
+/**
+ * @file stream_server.hpp
+ * @brief Serves the stream and device events to local subscribers over a socket.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_STREAM_SERVER_HPP
+#define STMDSPGUI_STREAM_SERVER_HPP
+
+#include "chunk.hpp"
+#include "stmdsp_stream.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+/**
+ * Sends every chunk published to it, and every status event, to each of its
+ * subscribers in the framing of stmdsp_stream.h. Chunks are shared, not
+ * copied, until they are written to the sockets.
+ *
+ * Publishing only queues frames, so it never waits on a subscriber. Each
+ * subscriber has its own bounded queue; a slow one has its oldest unsent
+ * samples frames dropped, and falls no further behind.
+ */
+class StreamServer
+{
+public:
+    struct Stats {
+        std::size_t subscribers = 0;
+        uint64_t frames = 0;  // Frames sent, over all subscribers.
+        uint64_t bytes = 0;
+        uint64_t dropped = 0; // Frames dropped, over all subscribers.
+    };
+
+    StreamServer() = default;
+    StreamServer(const StreamServer&) = delete;
+    StreamServer& operator=(const StreamServer&) = delete;
+    ~StreamServer();
+
+    /**
+     * Listens at the given address: a path (containing a '/') for a Unix
+     * domain socket, or PORT or HOST:PORT for TCP. HOST must be a loopback
+     * address (127.0.0.0/8 or ::1); a port alone listens on 127.0.0.1.
+     * @return False if it cannot listen there; error then says why.
+     */
+    bool open(const std::string& address, std::string& error);
+
+    const std::string& address() const noexcept {
+        return m_address;
+    }
+
+    // Serves subscribers until stopped, then tells them and closes.
+    void run(std::stop_token stop);
+
+    // Queues the chunk, numbered sequence in its stream, for every subscriber.
+    void publish(const ChunkRef& chunk, uint64_t sequence, unsigned int rate);
+
+    // Queues a status event for every subscriber.
+    void status(uint32_t event, uint32_t value, const std::string& message);
+
+    Stats stats() const;
+
+private:
+    struct Frame {
+        uint16_t type = STMDSP_FRAME_SAMPLES;
+        uint64_t sequence = 0;
+        ChunkRef chunk;
+        unsigned int rate = 0;
+        stmdsp_frame_status status {};
+        std::string message;
+
+        // The headers, filled in once the frame starts to go out.
+        std::array<char, sizeof(stmdsp_frame) + sizeof(stmdsp_frame_samples)> head;
+        std::size_t headSize = 0;
+        std::size_t sent = 0;
+    };
+
+    struct Subscriber {
+        int fd = -1;
+        std::deque<Frame> queue;
+        uint64_t dropped = 0;
+    };
+
+    mutable std::mutex m_lock;
+    std::vector<std::unique_ptr<Subscriber>> m_subscribers;
+    uint64_t m_frames = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_dropped = 0;
+
+    int m_listen = -1;
+    int m_wake[2] = {-1, -1};
+    std::string m_address;
+    std::string m_path; // Of the Unix socket, removed on close.
+
+    void close();
+    void wake();
+    void acceptSubscribers();
+    void enqueue(Subscriber& sub, Frame frame);
+    bool flush(Subscriber& sub);
+    void closeSubscriber(std::size_t index);
+};
+
+#endif // STMDSPGUI_STREAM_SERVER_HPP
@@ -0,0 +1,65 @@
+/**
+ * @file swapbuffer.hpp
+ * @brief Lock-free handoff of whole objects from one thread to another.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_SWAPBUFFER_HPP
+#define STMDSPGUI_SWAPBUFFER_HPP
+
+#include <array>
+#include <atomic>
+
+/**
+ * A triple buffer: one writer fills back() and publishes it, one reader
+ * fetches the newest published object and uses front(). Publishing and
+ * fetching are single atomic exchanges, so neither side ever waits on the
+ * other, and the reader never sees a half-written object. Objects are
+ * reused, keeping whatever capacity they have grown to.
+ */
+template<typename T>
+class SwapBuffer
+{
+public:
+    // Writer side: the object being filled.
+    T& back() noexcept {
+        return m_buffers[m_back];
+    }
+
+    // Writer side: hands back() to the reader, replacing any object the
+    // reader has not fetched yet.
+    void publish() noexcept {
+        m_back = m_ready.exchange(m_back | Fresh, std::memory_order_acq_rel) & Index;
+    }
+
+    // Reader side: takes the newest published object, if there is one.
+    // Returns true if front() changed.
+    bool fetch() noexcept {
+        if (!(m_ready.load(std::memory_order_relaxed) & Fresh))
+            return false;
+
+        m_front = m_ready.exchange(m_front, std::memory_order_acq_rel) & Index;
+        return true;
+    }
+
+    // Reader side: the newest object fetched.
+    const T& front() const noexcept {
+        return m_buffers[m_front];
+    }
+
+private:
+    static constexpr unsigned int Index = 3;
+    static constexpr unsigned int Fresh = 4;
+
+    std::array<T, 3> m_buffers;
+    unsigned int m_back = 0;
+    unsigned int m_front = 1;
+    std::atomic_uint m_ready = 2; // Index of the spare object, plus Fresh.
+};
+
+#endif // STMDSPGUI_SWAPBUFFER_HPP
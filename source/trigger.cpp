@@ -0,0 +1,120 @@
+/**
+ * @file trigger.cpp
+ * @brief Edge trigger detection for the sample draw window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "trigger.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using sample_t = stmdsp::adcsample_t;
+using samples_t = std::span<const sample_t>;
+
+/**
+ * Returns the index of the first sample below (or above, if Above is true) the
+ * given threshold, or samples.size() if there is none.
+ */
+template<bool Above>
+static std::size_t findCrossing(samples_t samples, int threshold) noexcept
+{
+    constexpr int sampleMax = std::numeric_limits<sample_t>::max();
+
+    // Thresholds outside the sample range either match everything or nothing.
+    if constexpr (Above) {
+        if (threshold < 0)
+            return 0;
+        else if (threshold >= sampleMax)
+            return samples.size();
+    } else {
+        if (threshold > sampleMax)
+            return 0;
+        else if (threshold <= 0)
+            return samples.size();
+    }
+
+    std::size_t i = 0;
+
+#ifdef __SSE2__
+    // SSE2 only has signed 16-bit compares, so bias both sides by 0x8000 to
+    // compare them as unsigned. Sixteen samples are tested per iteration.
+    const auto bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    const auto thresh = _mm_xor_si128(bias,
+        _mm_set1_epi16(static_cast<short>(threshold)));
+
+    for (; i + 16 <= samples.size(); i += 16) {
+        const auto *p = reinterpret_cast<const __m128i *>(samples.data() + i);
+        const auto a = _mm_xor_si128(bias, _mm_loadu_si128(p));
+        const auto b = _mm_xor_si128(bias, _mm_loadu_si128(p + 1));
+
+        __m128i ca, cb;
+        if constexpr (Above) {
+            ca = _mm_cmpgt_epi16(a, thresh);
+            cb = _mm_cmpgt_epi16(b, thresh);
+        } else {
+            ca = _mm_cmplt_epi16(a, thresh);
+            cb = _mm_cmplt_epi16(b, thresh);
+        }
+
+        const unsigned int mask = _mm_movemask_epi8(ca) |
+            (static_cast<unsigned int>(_mm_movemask_epi8(cb)) << 16);
+        if (mask != 0)
+            return i + std::countr_zero(mask) / 2;
+    }
+#endif
+
+    for (; i < samples.size(); ++i) {
+        if (Above ? samples[i] > threshold : samples[i] < threshold)
+            return i;
+    }
+
+    return samples.size();
+}
+
+void EdgeTrigger::configure(sample_t level, sample_t hysteresis,
+    Slope slope) noexcept
+{
+    if (level != m_level || hysteresis != m_hysteresis || slope != m_slope)
+        m_armed = false;
+
+    m_level = level;
+    m_hysteresis = hysteresis;
+    m_slope = slope;
+}
+
+std::size_t EdgeTrigger::scan(samples_t samples) noexcept
+{
+    std::size_t i = 0;
+
+    if (!m_armed) {
+        // Arm once the signal is clear of the level by the hysteresis amount.
+        i = m_slope == Slope::Rising ?
+            findCrossing<false>(samples, m_level - m_hysteresis) :
+            findCrossing<true>(samples, m_level + m_hysteresis);
+        if (i == samples.size())
+            return i;
+        m_armed = true;
+    }
+
+    const auto rest = samples.subspan(i);
+    const auto j = m_slope == Slope::Rising ?
+        findCrossing<true>(rest, m_level - 1) :
+        findCrossing<false>(rest, m_level + 1);
+    if (j == rest.size())
+        return samples.size();
+
+    m_armed = false;
+    return i + j;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file trigger.hpp
+ * @brief Edge trigger detection for the sample draw window.
+ *
+ * Copyright (C) 2022 Clyne Sullivan
+ *
+ * Distributed under the GNU GPL v3 or later. You should have received a copy of
+ * the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STMDSPGUI_TRIGGER_HPP
+#define STMDSPGUI_TRIGGER_HPP
+
+#include "stmdsp.hpp"
+
+#include <cstddef>
+#include <span>
+
+/**
+ * Finds rising or falling edges through a level, with hysteresis.
+ * An edge is only reported after the signal has first moved at least the
+ * hysteresis amount to the other side of the level, so noise riding on a
+ * slow edge does not re-trigger. Detection state carries across scan() calls,
+ * allowing a stream to be fed in arbitrary pieces.
+ */
+class EdgeTrigger
+{
+public:
+    enum class Slope {
+        Rising,
+        Falling
+    };
+
+    void configure(stmdsp::adcsample_t level, stmdsp::adcsample_t hysteresis,
+        Slope slope) noexcept;
+
+    /**
+     * Requires the signal to cross the hysteresis band again before the next
+     * edge is reported.
+     */
+    void rearm() noexcept {
+        m_armed = false;
+    }
+
+    /**
+     * Scans the given samples for the next edge.
+     * @return The edge's index in samples, or samples.size() if none was found.
+     */
+    std::size_t scan(std::span<const stmdsp::adcsample_t> samples) noexcept;
+
+private:
+    int m_level = 2048;
+    int m_hysteresis = 0;
+    Slope m_slope = Slope::Rising;
+    bool m_armed = false;
+};
+
+#endif // STMDSPGUI_TRIGGER_HPP
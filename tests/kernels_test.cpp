@@ -0,0 +1,166 @@
+/**
+ * kernels_test.cpp
+ * Written by Clyne Sullivan.
+ *
+ * Checks that every kernel variant the CPU supports gives bit-for-bit the
+ * results of the scalar one. Inputs are random, start at every offset from an
+ * aligned buffer, and run over every length up to a few vectors' worth and
+ * then some longer ones, to cover each kernel's vector tail and the leftover
+ * samples of moments().
+ *
+ * Built and run by `make test`, or by ctest.
+ */
+
+#include "kernels.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace kernels;
+
+namespace
+{
+    constexpr std::size_t MaxOffset = 8;
+
+    struct Inputs {
+        std::vector<uint16_t> adc;
+        std::vector<int16_t> pcm;
+        std::vector<double> unit;
+        std::vector<float> a;
+        std::vector<float> b;
+        int32_t prev = 0;
+    };
+
+    struct Results {
+        std::vector<float> volts;
+        std::vector<uint16_t> dac;
+        std::vector<uint16_t> unitDac;
+        std::vector<float> product;
+        std::vector<float> accumulated;
+        std::vector<uint32_t> deltas;
+        uint32_t deltaBits = 0;
+        Moments moments;
+    };
+
+    Inputs makeInputs(std::mt19937& rng, std::size_t size, bool wideAdc)
+    {
+        std::uniform_real_distribution<double> unit (-1.5, 1.5);
+        std::uniform_real_distribution<float> value (-4.f, 4.f);
+
+        Inputs in;
+        in.adc.resize(size);
+        in.pcm.resize(size);
+        in.unit.resize(size);
+        in.a.resize(size);
+        in.b.resize(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            // Codes past 4095 make deltas of more than 13 bits.
+            in.adc[i] = static_cast<uint16_t>(rng() % (wideAdc ? 65536 : 4096));
+            in.pcm[i] = static_cast<int16_t>(rng());
+            in.unit[i] = unit(rng);
+            in.a[i] = value(rng);
+            in.b[i] = value(rng);
+        }
+        in.prev = static_cast<int32_t>(rng() % 4096);
+        return in;
+    }
+
+    Results run(const Inputs& in, std::size_t offset, std::size_t count)
+    {
+        Results r;
+        r.volts.resize(count);
+        r.dac.resize(count);
+        r.unitDac.resize(count);
+        r.product.resize(count);
+        r.accumulated.assign(in.b.begin() + offset, in.b.begin() + offset + count);
+        r.deltas.resize(count);
+
+        samplesToVolts(in.adc.data() + offset, r.volts.data(), count);
+        pcmToDac(in.pcm.data() + offset, r.dac.data(), count);
+        unitToDac(in.unit.data() + offset, r.unitDac.data(), count);
+        multiply(in.a.data() + offset, in.b.data() + offset, r.product.data(), count);
+        multiplyAdd(in.a.data() + offset, 0.37f, r.accumulated.data(), count);
+        r.deltaBits = packDeltas(in.adc.data() + offset, count, in.prev, r.deltas.data());
+        r.moments = moments(in.a.data() + offset, count);
+        return r;
+    }
+
+    template<typename T>
+    bool same(const std::vector<T>& x, const std::vector<T>& y)
+    {
+        return x.size() == y.size() &&
+            (x.empty() || std::memcmp(x.data(), y.data(), x.size() * sizeof(T)) == 0);
+    }
+
+    bool same(const Moments& x, const Moments& y)
+    {
+        return std::memcmp(&x.sum, &y.sum, sizeof(float)) == 0 &&
+            std::memcmp(&x.sumSquares, &y.sumSquares, sizeof(float)) == 0 &&
+            std::memcmp(&x.min, &y.min, sizeof(float)) == 0 &&
+            std::memcmp(&x.max, &y.max, sizeof(float)) == 0;
+    }
+
+    // Reports each kernel that differs; returns how many did.
+    int compare(Variant v, const Results& r, const Results& ref,
+        std::size_t offset, std::size_t count)
+    {
+        int failures = 0;
+        const auto check = [&](bool ok, const char *kernel) {
+            if (!ok) {
+                std::printf("%s %s differs (offset %zu, count %zu)\n",
+                    variantName(v), kernel, offset, count);
+                ++failures;
+            }
+        };
+
+        check(same(r.volts, ref.volts), "samplesToVolts");
+        check(same(r.dac, ref.dac), "pcmToDac");
+        check(same(r.unitDac, ref.unitDac), "unitToDac");
+        check(same(r.product, ref.product), "multiply");
+        check(same(r.accumulated, ref.accumulated), "multiplyAdd");
+        check(same(r.deltas, ref.deltas) && r.deltaBits == ref.deltaBits, "packDeltas");
+        check(same(r.moments, ref.moments), "moments");
+        return failures;
+    }
+}
+
+int main()
+{
+    std::vector<Variant> variants;
+    for (const auto v : {Variant::Scalar, Variant::SSE2, Variant::AVX2}) {
+        if (select(v))
+            variants.push_back(v);
+        else
+            std::printf("%s is not supported here; skipped.\n", variantName(v));
+    }
+
+    std::vector<std::size_t> counts;
+    for (std::size_t n = 0; n <= 80; ++n)
+        counts.push_back(n);
+    for (const std::size_t n : {127, 128, 129, 1000, 4093, 4096, 4103})
+        counts.push_back(n);
+
+    std::mt19937 rng (1);
+    int failures = 0;
+    std::size_t cases = 0;
+    for (const auto count : counts) {
+        const auto in = makeInputs(rng, count + MaxOffset, count % 3 == 0);
+        for (std::size_t offset = 0; offset < MaxOffset; ++offset) {
+            select(Variant::Scalar);
+            const auto ref = run(in, offset, count);
+            for (const auto v : variants) {
+                if (v == Variant::Scalar)
+                    continue;
+                select(v);
+                failures += compare(v, run(in, offset, count), ref, offset, count);
+            }
+            ++cases;
+        }
+    }
+
+    std::printf("%zu cases over %zu variants: %s\n", cases, variants.size(),
+        failures == 0 ? "all kernels agree" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
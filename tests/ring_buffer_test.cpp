@@ -0,0 +1,124 @@
+/**
+ * ring_buffer_test.cpp
+ * Written by Clyne Sullivan.
+ *
+ * Checks RingBuffer against a plain vector holding everything written. Writes
+ * of random sizes, from empty to more than the capacity, wrap around the
+ * buffer many times; after each, holds() and read_spans() are compared with
+ * the model at random positions and at the edges of what is held.
+ *
+ * Built and run by `make test`, or by ctest.
+ */
+
+#include "circular.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const char *what, std::size_t capacity, std::size_t end)
+    {
+        if (!ok) {
+            std::printf("%s (capacity %zu, end %zu)\n", what, capacity, end);
+            ++failures;
+        }
+    }
+
+    // Whether read_spans() gives the model's positions [first, first + count).
+    bool readsBack(const RingBuffer<uint32_t>& ring,
+        const std::vector<uint32_t>& model, std::size_t first, std::size_t count)
+    {
+        const auto spans = ring.read_spans(first, count);
+        if (spans[0].size() + spans[1].size() != count)
+            return false;
+        if (!spans[1].empty() && spans[0].data() + spans[0].size() !=
+            ring.read_spans(0, ring.capacity())[0].data() + ring.capacity())
+        {
+            return false; // The first region must run to the buffer's end.
+        }
+
+        auto expected = model.begin() + first;
+        for (const auto& span : spans) {
+            for (const auto value : span) {
+                if (value != *expected++)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void testCapacity(std::mt19937& rng, std::size_t requested)
+    {
+        RingBuffer<uint32_t> ring (requested);
+        const auto capacity = ring.capacity();
+        check(capacity == std::bit_ceil(requested),
+            "capacity is not rounded to a power of two", capacity, 0);
+
+        std::vector<uint32_t> model;
+        std::vector<uint32_t> chunk;
+        uint32_t next = 0;
+        for (int step = 0; step < 2000; ++step) {
+            if (step == 1000) {
+                ring.reset();
+                model.clear();
+            }
+
+            // Mostly small writes, some exactly the capacity, some larger.
+            std::size_t size;
+            switch (rng() % 8) {
+            case 0:  size = 0; break;
+            case 1:  size = capacity; break;
+            case 2:  size = capacity + 1 + rng() % (2 * capacity); break;
+            default: size = rng() % (capacity / 2 + 2); break;
+            }
+            chunk.resize(size);
+            for (auto& value : chunk)
+                value = next++;
+            ring.write(chunk);
+            model.insert(model.end(), chunk.begin(), chunk.end());
+
+            const auto end = model.size();
+            const auto begin = end > capacity ? end - capacity : 0;
+            check(ring.end() == end, "end() is wrong", capacity, end);
+            check(ring.begin() == begin, "begin() is wrong", capacity, end);
+            check(ring.holds(begin, end - begin), "does not hold the newest elements",
+                capacity, end);
+            check(readsBack(ring, model, begin, end - begin),
+                "reads back the newest elements wrongly", capacity, end);
+            check(!ring.holds(end, 1), "holds past the end", capacity, end);
+            if (begin > 0)
+                check(!ring.holds(begin - 1, 1), "holds an overwritten element",
+                    capacity, end);
+
+            for (int i = 0; i < 4 && end > begin; ++i) {
+                const auto first = begin + rng() % (end - begin);
+                const auto count = rng() % (end - first + 1);
+                check(ring.holds(first, count), "does not hold a range it should",
+                    capacity, end);
+                check(readsBack(ring, model, first, count), "reads a range back wrongly",
+                    capacity, end);
+
+                const auto over = first + rng() % (2 * capacity + 1);
+                const bool held = over >= begin && over + count <= end;
+                check(ring.holds(over, count) == held, "holds() disagrees with the model",
+                    capacity, end);
+            }
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 rng (1);
+    for (const std::size_t capacity : {0, 1, 2, 3, 5, 8, 31, 64, 100, 1000, 4096})
+        testCapacity(rng, capacity);
+
+    std::printf("%s\n", failures == 0 ? "RingBuffer agrees with the model" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
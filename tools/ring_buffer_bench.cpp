@@ -0,0 +1,102 @@
+/**
+ * ring_buffer_bench.cpp
+ * Written by Clyne Sullivan.
+ *
+ * Compares writing chunks of samples into RingBuffer, with write(), against
+ * the element-at-a-time put() loop of the CircularBuffer it replaced, kept
+ * here as the baseline. Both buffers hold the same number of samples and are
+ * given the same chunks; the rate of each is reported for a few chunk sizes.
+ *
+ * Build with:
+ *   g++ -std=c++20 -O2 -I../source -o ring_buffer_bench ring_buffer_bench.cpp
+ * and run as:
+ *   ./ring_buffer_bench [CAPACITY] [SECONDS_PER_CASE]
+ */
+
+#include "circular.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// The old CircularBuffer: writes one element at a time, wrapping at the end.
+class PutBuffer
+{
+public:
+    explicit PutBuffer(std::vector<uint16_t>& storage) :
+        m_begin(storage.begin()),
+        m_end(storage.end()),
+        m_current(m_begin) {}
+
+    void put(uint16_t value) noexcept {
+        *m_current = value;
+        if (++m_current == m_end)
+            m_current = m_begin;
+    }
+
+private:
+    std::vector<uint16_t>::iterator m_begin;
+    std::vector<uint16_t>::iterator m_end;
+    std::vector<uint16_t>::iterator m_current;
+};
+
+// Writes the chunk over and over for about the given time; returns samples/s.
+template<typename Write>
+static double measure(const std::vector<uint16_t>& chunk, double seconds, Write write)
+{
+    std::size_t written = 0;
+    const auto start = Clock::now();
+    const auto stop = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(seconds));
+    auto now = start;
+    while (now < stop) {
+        for (int i = 0; i < 64; ++i)
+            write(chunk);
+        written += 64 * chunk.size();
+        now = Clock::now();
+    }
+    return written / std::chrono::duration<double>(now - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t capacity = argc > 1 ? std::atoi(argv[1]) : 1 << 20;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 0.5;
+
+    RingBuffer<uint16_t> ring (capacity);
+    std::vector<uint16_t> storage (ring.capacity());
+    PutBuffer baseline (storage);
+
+    std::mt19937 rng (1);
+    std::printf("capacity %zu samples\n", ring.capacity());
+    std::printf("%10s %16s %18s %8s\n", "chunk", "put() Msamples/s", "write() Msamples/s",
+        "speedup");
+    for (const std::size_t size : {16, 256, 4096, 65536}) {
+        // A larger chunk would let write() skip all but its newest samples.
+        if (size > ring.capacity())
+            break;
+
+        std::vector<uint16_t> chunk (size);
+        for (auto& s : chunk)
+            s = static_cast<uint16_t>(rng() % 4096);
+
+        const auto put = measure(chunk, seconds, [&baseline](const auto& c) {
+            for (const auto s : c)
+                baseline.put(s);
+        });
+        const auto write = measure(chunk, seconds, [&ring](const auto& c) {
+            ring.write(c);
+        });
+        std::printf("%10zu %16.0f %18.0f %7.1fx\n", size, put / 1e6, write / 1e6,
+            write / put);
+    }
+
+    // Reads the buffers back so that the writes are not optimized away; the
+    // samples are all below 4096, so this is always zero.
+    return (storage[0] | ring.read_spans(ring.begin(), 1)[0][0]) > 4095;
+}
@@ -0,0 +1,160 @@
+/**
+ * stream_bench.cpp
+ * Written by Clyne Sullivan.
+ *
+ * Measures how fast the stream server fans chunks out. Synthetic chunks are published as fast as
+ * they can be, to a number of subscribers that read and check every frame, over a Unix domain
+ * socket. The total rate delivered and the share of frames dropped are reported.
+ *
+ * Build with:
+ *   g++ -std=c++20 -O2 -I../source -I../source/stmdsp -I../source/serial/include \
+ *       -o stream_bench stream_bench.cpp ../source/stream_server.cpp ../source/chunk.cpp -lpthread
+ * and run as:
+ *   ./stream_bench [SUBSCRIBERS] [SECONDS] [SAMPLES_PER_CHUNK]
+ */
+
+#include "chunk.hpp"
+#include "stream_server.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void log(const std::string&) {}
+
+struct Reader {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t missed = 0;
+    bool ok = true;
+};
+
+static bool readAll(int fd, void *buffer, std::size_t size)
+{
+    for (auto p = static_cast<char *>(buffer); size > 0;) {
+        const auto n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void subscribe(const std::string& path, Reader& reader)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        reader.ok = false;
+        return;
+    }
+
+    std::vector<char> payload;
+    uint64_t expected = 0;
+    bool first = true;
+    stmdsp_frame frame;
+    while (readAll(fd, &frame, sizeof(frame))) {
+        payload.resize(frame.size);
+        if (frame.magic != STMDSP_STREAM_MAGIC || !readAll(fd, payload.data(), frame.size)) {
+            reader.ok = false;
+            break;
+        }
+
+        if (frame.type == STMDSP_FRAME_SAMPLES) {
+            stmdsp_frame_samples info;
+            std::memcpy(&info, payload.data(), sizeof(info));
+            const auto samples = reinterpret_cast<const uint16_t *>(payload.data() + sizeof(info));
+            if (samples[0] != static_cast<uint16_t>(frame.sequence))
+                reader.ok = false;
+            if (!first)
+                reader.missed += frame.sequence - expected;
+            first = false;
+            expected = frame.sequence + 1;
+            ++reader.frames;
+        }
+        reader.bytes += sizeof(frame) + frame.size;
+    }
+
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    const int subscribers = argc > 1 ? std::atoi(argv[1]) : 4;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 3;
+    const std::size_t samples = argc > 3 ? std::atoi(argv[3]) : 4096;
+
+    const auto path = "/tmp/stmdsp_bench." + std::to_string(getpid()) + ".sock";
+    StreamServer server;
+    std::string error;
+    if (!server.open(path, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::jthread serving ([&server](std::stop_token stop) { server.run(stop); });
+
+    std::vector<Reader> readers (subscribers);
+    std::vector<std::thread> threads;
+    for (auto& r : readers)
+        threads.emplace_back(subscribe, path, std::ref(r));
+    while (server.stats().subscribers < static_cast<std::size_t>(subscribers))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    ChunkPool pool (ChunkStream::Capacity);
+    ChunkStream stream; // Holds chunks as the device's stream would.
+    const auto start = std::chrono::steady_clock::now();
+    const auto stop = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(seconds));
+    uint64_t published = 0;
+    while (std::chrono::steady_clock::now() < stop) {
+        auto ref = pool.acquire();
+        auto& fill = ref.edit();
+        fill.output.assign(samples, static_cast<uint16_t>(published));
+        fill.input.assign(samples, 0);
+        fill.stream = 1;
+        server.publish(ref, published++, 96000);
+        stream.publish(std::move(ref));
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    serving.request_stop();
+    serving.join();
+    for (auto& t : threads)
+        t.join();
+
+    const auto stats = server.stats();
+    uint64_t frames = 0, bytes = 0, missed = 0;
+    bool ok = true;
+    for (const auto& r : readers) {
+        frames += r.frames;
+        bytes += r.bytes;
+        missed += r.missed;
+        ok = ok && r.ok;
+    }
+
+    const double offered = static_cast<double>(published) * subscribers;
+    std::printf("%d subscribers, %zu-sample chunks (output and input), %.1f s\n",
+        subscribers, samples, elapsed.count());
+    std::printf("published %.0f chunks/s\n", published / elapsed.count());
+    std::printf("delivered %.0f frames/s, %.1f MB/s, %.1f Msamples/s in total\n",
+        frames / elapsed.count(), bytes / elapsed.count() / 1e6,
+        frames * 2. * samples / elapsed.count() / 1e6);
+    std::printf("dropped %.1f%% of frames (%llu counted by the server, %llu seen missing)\n",
+        offered > 0 ? 100. * stats.dropped / offered : 0.,
+        static_cast<unsigned long long>(stats.dropped),
+        static_cast<unsigned long long>(missed));
+    std::printf("%s\n", ok ? "all frames intact" : "ERROR: damaged frames");
+    return ok ? 0 : 1;
+}
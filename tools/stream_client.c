@@ -0,0 +1,142 @@
+/**
+ * stream_client.c
+ * Written by Clyne Sullivan.
+ *
+ * A reference subscriber for the stream server (see source/stmdsp_stream.h). It prints each
+ * status event as it comes, and once a second the rate of samples received along with any chunks
+ * missed. A delay per frame can be given to see how a slow subscriber is treated.
+ *
+ * Build with:
+ *   cc -O2 -I../source -o stream_client stream_client.c
+ * and run as:
+ *   ./stream_client [ADDRESS] [DELAY_MS]
+ * where ADDRESS is the server's socket path (default /tmp/stmdsp.sock), PORT or HOST:PORT.
+ * The server only listens on loopback addresses, so HOST is 127.0.0.1 (the default), localhost
+ * or ::1.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "stmdsp_stream.h"
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static int connect_to(const char *address)
+{
+    if (strchr(address, '/')) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    char host[256] = "127.0.0.1";
+    const char *port = address;
+    const char *colon = strrchr(address, ':');
+    if (colon) {
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+        port = colon + 1;
+    }
+
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *info;
+    if (getaddrinfo(host, port, &hints, &info) != 0)
+        return -1;
+    int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+static int read_all(int fd, void *buffer, size_t size)
+{
+    for (char *p = buffer; size > 0;) {
+        const ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return 0;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = argc > 1 ? argv[1] : STMDSP_STREAM_DEFAULT_PATH;
+    const int delay_ms = argc > 2 ? atoi(argv[2]) : 0;
+
+    const int fd = connect_to(address);
+    if (fd < 0) {
+        perror(address);
+        return 1;
+    }
+
+    static char payload[1 << 20];
+    uint64_t expected = 0, missed = 0, samples = 0, dropped = 0;
+    int first = 1;
+    double next = now() + 1;
+
+    stmdsp_frame frame;
+    while (read_all(fd, &frame, sizeof(frame))) {
+        if (frame.magic != STMDSP_STREAM_MAGIC || frame.size > sizeof(payload)) {
+            fprintf(stderr, "Bad frame.\n");
+            return 1;
+        }
+        if (!read_all(fd, payload, frame.size))
+            break;
+
+        if (frame.type == STMDSP_FRAME_SAMPLES) {
+            stmdsp_frame_samples info;
+            memcpy(&info, payload, sizeof(info));
+            /* Samples follow: info.output_count, then info.input_count. */
+            if (!first && frame.sequence != expected)
+                missed += frame.sequence - expected;
+            first = 0;
+            expected = frame.sequence + 1;
+            samples += info.output_count;
+            dropped = info.dropped;
+
+            if (delay_ms > 0)
+                usleep(delay_ms * 1000);
+        } else if (frame.type == STMDSP_FRAME_STATUS) {
+            stmdsp_frame_status status;
+            memcpy(&status, payload, sizeof(status));
+            printf("event %u (%u): %.*s\n", status.event, status.value,
+                (int)(frame.size - sizeof(status)), payload + sizeof(status));
+            fflush(stdout);
+        }
+
+        if (now() >= next) {
+            printf("%llu samples/s, %llu chunks missed, %llu dropped by the server\n",
+                (unsigned long long)samples, (unsigned long long)missed,
+                (unsigned long long)dropped);
+            fflush(stdout);
+            samples = 0;
+            next += 1;
+        }
+    }
+
+    printf("Server closed the connection.\n");
+    close(fd);
+    return 0;
+}